@@ -0,0 +1,295 @@
+﻿/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+/********************************************************************************
+ *                                                                              *
+ * A command line application that reports the elements in an IFC file that    *
+ * intersect, or that are closer to each other than a given clearance, between  *
+ * two sets of elements selected by their entity types.                         *
+ *                                                                              *
+ ********************************************************************************/
+
+#include "../ifcgeom/IfcGeomTree.h"
+
+#include <Standard_Version.hxx>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/program_options.hpp>
+#include <boost/thread.hpp>
+
+#include <fstream>
+#include <iomanip>
+#include <set>
+
+#if USE_VLD
+#include <vld.h>
+#endif
+
+namespace po = boost::program_options;
+
+void print_version(std::ostream& os = std::cout)
+{
+	os << "IfcOpenShell " << IfcSchema::Identifier << " IfcClash " << IFCOPENSHELL_VERSION << " (OCC " << OCC_VERSION_STRING_EXT << ")\n";
+}
+
+void print_usage(bool suggest_help = true)
+{
+	std::cout << "Usage: IfcClash [options] <input.ifc> [<output>]\n"
+		<< "\n"
+		<< "Reports the clashes between two sets of elements in an IFC file as:\n"
+		<< "  .json  JSON           An array of clashes\n"
+		<< "  .csv   CSV            One clash per line\n"
+		<< "\n"
+		<< "If no output filename given, the clashes are written to standard output as JSON.\n";
+	if (suggest_help) {
+		std::cout << "\nRun 'IfcClash --help' for more information.";
+	}
+	std::cout << std::endl;
+}
+
+// The products of any of the types, excluding those of the excluded types, ordered by instance id
+IfcSchema::IfcProduct::list::ptr select_products(IfcParse::IfcFile& f, const std::vector<std::string>& types, const std::vector<std::string>& exclude)
+{
+	std::set<IfcSchema::Type::Enum> excluded;
+	for (std::vector<std::string>::const_iterator it = exclude.begin(); it != exclude.end(); ++it) {
+		excluded.insert(IfcSchema::Type::FromString(boost::to_upper_copy(*it)));
+	}
+
+	std::map<unsigned int, IfcSchema::IfcProduct*> products;
+	for (std::vector<std::string>::const_iterator it = types.begin(); it != types.end(); ++it) {
+		IfcEntityList::ptr es = f.entitiesByType(IfcSchema::Type::FromString(boost::to_upper_copy(*it)));
+		if (!es) {
+			continue;
+		}
+		for (IfcEntityList::it jt = es->begin(); jt != es->end(); ++jt) {
+			if (!(*jt)->is(IfcSchema::Type::IfcProduct)) {
+				continue;
+			}
+			bool is_excluded = false;
+			for (std::set<IfcSchema::Type::Enum>::const_iterator kt = excluded.begin(); kt != excluded.end(); ++kt) {
+				if ((*jt)->is(*kt)) {
+					is_excluded = true;
+					break;
+				}
+			}
+			if (!is_excluded) {
+				products[(*jt)->entity->id()] = (IfcSchema::IfcProduct*)*jt;
+			}
+		}
+	}
+
+	IfcSchema::IfcProduct::list::ptr result(new IfcSchema::IfcProduct::list);
+	for (std::map<unsigned int, IfcSchema::IfcProduct*>::const_iterator it = products.begin(); it != products.end(); ++it) {
+		result->push(it->second);
+	}
+	return result;
+}
+
+void write_json(std::ostream& os, const std::vector<IfcGeom::tree::clash_t>& clashes)
+{
+	os << "[";
+	for (std::vector<IfcGeom::tree::clash_t>::const_iterator it = clashes.begin(); it != clashes.end(); ++it) {
+		os << (it == clashes.begin() ? "\n" : ",\n")
+			<< "  {\"a\": \"" << it->a->GlobalId() << "\", \"a_type\": \"" << IfcSchema::Type::ToString(it->a->type())
+			<< "\", \"b\": \"" << it->b->GlobalId() << "\", \"b_type\": \"" << IfcSchema::Type::ToString(it->b->type())
+			<< "\", \"type\": \"" << (it->type == IfcGeom::tree::clash_t::COLLISION ? "collision" : "clearance")
+			<< "\", \"distance\": " << it->distance
+			<< ", \"point\": [" << it->point.X() << ", " << it->point.Y() << ", " << it->point.Z() << "]}";
+	}
+	os << "\n]\n";
+}
+
+void write_csv(std::ostream& os, const std::vector<IfcGeom::tree::clash_t>& clashes)
+{
+	os << "a,a_type,b,b_type,type,distance,x,y,z\n";
+	for (std::vector<IfcGeom::tree::clash_t>::const_iterator it = clashes.begin(); it != clashes.end(); ++it) {
+		os << it->a->GlobalId() << "," << IfcSchema::Type::ToString(it->a->type()) << ","
+			<< it->b->GlobalId() << "," << IfcSchema::Type::ToString(it->b->type()) << ","
+			<< (it->type == IfcGeom::tree::clash_t::COLLISION ? "collision" : "clearance") << ","
+			<< it->distance << "," << it->point.X() << "," << it->point.Y() << "," << it->point.Z() << "\n";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	po::options_description generic_options("Command line options");
+	generic_options.add_options()
+		("help,h", "display usage information")
+		("version", "display version information")
+		("verbose,v", "more verbose log messages")
+		("quiet,q", "less status and progress output");
+
+	po::options_description fileio_options;
+	fileio_options.add_options()
+		("input-file", po::value<std::string>(), "input IFC file")
+		("output-file", po::value<std::string>(), "output clash report");
+
+	std::vector<std::string> a_types, b_types, exclude_types;
+	double tolerance, clearance, deflection;
+	int num_threads;
+
+	po::options_description clash_options("Clash options");
+	clash_options.add_options()
+		("a", po::value< std::vector<std::string> >(&a_types)->multitoken(),
+			"entity types of the first set of elements, including subtypes. Defaults to IfcElement.")
+		("b", po::value< std::vector<std::string> >(&b_types)->multitoken(),
+			"entity types of the second set of elements, including subtypes. Defaults to IfcElement.")
+		("exclude", po::value< std::vector<std::string> >(&exclude_types)->multitoken(),
+			"entity types that are excluded from both sets. Defaults to IfcOpeningElement and IfcSpace.")
+		("tolerance", po::value<double>(&tolerance)->default_value(0.),
+			"the penetration depth up to which intersecting elements are not reported")
+		("clearance", po::value<double>(&clearance)->default_value(0.),
+			"also report elements that do not intersect, but are closer to each other than this distance")
+		("threads,j", po::value<int>(&num_threads)->default_value(static_cast<int>(boost::thread::hardware_concurrency())),
+			"number of threads used for the conversion of the geometry and the clash tests")
+		("exact",
+			"test for intersections with boolean operations, rather than on triangle meshes of the elements")
+		("deflection-tolerance", po::value<double>(&deflection)->default_value(1e-3),
+			"the deflection of the triangle meshes of the elements");
+
+	po::options_description cmdline_options;
+	cmdline_options.add(generic_options).add(fileio_options).add(clash_options);
+
+	po::positional_options_description positional_options;
+	positional_options.add("input-file", 1);
+	positional_options.add("output-file", 1);
+
+	po::variables_map vmap;
+	try {
+		po::store(po::command_line_parser(argc, argv).
+			options(cmdline_options).positional(positional_options).run(), vmap);
+	} catch (const po::unknown_option& e) {
+		std::cerr << "[Error] Unknown option '" << e.get_option_name() << "'\n\n";
+		print_usage();
+		return EXIT_FAILURE;
+	} catch (const po::error_with_option_name& e) {
+		std::cerr << "[Error] Invalid usage of '" << e.get_option_name() << "': " << e.what() << "\n\n";
+		return EXIT_FAILURE;
+	} catch (const std::exception& e) {
+		std::cerr << "[Error] " << e.what() << "\n\n";
+		print_usage();
+		return EXIT_FAILURE;
+	}
+
+	po::notify(vmap);
+
+	const bool verbose = vmap.count("verbose") != 0;
+	const bool quiet = vmap.count("quiet") != 0;
+	const bool exact = vmap.count("exact") != 0;
+
+	if (vmap.count("version")) {
+		print_version();
+		return EXIT_SUCCESS;
+	} else if (vmap.count("help")) {
+		print_usage(false);
+		std::cout << "\n" << generic_options.add(clash_options) << std::endl;
+		return EXIT_SUCCESS;
+	} else if (!vmap.count("input-file")) {
+		std::cerr << "[Error] Input file not specified" << std::endl;
+		print_usage();
+		return EXIT_FAILURE;
+	}
+
+	const std::string input_filename = vmap["input-file"].as<std::string>();
+	const std::string output_filename = vmap.count("output-file") ? vmap["output-file"].as<std::string>() : std::string();
+	const bool csv = boost::iends_with(output_filename, ".csv");
+
+	if (a_types.empty()) {
+		a_types.push_back("IfcElement");
+	}
+	if (b_types.empty()) {
+		b_types.push_back("IfcElement");
+	}
+	if (!vmap.count("exclude")) {
+		exclude_types.push_back("IfcOpeningElement");
+		exclude_types.push_back("IfcSpace");
+	}
+
+	// The report can be written to standard output, so messages go to standard error
+	Logger::SetOutput(quiet ? 0 : &std::cerr, &std::cerr);
+	Logger::Verbosity(verbose ? Logger::LOG_NOTICE : Logger::LOG_ERROR);
+
+	if (!quiet) {
+		// Like the log messages, so that a report on standard output stays valid
+		print_version(std::cerr);
+	}
+
+	IfcParse::IfcFile file;
+	if (!file.Init(input_filename)) {
+		Logger::Error("Unable to parse input file '" + input_filename + "'");
+		return EXIT_FAILURE;
+	}
+
+	IfcSchema::IfcProduct::list::ptr a, b;
+	try {
+		a = select_products(file, a_types, exclude_types);
+		b = select_products(file, b_types, exclude_types);
+	} catch (const IfcParse::IfcException& e) {
+		std::cerr << "[Error] " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Only the elements in either set are converted
+	IfcSchema::IfcProduct::list::ptr products(new IfcSchema::IfcProduct::list);
+	std::set<IfcSchema::IfcProduct*> unique_products;
+	IfcSchema::IfcProduct::list::ptr sets[2] = { a, b };
+	for (int i = 0; i < 2; ++i) {
+		for (IfcSchema::IfcProduct::list::it it = sets[i]->begin(); it != sets[i]->end(); ++it) {
+			if (unique_products.insert(*it).second) {
+				products->push(*it);
+			}
+		}
+	}
+
+	Logger::Status("Converting " + boost::lexical_cast<std::string>(products->size()) + " elements...");
+
+	IfcGeom::tree tree;
+	tree.add_products(file, IfcGeom::IteratorSettings(), products, num_threads);
+	if (!exact) {
+		tree.set_mesh_narrow_phase(true, tolerance, deflection);
+	}
+
+	Logger::Status("Testing for clashes...");
+
+	const std::vector<IfcGeom::tree::clash_t> clashes = tree.clashes(
+		std::vector<IfcSchema::IfcProduct*>(a->begin(), a->end()),
+		std::vector<IfcSchema::IfcProduct*>(b->begin(), b->end()),
+		tolerance, clearance, num_threads);
+
+	Logger::Status(boost::lexical_cast<std::string>(clashes.size()) + " clashes found");
+
+	std::ofstream output_file;
+	if (!output_filename.empty()) {
+		output_file.open(output_filename.c_str());
+		if (!output_file.is_open()) {
+			Logger::Error("Unable to open output file '" + output_filename + "'");
+			return EXIT_FAILURE;
+		}
+	}
+	std::ostream& os = output_filename.empty() ? std::cout : output_file;
+	os << std::setprecision(15);
+	if (csv) {
+		write_csv(os, clashes);
+	} else {
+		write_json(os, clashes);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -63,7 +63,7 @@ void ColladaSerializer::ColladaExporter::ColladaGeometries::addFloatSource(const
 void ColladaSerializer::ColladaExporter::ColladaGeometries::write(
     const std::string &mesh_id, const std::string& /*default_material_name*/, const std::vector<real_t>& positions,
     const std::vector<real_t>& normals, const std::vector<int>& faces, const std::vector<int>& edges,
-    const std::vector<int> material_ids, const std::vector<IfcGeom::Material>& materials,
+    const std::vector<int>& material_ids, const std::vector<IfcGeom::Material>& materials,
     const std::vector<real_t>& uvs)
 {
 	openMesh(mesh_id);
@@ -406,8 +406,17 @@ void ColladaSerializer::ColladaExporter::write(const IfcGeom::TriangulationEleme
 				: o->unique_id()));
 	collada_id(name);
 	
-	std::string representation_id = "representation-" + o->geometry().id();
-	collada_id(representation_id);
+	// Products that share a triangulation refer to a single geometry by means of
+	// instance_geometry, the id of the first representation encountered is used.
+	std::map<const IfcGeom::Representation::Triangulation<real_t>*, std::string>::const_iterator id_it = representation_ids.find(&mesh);
+	std::string representation_id;
+	if (id_it == representation_ids.end()) {
+		representation_id = "representation-" + mesh.id();
+		collada_id(representation_id);
+		representation_ids[&mesh] = representation_id;
+	} else {
+		representation_id = id_it->second;
+	}
 
 	std::vector<std::string> material_references;
 	BOOST_FOREACH(const IfcGeom::Material& material, mesh.materials()) {
@@ -420,8 +429,7 @@ void ColladaSerializer::ColladaExporter::write(const IfcGeom::TriangulationEleme
 		material_references.push_back(material_name);
 	}
 
-	DeferredObject deferred(name, representation_id, o->type(), o->transformation(), mesh.verts(), mesh.normals(), 
-		mesh.faces(), mesh.edges(), mesh.material_ids(), mesh.materials(), material_references, mesh.uvs());
+	DeferredObject deferred(name, representation_id, o->type(), o->transformation(), o->geometry_pointer(), material_references);
 
 	if (serializer->settings().get(SerializerSettings::USE_ELEMENT_HIERARCHY)) {
 		deferred.parents() = o->parents();
@@ -478,7 +486,8 @@ void ColladaSerializer::ColladaExporter::endDocument() {
 			continue;
 		}
 		geometries_written.insert(it->representation_id);
-		geometries.write(it->representation_id, it->type, it->vertices, it->normals, it->faces, it->edges, it->material_ids, it->materials, it->uvs);
+		const IfcGeom::Representation::Triangulation<real_t>& mesh = *it->geometry;
+		geometries.write(it->representation_id, it->type, mesh.verts(), mesh.normals(), mesh.faces(), mesh.edges(), mesh.material_ids(), mesh.materials(), mesh.uvs());
 	}
 	geometries.close();
 
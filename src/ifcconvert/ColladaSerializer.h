@@ -48,6 +48,8 @@
 #include <boost/numeric/ublas/matrix.hpp>
 #include <boost/numeric/ublas/io.hpp>
 
+#include <map>
+
 
 class ColladaSerializer : public GeometrySerializer
 {
@@ -72,7 +74,7 @@ private:
             void write(const std::string &mesh_id, const std::string& default_material_name,
                 const std::vector<real_t>& positions, const std::vector<real_t>& normals,
                 const std::vector<int>& faces, const std::vector<int>& edges,
-                const std::vector<int> material_ids, const std::vector<IfcGeom::Material>& materials,
+                const std::vector<int>& material_ids, const std::vector<IfcGeom::Material>& materials,
                 const std::vector<real_t>& uvs);
 			void close();
             ColladaSerializer *serializer;
@@ -155,32 +157,20 @@ private:
 		public:
 			std::string unique_id, representation_id, type;
 			IfcGeom::Transformation<real_t> transformation;
-			std::vector<real_t> vertices;
-			std::vector<real_t> normals;
-			std::vector<int> faces;
-			std::vector<int> edges;
-			std::vector<int> material_ids;
-			std::vector<IfcGeom::Material> materials;
+			/// Shared by all products that instantiate the same geometry, the
+			/// mesh data is written once and referenced by representation_id.
+			boost::shared_ptr< IfcGeom::Representation::Triangulation<real_t> > geometry;
 			std::vector<std::string> material_references;
-            std::vector<real_t> uvs;
 			std::vector<const IfcGeom::Element<real_t>*> parents_;
 
 			DeferredObject(const std::string& unique_id, const std::string& representation_id, const std::string& type, const IfcGeom::Transformation<real_t>& transformation,
-				const std::vector<real_t>& vertices, const std::vector<real_t>& normals, const std::vector<int>& faces,
-				const std::vector<int>& edges, const std::vector<int>& material_ids, const std::vector<IfcGeom::Material>& materials,
-				const std::vector<std::string>& material_references, const std::vector<real_t>& uvs)
+				const boost::shared_ptr< IfcGeom::Representation::Triangulation<real_t> >& geometry, const std::vector<std::string>& material_references)
 				: unique_id(unique_id)
 				, representation_id(representation_id)
 				, type(type)
 				, transformation(transformation)
-				, vertices(vertices)
-				, normals(normals)
-				, faces(faces)
-				, edges(edges)
-				, material_ids(material_ids)
-				, materials(materials)
+				, geometry(geometry)
 				, material_references(material_references)
-				, uvs(uvs)
 			{}
 
 			std::vector<const IfcGeom::Element<real_t>*>& parents() { return parents_; }
@@ -206,6 +196,9 @@ private:
         ColladaGeometries geometries;
         ColladaSerializer *serializer;
 		std::vector<DeferredObject> deferreds;
+		/// Geometry ids by triangulation, so that triangulations shared between
+		/// distinct representations, e.g. by deduplication, are instanced as well.
+		std::map<const IfcGeom::Representation::Triangulation<real_t>*, std::string> representation_ids;
 		virtual ~ColladaExporter() {}
 		void startDocument(const std::string& unit_name, float unit_magnitude);
 		void write(const IfcGeom::TriangulationElement<real_t>* o);
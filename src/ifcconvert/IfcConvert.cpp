@@ -173,6 +173,14 @@ int main(int argc, char** argv)
 		
 
     double deflection_tolerance;
+    double relative_deflection, min_deflection, max_deflection, angular_deflection;
+    std::vector<double> lod_deflections;
+    double simplification_ratio, simplification_error;
+    int max_boolean_attempts;
+    double boolean_timeout;
+    std::string cache_directory;
+    double cache_size_limit;
+    double cache_memory_limit;
     inclusion_filter include_filter;
     inclusion_traverse_filter include_traverse_filter;
     exclusion_filter exclude_filter;
@@ -224,6 +232,33 @@ int main(int argc, char** argv)
 		("enable-layerset-slicing", 
 			"Specifies whether to enable the slicing of products according "
 			"to their associated IfcMaterialLayerSet.")
+		("deduplicate-representations",
+			"Specifies whether to share the geometry of representations that are "
+			"structurally identical, but defined by different instances in the IFC "
+			"file, between the products that use them.")
+		("boolean-attempts", po::value<int>(&max_boolean_attempts)->default_value(-1),
+			"Sets the maximum number of boolean operations, including retries, that are "
+			"attempted for a single product. When exceeded the product is written without "
+			"its openings subtracted. Unlimited by default.")
+		("boolean-timeout", po::value<double>(&boolean_timeout)->default_value(-1.),
+			"Sets the maximum time in seconds spent on boolean operations for a single "
+			"product. When exceeded the product is written without its openings "
+			"subtracted. Unlimited by default.")
+		("boolean-bounding-box-fallback",
+			"Write the bounding boxes of products for which --boolean-attempts or "
+			"--boolean-timeout are exceeded, rather than their shapes without openings.")
+		("cache-directory", po::value<std::string>(&cache_directory),
+			"Directory in which converted representations are stored, so that subsequent "
+			"conversions of the same or a modified model with the same settings can reuse "
+			"them. Disabled by default.")
+		("cache-size", po::value<double>(&cache_size_limit)->default_value(1024.),
+			"Sets the maximum size in megabytes of the --cache-directory, when exceeded "
+			"the least recently used entries are removed.")
+		("cache-memory", po::value<double>(&cache_memory_limit)->default_value(512.),
+			"Sets the memory budget in megabytes for intermediate conversion results, such "
+			"as placements and profiles, that are retained to be reused by subsequent "
+			"products. When exceeded the least recently used results are discarded. "
+			"Negative values denote no limit.")
         ("include", po::value<inclusion_filter>(&include_filter)->multitoken(),
             "Specifies that the entities that match a specific filtering criteria are to be included in the geometrical output:\n"
             "1) 'entities': the following list of types should be included. SVG output defaults "
@@ -251,6 +286,30 @@ int main(int argc, char** argv)
             "model in other modelling application in any case.")
         ("deflection-tolerance", po::value<double>(&deflection_tolerance)->default_value(1e-3),
             "Sets the deflection tolerance of the mesher, 1e-3 by default if not specified.")
+        ("relative-deflection", po::value<double>(&relative_deflection)->default_value(0.),
+            "Sets the deflection tolerance of the mesher relative to the bounding box diagonal "
+            "of every shape, clamped by --min-deflection and --max-deflection. When positive, "
+            "--deflection-tolerance is ignored. Disabled by default.")
+        ("min-deflection", po::value<double>(&min_deflection)->default_value(1e-4),
+            "Sets the lower bound of the deflection tolerance derived from --relative-deflection.")
+        ("max-deflection", po::value<double>(&max_deflection)->default_value(1e-1),
+            "Sets the upper bound of the deflection tolerance derived from --relative-deflection.")
+        ("angular-deflection", po::value<double>(&angular_deflection)->default_value(0.5),
+            "Sets the angular deflection of the mesher in radians, 0.5 by default if not specified.")
+        ("lod-deflections", po::value< std::vector<double> >(&lod_deflections)->multitoken(),
+            "Triangulates every element again for each of the given deflection tolerances, "
+            "which yields additional levels of detail without converting the model repeatedly. "
+            "Relative deflections when --relative-deflection is used. Currently only written by "
+            "WaveFront OBJ output, each level to its own file with a .lod<n>.obj extension that "
+            "uses the same material library. Cannot be placed "
+            "right before the input file argument.")
+        ("simplify-ratio", po::value<double>(&simplification_ratio)->default_value(1.),
+            "Simplifies triangulations by collapsing edges until at most the given fraction "
+            "of triangles remains. Boundary edges and material boundaries are retained. Works "
+            "best with --weld-vertices. Disabled by default.")
+        ("simplify-error", po::value<double>(&simplification_error)->default_value(-1.),
+            "Sets the maximal geometric error in meters introduced by simplifying triangulations. "
+            "Can be used on its own or together with --simplify-ratio. Disabled by default.")
         ("generate-uvs",
             "Generates UVs (texture coordinates) by using simple box projection. Requires normals. "
             "Not guaranteed to work properly if used with --weld-vertices.")
@@ -354,6 +413,8 @@ int main(int argc, char** argv)
 	const bool include_plan = vmap.count("plan") != 0;
 	const bool include_model = vmap.count("model") != 0 || (!include_plan);
 	const bool enable_layerset_slicing = vmap.count("enable-layerset-slicing") != 0;
+	const bool boolean_bounding_box_fallback = vmap.count("boolean-bounding-box-fallback") != 0;
+	const bool deduplicate_representations = vmap.count("deduplicate-representations") != 0;
 	const bool use_element_names = vmap.count("use-element-names") != 0;
 	const bool use_element_guids = vmap.count("use-element-guids") != 0;
 	const bool use_material_names = vmap.count("use-material-names") != 0;
@@ -523,6 +584,8 @@ int main(int argc, char** argv)
 	settings.set(IfcGeom::IteratorSettings::INCLUDE_CURVES,               include_plan);
 	settings.set(IfcGeom::IteratorSettings::EXCLUDE_SOLIDS_AND_SURFACES,  !include_model);
 	settings.set(IfcGeom::IteratorSettings::APPLY_LAYERSETS,              enable_layerset_slicing);
+	settings.set(IfcGeom::IteratorSettings::BOOLEAN_BOUNDING_BOX_FALLBACK, boolean_bounding_box_fallback);
+	settings.set(IfcGeom::IteratorSettings::DEDUPLICATE_REPRESENTATIONS,  deduplicate_representations);
     settings.set(IfcGeom::IteratorSettings::NO_NORMALS, no_normals);
     settings.set(IfcGeom::IteratorSettings::GENERATE_UVS, generate_uvs);
 	settings.set(IfcGeom::IteratorSettings::SEARCH_FLOOR, use_element_hierarchy);
@@ -536,6 +599,17 @@ int main(int argc, char** argv)
 	settings.set(SerializerSettings::USE_ELEMENT_TYPES, use_element_types);
 	settings.set(SerializerSettings::USE_ELEMENT_HIERARCHY, use_element_hierarchy);
     settings.set_deflection_tolerance(deflection_tolerance);
+    settings.set_relative_deflection(relative_deflection);
+    settings.set_deflection_bounds(min_deflection, max_deflection);
+    settings.set_angular_deflection(angular_deflection);
+    settings.set_lod_deflections(lod_deflections);
+    settings.set_simplification_ratio(simplification_ratio);
+    settings.set_simplification_error(simplification_error);
+    settings.set_max_boolean_attempts(max_boolean_attempts);
+    settings.set_boolean_timeout(boolean_timeout);
+    settings.set_cache_directory(cache_directory);
+    settings.set_cache_size_limit(cache_size_limit);
+    settings.set_cache_memory_limit(cache_memory_limit);
     settings.precision = precision;
 
 	GeometrySerializer* serializer;
@@ -546,7 +620,12 @@ int main(int argc, char** argv)
 			Logger::Notice("Using world coords when writing WaveFront OBJ files");
 			settings.set(IfcGeom::IteratorSettings::USE_WORLD_COORDS, true);
 		}
-		serializer = new WaveFrontOBJSerializer(output_temp_filename, mtl_filename, settings);
+		// Like the MTL file, the levels of detail are written without a temp file
+		std::vector<std::string> lod_filenames;
+		for (size_t i = 0; i < lod_deflections.size(); ++i) {
+			lod_filenames.push_back(change_extension(output_filename, "lod" + boost::lexical_cast<std::string>(i + 1) + ".obj"));
+		}
+		serializer = new WaveFrontOBJSerializer(output_temp_filename, mtl_filename, settings, lod_filenames);
 #ifdef WITH_OPENCOLLADA
 	} else if (output_extension == ".dae") {
 		serializer = new ColladaSerializer(output_temp_filename, settings);
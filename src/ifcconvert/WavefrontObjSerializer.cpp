@@ -24,13 +24,18 @@
 
 #include <boost/lexical_cast.hpp>
 #include <iomanip>
+#include <algorithm>
 
 bool WaveFrontOBJSerializer::ready() {
+	for (std::vector< boost::shared_ptr<std::ofstream> >::const_iterator it = lod_streams.begin(); it != lod_streams.end(); ++it) {
+		if (!(*it)->is_open()) {
+			return false;
+		}
+	}
 	return obj_stream.is_open() && mtl_stream.is_open();
 }
 
 void WaveFrontOBJSerializer::writeHeader() {
-	obj_stream << "# File generated by IfcOpenShell " << IFCOPENSHELL_VERSION << "\n";
 #ifdef WIN32
 	const char dir_separator = '\\';
 #else
@@ -41,7 +46,12 @@ void WaveFrontOBJSerializer::writeHeader() {
 	if (slash != std::string::npos) {
 		mtl_basename = mtl_basename.substr(slash+1);
 	}
+	obj_stream << "# File generated by IfcOpenShell " << IFCOPENSHELL_VERSION << "\n";
 	obj_stream << "mtllib " << mtl_basename << "\n";
+	for (std::vector< boost::shared_ptr<std::ofstream> >::const_iterator it = lod_streams.begin(); it != lod_streams.end(); ++it) {
+		**it << "# File generated by IfcOpenShell " << IFCOPENSHELL_VERSION << "\n";
+		**it << "mtllib " << mtl_basename << "\n";
+	}
 	mtl_stream << "# File generated by IfcOpenShell " << IFCOPENSHELL_VERSION << "\n";
 }
 
@@ -76,38 +86,59 @@ void WaveFrontOBJSerializer::write(const IfcGeom::TriangulationElement<real_t>*
     const std::string name = (settings().get(SerializerSettings::USE_ELEMENT_GUIDS)
         ? o->guid() : (settings().get(SerializerSettings::USE_ELEMENT_NAMES)
             ? o->name() : o->unique_id()));
-    obj_stream << "g " << name << "\n";
-	obj_stream << "s 1" << "\n";
+    writeMesh(obj_stream, vcount_total, name, o->geometry());
 
-    const IfcGeom::Representation::Triangulation<real_t>& mesh = o->geometry();
+	// Levels of detail are written under the same name to their own files
+	const size_t num_lods = (std::min)(o->lods().size(), lod_streams.size());
+	for (size_t i = 0; i < num_lods; ++i) {
+		writeMesh(*lod_streams[i], lod_vcount_totals[i], name, *o->lods()[i]);
+	}
+}
 
-	const int vcount = (int)mesh.verts().size() / 3;
-    for ( std::vector<real_t>::const_iterator it = mesh.verts().begin(); it != mesh.verts().end(); ) {
-        const real_t x = *(it++) + (real_t)settings().offset[0];
-        const real_t y = *(it++) + (real_t)settings().offset[1];
-        const real_t z = *(it++) + (real_t)settings().offset[2];
-		obj_stream << "v " << x << " " << y << " " << z << "\n";
+void WaveFrontOBJSerializer::writeMesh(std::ostream& stream, unsigned int& vertex_offset, const std::string& name, const IfcGeom::Representation::Triangulation<real_t>& mesh)
+{
+    stream << "g " << name << "\n";
+	stream << "s 1" << "\n";
+
+	// The mesh is read from its compact buffer, which is shared by all elements and levels
+	// of detail that use the same triangulation. Positions are only taken from the buffer
+	// when they are single precision anyway.
+	const boost::shared_ptr<const IfcGeom::MeshBuffer> buffer = mesh.buffer();
+#ifdef IFCCONVERT_DOUBLE_PRECISION
+	const real_t* positions = mesh.verts().empty() ? 0 : &mesh.verts()[0];
+#else
+	const real_t* positions = buffer->positions();
+#endif
+	const float* normals = static_cast<const float*>(buffer->normals());
+	const float* uvs = buffer->uvs();
+
+	const int vcount = (int)buffer->num_vertices();
+	for (int i = 0; i < vcount; ++i) {
+        const real_t x = positions[3 * i + 0] + (real_t)settings().offset[0];
+        const real_t y = positions[3 * i + 1] + (real_t)settings().offset[1];
+        const real_t z = positions[3 * i + 2] + (real_t)settings().offset[2];
+		stream << "v " << x << " " << y << " " << z << "\n";
 	}
 
-    for ( std::vector<real_t>::const_iterator it = mesh.normals().begin(); it != mesh.normals().end(); ) {
-        const real_t x = *(it++);
-        const real_t y = *(it++);
-        const real_t z = *(it++);
-		obj_stream << "vn " << x << " " << y << " " << z << "\n";
+	if (normals) {
+		for (int i = 0; i < vcount; ++i) {
+			stream << "vn " << normals[3 * i + 0] << " " << normals[3 * i + 1] << " " << normals[3 * i + 2] << "\n";
+		}
 	}
 
-    for (std::vector<real_t>::const_iterator it = mesh.uvs().begin(); it != mesh.uvs().end();) {
-        const real_t u = *it++;
-        const real_t v = *it++;
-        obj_stream << "vt " << u << " " << v << "\n";
-    }
+	if (uvs) {
+		for (int i = 0; i < vcount; ++i) {
+			stream << "vt " << uvs[2 * i + 0] << " " << uvs[2 * i + 1] << "\n";
+		}
+	}
 
 	int previous_material_id = -2;
-	std::vector<int>::const_iterator material_it = mesh.material_ids().begin();
+	const boost::int32_t* material_it = buffer->material_ids();
 
-    const bool has_uvs = !mesh.uvs().empty();
-	const bool has_normals = !mesh.normals().empty();
-	for ( std::vector<int>::const_iterator it = mesh.faces().begin(); it != mesh.faces().end(); ) {
+    const bool has_uvs = uvs != 0;
+	const bool has_normals = normals != 0;
+	const size_t num_face_indices = 3 * buffer->num_triangles();
+	for (size_t i = 0; i < num_face_indices; ) {
 		
 		const int material_id = *(material_it++);
 		if (material_id != previous_material_id) {
@@ -115,7 +146,7 @@ void WaveFrontOBJSerializer::write(const IfcGeom::TriangulationElement<real_t>*
             std::string material_name = (settings().get(SerializerSettings::USE_MATERIAL_NAMES)
                 ? material.original_name() : material.name());
             IfcUtil::sanitate_material_name(material_name);
-			obj_stream << "usemtl " << material_name << "\n";
+			stream << "usemtl " << material_name << "\n";
 			if (materials.find(material_name) == materials.end()) {
 				writeMaterial(material);
 				materials.insert(material_name);
@@ -123,30 +154,32 @@ void WaveFrontOBJSerializer::write(const IfcGeom::TriangulationElement<real_t>*
 			previous_material_id = material_id;
 		}
 
-		const int v1 = *(it++)+vcount_total;
-		const int v2 = *(it++)+vcount_total;
-		const int v3 = *(it++)+vcount_total;
+		const int v1 = (int)buffer->face_index(i++)+vertex_offset;
+		const int v2 = (int)buffer->face_index(i++)+vertex_offset;
+		const int v3 = (int)buffer->face_index(i++)+vertex_offset;
 
 		if (has_normals && has_uvs) {
-			obj_stream << "f " << v1 << "/" << v1 << "/" << v1 << " "
+			stream << "f " << v1 << "/" << v1 << "/" << v1 << " "
 				<< v2 << "/" << v2 << "/" << v2 << " "
 				<< v3 << "/" << v3 << "/" << v3 << "\n";
 		} else if (has_normals) {
-			obj_stream << "f " << v1 << "//" << v1 << " "
+			stream << "f " << v1 << "//" << v1 << " "
 				<< v2 << "//" << v2 << " "
 				<< v3 << "//" << v3 << "\n";
 		} else {
-			obj_stream << "f " << v1 << " " << v2 << " " << v3 << "\n";
+			stream << "f " << v1 << " " << v2 << " " << v3 << "\n";
 		}
 
 	}
 
-	std::set<int> faces_set (mesh.faces().begin(), mesh.faces().end());
-	const std::vector<int>& edges = mesh.edges();
+	std::set<int> faces_set;
+	for (size_t i = 0; i < num_face_indices; ++i) {
+		faces_set.insert((int)buffer->face_index(i));
+	}
 
-	for ( std::vector<int>::const_iterator it = edges.begin(); it != edges.end(); ) {
-		const int i1 = *(it++);
-		const int i2 = *(it++);
+	for (size_t i = 0; i < buffer->num_edges(); ++i) {
+		const int i1 = (int)buffer->edge_index(2 * i);
+		const int i2 = (int)buffer->edge_index(2 * i + 1);
 
 		if (faces_set.find(i1) != faces_set.end() || faces_set.find(i2) != faces_set.end()) {
 			continue;
@@ -159,7 +192,7 @@ void WaveFrontOBJSerializer::write(const IfcGeom::TriangulationElement<real_t>*
             std::string material_name = (settings().get(SerializerSettings::USE_MATERIAL_NAMES)
                 ? material.original_name() : material.name());
             IfcUtil::sanitate_material_name(material_name);
-			obj_stream << "usemtl " << material_name << "\n";
+			stream << "usemtl " << material_name << "\n";
 			if (materials.find(material_name) == materials.end()) {
 				writeMaterial(material);
 				materials.insert(material_name);
@@ -167,11 +200,11 @@ void WaveFrontOBJSerializer::write(const IfcGeom::TriangulationElement<real_t>*
 			previous_material_id = material_id;
 		}
 
-		const int v1 = i1 + vcount_total;
-		const int v2 = i2 + vcount_total;
+		const int v1 = i1 + vertex_offset;
+		const int v2 = i2 + vertex_offset;
 
-		obj_stream << "l " << v1 << " " << v2 << "\n";
+		stream << "l " << v1 << " " << v2 << "\n";
 	}
 
-	vcount_total += vcount;
+	vertex_offset += vcount;
 }
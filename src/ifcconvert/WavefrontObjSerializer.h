@@ -22,8 +22,11 @@
 
 #include <set>
 #include <string>
+#include <vector>
 #include <fstream>
 
+#include <boost/shared_ptr.hpp>
+
 #include "../ifcconvert/GeometrySerializer.h"
 
 // http://people.sc.fsu.edu/~jburkardt/txt/obj_format.txt
@@ -34,16 +37,28 @@ private:
 	std::ofstream mtl_stream;
 	unsigned int vcount_total;
 	std::set<std::string> materials;
+	/// Every additional level of detail is written to its own file, which
+	/// shares the material library with the main file
+	std::vector< boost::shared_ptr<std::ofstream> > lod_streams;
+	std::vector<unsigned int> lod_vcount_totals;
 public:
-	WaveFrontOBJSerializer(const std::string& obj_filename, const std::string& mtl_filename, const SerializerSettings& settings)
+	/// @param lod_filenames The files for the levels of detail in TriangulationElement::lods(),
+	/// levels beyond the number of filenames are not written
+	WaveFrontOBJSerializer(const std::string& obj_filename, const std::string& mtl_filename, const SerializerSettings& settings,
+		const std::vector<std::string>& lod_filenames = std::vector<std::string>())
 		: GeometrySerializer(settings)
 		, mtl_filename(mtl_filename)
 		, obj_stream(obj_filename.c_str())
 		, mtl_stream(mtl_filename.c_str())
 		, vcount_total(1)
+		, lod_vcount_totals(lod_filenames.size(), 1)
     {
         obj_stream << std::setprecision(settings.precision);
         mtl_stream << std::setprecision(settings.precision);
+		for (std::vector<std::string>::const_iterator it = lod_filenames.begin(); it != lod_filenames.end(); ++it) {
+			lod_streams.push_back(boost::shared_ptr<std::ofstream>(new std::ofstream(it->c_str())));
+			*lod_streams.back() << std::setprecision(settings.precision);
+		}
     }
 
 	virtual ~WaveFrontOBJSerializer() {}
@@ -52,6 +67,7 @@ public:
 	void writeMaterial(const IfcGeom::Material& style);
 	void write(const IfcGeom::TriangulationElement<real_t>* o);
 	void write(const IfcGeom::BRepElement<real_t>* /*o*/) {}
+	void writeMesh(std::ostream& stream, unsigned int& vertex_offset, const std::string& name, const IfcGeom::Representation::Triangulation<real_t>& mesh);
 	void finalize() {}
 	bool isTesselated() const { return true; }
 	void setUnitNameAndMagnitude(const std::string& /*name*/, float /*magnitude*/) {}
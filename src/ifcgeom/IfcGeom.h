@@ -45,6 +45,9 @@ inline static bool ALMOST_THE_SAME(const T& a, const T& b, double tolerance=ALMO
 #include <TColgp_SequenceOfPnt.hxx>
 #include <TopTools_ListOfShape.hxx>
 #include <BOPAlgo_Operation.hxx>
+#include <Bnd_Box.hxx>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include "../ifcparse/IfcParse.h"
 #include "../ifcparse/IfcBaseClass.h"
@@ -53,6 +56,7 @@ inline static bool ALMOST_THE_SAME(const T& a, const T& b, double tolerance=ALMO
 #include "../ifcgeom/IfcGeomRepresentation.h" 
 #include "../ifcgeom/IfcRepresentationShapeItem.h"
 #include "../ifcgeom/IfcGeomShapeType.h"
+#include "../ifcgeom/IfcGeomCache.h"
 #include "ifc_geom_api.h"
 
 // Define this in case you want to conserve memory usage at all cost. This has been
@@ -66,18 +70,39 @@ inline static bool ALMOST_THE_SAME(const T& a, const T& b, double tolerance=ALMO
 
 #else
 
-#define IN_CACHE(T,E,t,e) std::map<int,t>::const_iterator it = cache.T.find(E->entity->id());\
-if ( it != cache.T.end() ) { e = it->second; return true; }
-#define CACHE(T,E,e) cache.T[E->entity->id()] = e;
+#define IN_CACHE(T,E,t,e) if ( cache.T.find(E->entity->id(), e) ) { return true; }
+#define CACHE(T,E,e) cache.T.insert(E->entity->id(), e);
 
 #endif
 
 namespace IfcGeom {
 
 class IFC_GEOM_API Cache {
+private:
+	CacheRecency recency_;
+
+	Cache(const Cache&); // N/I
+	Cache& operator=(const Cache&); // N/I
 public:
 #include "IfcRegisterCreateCache.h"
-	std::map<int, TopoDS_Shape> Shape;
+	CacheMap<TopoDS_Shape> Shape;
+
+	Cache() {
+#include "IfcRegisterInitCache.h"
+		Shape.set_recency(&recency_);
+	}
+
+	void clear() {
+#include "IfcRegisterPurgeCache.h"
+		Shape.clear();
+	}
+
+	/// The memory budget in bytes, when exceeded the least recently used entries are evicted
+	size_t budget() const { return recency_.budget(); }
+	void set_budget(size_t budget) { recency_.set_budget(budget); }
+
+	/// The estimated memory footprint in bytes of the cached entries
+	size_t size() const { return recency_.size(); }
 };
 
 class IFC_GEOM_API Kernel {
@@ -91,6 +116,14 @@ private:
 	double ifc_planeangle_unit;
 	double modelling_precision;
 	double dimensionality;
+	double max_boolean_attempts;
+	double boolean_timeout;
+	double cache_memory_limit;
+
+	// Bookkeeping of the boolean budget of the product currently being processed
+	int boolean_attempts;
+	bool boolean_budget_exceeded;
+	boost::posix_time::ptime boolean_budget_start;
 
 #ifndef NO_CACHE
 	Cache cache;
@@ -103,6 +136,9 @@ private:
 	 // For stopping PlacementRelTo recursion in convert(const IfcSchema::IfcObjectPlacement* l, gp_Trsf& trsf)
 	IfcSchema::Type::Enum placement_rel_to;
 
+	// Resolved object placements, created on demand for the current conversion settings
+	boost::shared_ptr<PlacementMemo> placement_memo;
+
 public:
 	Kernel()
 		: deflection_tolerance(0.001)
@@ -113,6 +149,11 @@ public:
 		, ifc_planeangle_unit(-1.0)
 		, modelling_precision(0.00001)
 		, dimensionality(1.)
+		, max_boolean_attempts(-1.0)
+		, boolean_timeout(-1.0)
+		, cache_memory_limit(-1.0)
+		, boolean_attempts(0)
+		, boolean_budget_exceeded(false)
 		, placement_rel_to(IfcSchema::Type::UNDEFINED)
 	{}
 
@@ -130,6 +171,11 @@ public:
 		setValue(GV_PRECISION,                other.getValue(GV_PRECISION));
 		setValue(GV_DIMENSIONALITY,           other.getValue(GV_DIMENSIONALITY));
 		setValue(GV_DEFLECTION_TOLERANCE,     other.getValue(GV_DEFLECTION_TOLERANCE));
+		setValue(GV_MAX_BOOLEAN_ATTEMPTS,     other.getValue(GV_MAX_BOOLEAN_ATTEMPTS));
+		setValue(GV_BOOLEAN_TIMEOUT,          other.getValue(GV_BOOLEAN_TIMEOUT));
+		setValue(GV_CACHE_MEMORY_LIMIT,       other.getValue(GV_CACHE_MEMORY_LIMIT));
+		placement_memo = other.placement_memo;
+		reset_boolean_budget();
 		return *this;
 	}
 
@@ -164,7 +210,20 @@ public:
 		// Default: 0.00001 (obtained from IfcGeometricRepresentationContext if available)
 		GV_PRECISION,
 		// Whether to process shapes of type Face or higher (1) Wire or lower (-1) or all (0)
-		GV_DIMENSIONALITY
+		GV_DIMENSIONALITY,
+		// The maximum number of boolean operations, including the retries with increased
+		// fuzziness, that are attempted for a single product
+		// Default: -1.0 (= unlimited)
+		GV_MAX_BOOLEAN_ATTEMPTS,
+		// The maximum wall clock time in seconds spent on boolean operations for a single
+		// product. Note that an operation that is in progress is not interrupted.
+		// Default: -1.0 (= unlimited)
+		GV_BOOLEAN_TIMEOUT,
+		// The memory budget in megabytes for the cache of conversion results, such as
+		// placements, profiles and mapped representations. When exceeded the least
+		// recently used results are evicted.
+		// Default: -1.0 (= unlimited)
+		GV_CACHE_MEMORY_LIMIT
 	};
 
 	bool convert_wire_to_face(const TopoDS_Wire& wire, TopoDS_Face& face);
@@ -234,6 +293,14 @@ public:
 	bool wire_intersections(const TopoDS_Wire & wire, TopTools_ListOfShape & wires);
 	void select_largest(const TopTools_ListOfShape& shapes, TopoDS_Shape& largest);
 
+	// Resets the per-product boolean budget defined by GV_MAX_BOOLEAN_ATTEMPTS and GV_BOOLEAN_TIMEOUT
+	void reset_boolean_budget();
+	// Registers a boolean operation that is about to be performed. Returns false when
+	// the budget is exhausted, in which case the operation should not be attempted.
+	bool consume_boolean_attempt();
+	bool is_boolean_budget_exceeded() const { return boolean_budget_exceeded; }
+	void bounding_box_proxy(const IfcRepresentationShapeItems& shapes, IfcRepresentationShapeItems& proxies);
+
 	static double shape_volume(const TopoDS_Shape& s);
 	static double face_area(const TopoDS_Face& f);
 
@@ -245,6 +312,9 @@ public:
 	IfcSchema::IfcRelVoidsElement::list::ptr find_openings(IfcSchema::IfcProduct* product);
 
 	IfcSchema::IfcRepresentation* find_representation(const IfcSchema::IfcProduct*, const std::string&);
+	// Places the IfcBoundingBox of the 'Box' representation of the product, if any, so that
+	// its extents are known without converting any of its other representations
+	bool find_box_representation(const IfcSchema::IfcProduct*, Bnd_Box&);
 
 	std::pair<std::string, double> initializeUnits(IfcSchema::IfcUnitAssignment*);
 
@@ -259,6 +329,10 @@ public:
 	template <typename P>
     IfcGeom::BRepElement<P>* create_brep_for_processed_representation(
         const IteratorSettings&, IfcSchema::IfcRepresentation*, IfcSchema::IfcProduct*, IfcGeom::BRepElement<P>*);
+
+	template <typename P>
+    IfcGeom::BRepElement<P>* create_brep_for_processed_representation(
+        const IteratorSettings&, IfcSchema::IfcRepresentation*, IfcSchema::IfcProduct*, const boost::shared_ptr<IfcGeom::Representation::BRep>&);
 	
 	const IfcSchema::IfcMaterial* get_single_material_association(const IfcSchema::IfcProduct*);
 	IfcSchema::IfcRepresentation* representation_mapped_to(const IfcSchema::IfcRepresentation* representation);
@@ -316,16 +390,21 @@ public:
 	}
 
 	void purge_cache() { 
-		// Rather hack-ish, but a stopgap solution to keep memory under control
-		// for large files. SurfaceStyles need to be kept at all costs, as they
-		// are read later on when serializing Collada files.
+		// SurfaceStyles need to be kept at all costs, as they are read later
+		// on when serializing Collada files.
 #ifndef NO_CACHE
-		cache = Cache(); 
+		cache.clear();
 #endif
 	}
 
 	void set_conversion_placement_rel_to(IfcSchema::Type::Enum type);
 
+	// The memo of resolved object placements can be shared between Kernels that
+	// operate on the same file, e.g. by the iterators of multiple threads. It is
+	// replaced when used with incompatible conversion settings.
+	const boost::shared_ptr<PlacementMemo>& get_placement_memo() const { return placement_memo; }
+	void set_placement_memo(const boost::shared_ptr<PlacementMemo>& memo) { placement_memo = memo; }
+
 #include "IfcRegisterGeomHeader.h"
 
 };
@@ -0,0 +1,852 @@
+/********************************************************************************
+*                                                                              *
+* This file is part of IfcOpenShell.                                           *
+*                                                                              *
+* IfcOpenShell is free software: you can redistribute it and/or modify         *
+* it under the terms of the Lesser GNU General Public License as published by  *
+* the Free Software Foundation, either version 3.0 of the License, or          *
+* (at your option) any later version.                                          *
+*                                                                              *
+* IfcOpenShell is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* Lesser GNU General Public License for more details.                          *
+*                                                                              *
+* You should have received a copy of the Lesser GNU General Public License     *
+* along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+*                                                                              *
+********************************************************************************/
+
+/********************************************************************************
+*                                                                              *
+* A bounding volume hierarchy over axis aligned boxes. Boxes are collected     *
+* first and the hierarchy is built in bulk on the first query after any        *
+* modification, splitting on the surface area heuristic over binned box        *
+* centroids. Nodes are stored depth first in a single array: the first child   *
+* of an interior node immediately follows it, the second child is referenced  *
+* by index. The bounds of the nodes are stored in single precision, rounded   *
+* outwards, the boxes of the items in double precision, so that the nodes are  *
+* compact and queries are nonetheless decided on the exact boxes.              *
+* Removing or updating items after the build refits the node bounds, items     *
+* added after the build are scanned linearly, until either warrants a rebuild. *
+*                                                                              *
+********************************************************************************/
+
+#ifndef IFCGEOMBVH_H
+#define IFCGEOMBVH_H
+
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <map>
+#include <istream>
+#include <ostream>
+#include <algorithm>
+
+#include <boost/cstdint.hpp>
+#include <boost/math/special_functions/next.hpp>
+
+namespace IfcGeom {
+
+	namespace impl {
+
+		/// An axis aligned box in double precision, the box of an item or of a query
+		struct bvh_box {
+			double min[3], max[3];
+
+			bvh_box() {
+				for (int i = 0; i < 3; ++i) {
+					min[i] = +std::numeric_limits<double>::infinity();
+					max[i] = -std::numeric_limits<double>::infinity();
+				}
+			}
+
+			bvh_box(double x1, double y1, double z1, double x2, double y2, double z2) {
+				min[0] = x1; min[1] = y1; min[2] = z1;
+				max[0] = x2; max[1] = y2; max[2] = z2;
+			}
+
+			bool is_void() const {
+				return min[0] > max[0] || min[1] > max[1] || min[2] > max[2];
+			}
+
+			void add(const bvh_box& b) {
+				for (int i = 0; i < 3; ++i) {
+					min[i] = (std::min)(min[i], b.min[i]);
+					max[i] = (std::max)(max[i], b.max[i]);
+				}
+			}
+
+			bool overlaps(const bvh_box& b) const {
+				return min[0] <= b.max[0] && b.min[0] <= max[0] &&
+				       min[1] <= b.max[1] && b.min[1] <= max[1] &&
+				       min[2] <= b.max[2] && b.min[2] <= max[2];
+			}
+
+			bool contains(const bvh_box& b) const {
+				return min[0] <= b.min[0] && b.max[0] <= max[0] &&
+				       min[1] <= b.min[1] && b.max[1] <= max[1] &&
+				       min[2] <= b.min[2] && b.max[2] <= max[2];
+			}
+
+			/// Half of the surface area, which suffices for the ratios in the heuristic
+			double half_area() const {
+				if (is_void()) return 0.;
+				const double dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+				return dx * dy + dy * dz + dz * dx;
+			}
+
+			double centroid(int axis) const {
+				return (min[axis] + max[axis]) * 0.5;
+			}
+		};
+
+		/// The bounds of a node of the hierarchy in single precision, rounded outwards, so
+		/// that they contain the double precision boxes added to them. Only used to prune
+		/// the traversal, as this is conservative.
+		struct bvh_node_box {
+			float min[3], max[3];
+
+			bvh_node_box() {
+				for (int i = 0; i < 3; ++i) {
+					min[i] = +std::numeric_limits<float>::infinity();
+					max[i] = -std::numeric_limits<float>::infinity();
+				}
+			}
+
+			explicit bvh_node_box(const bvh_box& b) {
+				for (int i = 0; i < 3; ++i) {
+					min[i] = +std::numeric_limits<float>::infinity();
+					max[i] = -std::numeric_limits<float>::infinity();
+				}
+				add(b);
+			}
+
+			bool is_void() const {
+				return min[0] > max[0] || min[1] > max[1] || min[2] > max[2];
+			}
+
+			void add(const bvh_box& b) {
+				if (b.is_void()) {
+					return;
+				}
+				for (int i = 0; i < 3; ++i) {
+					float lo = static_cast<float>(b.min[i]);
+					if (lo > b.min[i]) lo = boost::math::float_prior(lo);
+					float hi = static_cast<float>(b.max[i]);
+					if (hi < b.max[i]) hi = boost::math::float_next(hi);
+					min[i] = (std::min)(min[i], lo);
+					max[i] = (std::max)(max[i], hi);
+				}
+			}
+
+			void add(const bvh_node_box& b) {
+				for (int i = 0; i < 3; ++i) {
+					min[i] = (std::min)(min[i], b.min[i]);
+					max[i] = (std::max)(max[i], b.max[i]);
+				}
+			}
+
+			void add(const float* p) {
+				for (int i = 0; i < 3; ++i) {
+					min[i] = (std::min)(min[i], p[i]);
+					max[i] = (std::max)(max[i], p[i]);
+				}
+			}
+
+			bool overlaps(const bvh_box& b) const {
+				return min[0] <= b.max[0] && b.min[0] <= max[0] &&
+				       min[1] <= b.max[1] && b.min[1] <= max[1] &&
+				       min[2] <= b.max[2] && b.min[2] <= max[2];
+			}
+		};
+
+		template <typename T>
+		class bvh {
+		public:
+			/// Number of candidate split positions per axis considered during construction
+			static const int NUM_BINS = 16;
+			/// Subsets of this size or smaller are not split further
+			static const int MAX_LEAF_SIZE = 4;
+
+			bvh()
+				: indexed_(0)
+				, removed_(0)
+				, modified_(0)
+				, built_(true)
+				, needs_refit_(false)
+				, positions_valid_(false)
+			{}
+
+			/// Adds an item. Items added after the hierarchy is built are scanned linearly
+			/// by queries, until there are too many and the hierarchy is rebuilt.
+			void add(const T& t, const bvh_box& b) {
+				if (b.is_void()) {
+					return;
+				}
+				if (positions_valid_) {
+					positions_.insert(std::make_pair(t, static_cast<boost::uint32_t>(items_.size())));
+				}
+				items_.push_back(t);
+				boxes_.push_back(b);
+				if (items_.size() - indexed_ > max_pending_()) {
+					built_ = false;
+				}
+			}
+
+			/// Removes all entries of t, returns false if there are none. Entries in the
+			/// hierarchy are marked as removed and the bounds of the nodes are refit on the
+			/// next query. Once a quarter of the hierarchy has been removed or modified it
+			/// is rebuilt instead.
+			bool remove(const T& t) {
+				index_positions_();
+				typedef typename position_map_t::iterator iterator;
+				const std::pair<iterator, iterator> range = positions_.equal_range(t);
+				if (range.first == range.second) {
+					return false;
+				}
+				std::vector<boost::uint32_t> pending;
+				for (iterator it = range.first; it != range.second; ++it) {
+					if (it->second < indexed_) {
+						boxes_[it->second] = bvh_box();
+						++removed_;
+						needs_refit_ = true;
+					} else {
+						pending.push_back(it->second);
+					}
+				}
+				positions_.erase(range.first, range.second);
+
+				// Pending entries are removed from the back, by moving the last item into their slot
+				std::sort(pending.begin(), pending.end());
+				for (std::vector<boost::uint32_t>::reverse_iterator it = pending.rbegin(); it != pending.rend(); ++it) {
+					const boost::uint32_t last = static_cast<boost::uint32_t>(items_.size() - 1);
+					if (*it != last) {
+						move_position_(items_[last], last, *it);
+						items_[*it] = items_[last];
+						boxes_[*it] = boxes_[last];
+					}
+					items_.pop_back();
+					boxes_.pop_back();
+				}
+
+				check_degradation_();
+				return true;
+			}
+
+			/// Replaces the box of t, or adds t if it is not present. A single entry in the
+			/// hierarchy is updated in place and the bounds of the nodes are refit on the
+			/// next query. A void box removes t.
+			void update(const T& t, const bvh_box& b) {
+				if (b.is_void()) {
+					remove(t);
+					return;
+				}
+				index_positions_();
+				typedef typename position_map_t::iterator iterator;
+				const std::pair<iterator, iterator> range = positions_.equal_range(t);
+				iterator second = range.first;
+				if (range.first != range.second && ++second == range.second) {
+					const boost::uint32_t i = range.first->second;
+					boxes_[i] = b;
+					if (i < indexed_) {
+						++modified_;
+						needs_refit_ = true;
+						check_degradation_();
+					}
+					return;
+				}
+				remove(t);
+				add(t, b);
+			}
+
+			size_t size() const { return items_.size() - removed_; }
+
+			/// Builds the hierarchy, which otherwise happens on the first query after
+			/// modification. As that mutates the instance, concurrent readers should
+			/// call this beforehand.
+			void build() const {
+				if (built_) {
+					if (needs_refit_) {
+						refit_();
+					}
+					return;
+				}
+				built_ = true;
+				needs_refit_ = false;
+				removed_ = modified_ = 0;
+
+				compact_();
+				build_nodes_();
+				indexed_ = items_.size();
+
+				// The items have been reordered
+				if (positions_valid_) {
+					positions_valid_ = false;
+					index_positions_();
+				}
+			}
+
+			/// Appends the elements of which the box overlaps with b, or is contained
+			/// in b when completely_within is set.
+			void select_box(const bvh_box& b, std::vector<T>& results, bool completely_within = false) const {
+				build();
+				if (b.is_void()) {
+					return;
+				}
+
+				boost::uint32_t stack[64];
+				std::vector<boost::uint32_t> overflow;
+				int top = 0;
+				if (!nodes_.empty()) {
+					stack[top++] = 0;
+				}
+
+				for (;;) {
+					boost::uint32_t index;
+					if (!overflow.empty()) {
+						index = overflow.back();
+						overflow.pop_back();
+					} else if (top > 0) {
+						index = stack[--top];
+					} else {
+						break;
+					}
+
+					const node& nd = nodes_[index];
+					if (!nd.bounds.overlaps(b)) {
+						continue;
+					}
+					if (nd.count) {
+						for (boost::uint32_t i = nd.offset; i < nd.offset + nd.count; ++i) {
+							if (selects_(b, boxes_[i], completely_within)) {
+								results.push_back(items_[i]);
+							}
+						}
+					} else if (top + 2 <= 64) {
+						stack[top++] = nd.offset;
+						stack[top++] = index + 1;
+					} else {
+						overflow.push_back(nd.offset);
+						overflow.push_back(index + 1);
+					}
+				}
+
+				// Items added since the hierarchy was built
+				for (size_t i = indexed_; i < items_.size(); ++i) {
+					if (selects_(b, boxes_[i], completely_within)) {
+						results.push_back(items_[i]);
+					}
+				}
+			}
+
+			std::vector<T> select_box(const bvh_box& b, bool completely_within = false) const {
+				std::vector<T> results;
+				select_box(b, results, completely_within);
+				return results;
+			}
+
+			/// Calls visit(t, entry, max_t) for the items of which the box is hit by the ray
+			/// o + s * d with 0 <= s <= max_t, in the order in which the ray enters their boxes.
+			/// The visitor may lower max_t, e.g. to the distance of an exact hit, after which
+			/// the items of which the box is entered beyond it are skipped.
+			template <typename Fn>
+			void traverse_ray(const double* o, const double* d, double max_t, Fn& visit) const {
+				ray_key key(o, d);
+				traverse_ordered_(key, max_t, visit);
+			}
+
+			/// Calls visit(t, distance, max_distance) for the items of which the box lies within
+			/// max_distance of p, nearest box first. The visitor may lower max_distance, e.g. to
+			/// the distance of the k-th nearest item found so far.
+			template <typename Fn>
+			void traverse_nearest(const double* p, double max_distance, Fn& visit) const {
+				point_key key(p);
+				traverse_ordered_(key, max_distance, visit);
+			}
+
+			/// Writes the built hierarchy in native byte order, the items are written
+			/// by calling write_item(s, t).
+			template <typename Fn>
+			void write(std::ostream& s, Fn write_item) const {
+				// Removed items and items added since the last build are not part of the
+				// hierarchy, which is rebuilt to include them
+				if (removed_ || indexed_ != items_.size()) {
+					built_ = false;
+				}
+				build();
+				write_count_(s, items_.size());
+				for (typename std::vector<T>::const_iterator it = items_.begin(); it != items_.end(); ++it) {
+					write_item(s, *it);
+				}
+				if (!boxes_.empty()) {
+					s.write(reinterpret_cast<const char*>(&boxes_[0]), boxes_.size() * sizeof(bvh_box));
+				}
+				write_count_(s, nodes_.size());
+				if (!nodes_.empty()) {
+					s.write(reinterpret_cast<const char*>(&nodes_[0]), nodes_.size() * sizeof(node));
+				}
+			}
+
+			/// Replaces the contents with a hierarchy written by write(), the items are read
+			/// by calling read_item(s, t), which returns false if the item is invalid. Returns
+			/// false and leaves the hierarchy unchanged on invalid input.
+			template <typename Fn>
+			bool read(std::istream& s, Fn read_item) {
+				boost::uint64_t n;
+				if (!read_count_(s, n)) {
+					return false;
+				}
+				std::vector<T> items(static_cast<size_t>(n));
+				for (typename std::vector<T>::iterator it = items.begin(); it != items.end(); ++it) {
+					if (!read_item(s, *it)) {
+						return false;
+					}
+				}
+				std::vector<bvh_box> boxes(static_cast<size_t>(n));
+				if (n && !s.read(reinterpret_cast<char*>(&boxes[0]), boxes.size() * sizeof(bvh_box))) {
+					return false;
+				}
+				boost::uint64_t m;
+				if (!read_count_(s, m) || (n == 0) != (m == 0)) {
+					return false;
+				}
+				std::vector<node> nodes(static_cast<size_t>(m));
+				if (m && !s.read(reinterpret_cast<char*>(&nodes[0]), nodes.size() * sizeof(node))) {
+					return false;
+				}
+				// Every reference needs to be in range for queries to be safe
+				for (size_t i = 0; i < nodes.size(); ++i) {
+					const node& nd = nodes[i];
+					if (nd.count ? (nd.offset > n || nd.count > n - nd.offset) : (nd.offset <= i || nd.offset >= m || i + 1 >= m)) {
+						return false;
+					}
+				}
+				items_.swap(items);
+				boxes_.swap(boxes);
+				nodes_.swap(nodes);
+				indexed_ = items_.size();
+				removed_ = modified_ = 0;
+				built_ = true;
+				needs_refit_ = false;
+				positions_.clear();
+				positions_valid_ = false;
+				return true;
+			}
+
+		private:
+			typedef std::multimap<T, boost::uint32_t> position_map_t;
+
+			static bool selects_(const bvh_box& b, const bvh_box& item, bool completely_within) {
+				// Removed items have a void box, which is contained in any box
+				return completely_within ? !item.is_void() && b.contains(item) : b.overlaps(item);
+			}
+
+			// Number of items added since the last build above which it is rebuilt
+			size_t max_pending_() const {
+				return (std::max)(static_cast<size_t>(NUM_BINS), indexed_ / 16);
+			}
+
+			void check_degradation_() {
+				if ((removed_ + modified_) * 4 > indexed_) {
+					built_ = false;
+				}
+			}
+
+			void index_positions_() const {
+				if (positions_valid_) {
+					return;
+				}
+				positions_.clear();
+				for (size_t i = 0; i < items_.size(); ++i) {
+					if (!boxes_[i].is_void()) {
+						positions_.insert(std::make_pair(items_[i], static_cast<boost::uint32_t>(i)));
+					}
+				}
+				positions_valid_ = true;
+			}
+
+			void move_position_(const T& t, boost::uint32_t from, boost::uint32_t to) {
+				typedef typename position_map_t::iterator iterator;
+				const std::pair<iterator, iterator> range = positions_.equal_range(t);
+				for (iterator it = range.first; it != range.second; ++it) {
+					if (it->second == from) {
+						it->second = to;
+						return;
+					}
+				}
+			}
+
+			// Drops the removed items
+			void compact_() const {
+				size_t j = 0;
+				for (size_t i = 0; i < items_.size(); ++i) {
+					if (!boxes_[i].is_void()) {
+						items_[j] = items_[i];
+						boxes_[j] = boxes_[i];
+						++j;
+					}
+				}
+				items_.resize(j);
+				boxes_.resize(j);
+			}
+
+			// Recomputes the bounds of the nodes bottom up, as children are stored after their parent
+			void refit_() const {
+				needs_refit_ = false;
+				for (size_t i = nodes_.size(); i-- > 0;) {
+					node& nd = nodes_[i];
+					nd.bounds = bvh_node_box();
+					if (nd.count) {
+						for (boost::uint32_t j = nd.offset; j < nd.offset + nd.count; ++j) {
+							nd.bounds.add(boxes_[j]);
+						}
+					} else {
+						nd.bounds.add(nodes_[i + 1].bounds);
+						nd.bounds.add(nodes_[nd.offset].bounds);
+					}
+				}
+			}
+
+			void build_nodes_() const {
+				nodes_.clear();
+				if (items_.empty()) {
+					return;
+				}
+
+				const boost::uint32_t n = static_cast<boost::uint32_t>(items_.size());
+				std::vector<boost::uint32_t> order(n);
+				std::vector<float> centroids(3 * n);
+				for (boost::uint32_t i = 0; i < n; ++i) {
+					order[i] = i;
+					for (int j = 0; j < 3; ++j) {
+						centroids[3 * i + j] = static_cast<float>(boxes_[i].centroid(j));
+					}
+				}
+
+				// A binary tree with at least one item per leaf has less than 2n nodes
+				nodes_.reserve(2 * n / MAX_LEAF_SIZE + 1);
+
+				std::vector<task> stack;
+				task root = { 0, n, -1 };
+				stack.push_back(root);
+
+				while (!stack.empty()) {
+					const task t = stack.back();
+					stack.pop_back();
+
+					const boost::uint32_t index = static_cast<boost::uint32_t>(nodes_.size());
+					if (t.parent >= 0) {
+						nodes_[static_cast<size_t>(t.parent)].offset = index;
+					}
+
+					bvh_box bounds;
+					bvh_node_box centroid_bounds;
+					for (boost::uint32_t i = t.begin; i < t.end; ++i) {
+						bounds.add(boxes_[order[i]]);
+						centroid_bounds.add(&centroids[3 * order[i]]);
+					}
+					node nd;
+					nd.bounds = bvh_node_box(bounds);
+
+					boost::uint32_t mid = t.end;
+					if (t.end - t.begin > static_cast<boost::uint32_t>(MAX_LEAF_SIZE)) {
+						mid = split_(order, centroids, t.begin, t.end, bounds, centroid_bounds);
+					}
+
+					if (mid == t.end) {
+						nd.offset = t.begin;
+						nd.count = t.end - t.begin;
+						nodes_.push_back(nd);
+					} else {
+						nd.count = 0;
+						nodes_.push_back(nd);
+						// The first child is popped first, so that it directly follows its parent
+						task second = { mid, t.end, static_cast<boost::int64_t>(index) };
+						task first = { t.begin, mid, -1 };
+						stack.push_back(second);
+						stack.push_back(first);
+					}
+				}
+
+				// Reorder the items so that leaves reference contiguous ranges
+				std::vector<T> items(n);
+				std::vector<bvh_box> boxes(n);
+				for (boost::uint32_t i = 0; i < n; ++i) {
+					items[i] = items_[order[i]];
+					boxes[i] = boxes_[order[i]];
+				}
+				items_.swap(items);
+				boxes_.swap(boxes);
+			}
+
+			static void write_count_(std::ostream& s, boost::uint64_t n) {
+				s.write(reinterpret_cast<const char*>(&n), sizeof(n));
+			}
+
+			// Items and nodes are indexed by 32 bit integers
+			static bool read_count_(std::istream& s, boost::uint64_t& n) {
+				return s.read(reinterpret_cast<char*>(&n), sizeof(n)) && n <= (std::numeric_limits<boost::uint32_t>::max)();
+			}
+
+			struct node {
+				bvh_node_box bounds;
+				/// For leaves the first item, for interior nodes the index of the second child
+				boost::uint32_t offset;
+				/// Number of items, zero for interior nodes
+				boost::uint32_t count;
+			};
+
+			struct task {
+				boost::uint32_t begin, end;
+				// Index of the node of which this is the second child, or -1
+				boost::int64_t parent;
+			};
+
+			// An entry in the queue of ordered traversals, either a node or an item
+			struct queue_entry {
+				double key;
+				boost::uint32_t index;
+				bool is_item;
+			};
+
+			struct queue_greater {
+				bool operator()(const queue_entry& a, const queue_entry& b) const {
+					return a.key > b.key;
+				}
+			};
+
+			// The distance along the ray at which it enters the box
+			struct ray_key {
+				double o[3], d[3];
+				ray_key(const double* o_, const double* d_) {
+					for (int i = 0; i < 3; ++i) {
+						o[i] = o_[i];
+						d[i] = d_[i];
+					}
+				}
+				template <typename Box>
+				bool operator()(const Box& b, double max_t, double& t) const {
+					if (b.is_void()) {
+						return false;
+					}
+					double t0 = 0., t1 = max_t;
+					for (int i = 0; i < 3; ++i) {
+						if (d[i] == 0.) {
+							if (o[i] < b.min[i] || o[i] > b.max[i]) {
+								return false;
+							}
+							continue;
+						}
+						double a = (b.min[i] - o[i]) / d[i], c = (b.max[i] - o[i]) / d[i];
+						if (a > c) {
+							std::swap(a, c);
+						}
+						t0 = (std::max)(t0, a);
+						t1 = (std::min)(t1, c);
+						if (t0 > t1) {
+							return false;
+						}
+					}
+					t = t0;
+					return true;
+				}
+			};
+
+			// The distance from the point to the box
+			struct point_key {
+				double p[3];
+				point_key(const double* p_) {
+					for (int i = 0; i < 3; ++i) {
+						p[i] = p_[i];
+					}
+				}
+				template <typename Box>
+				bool operator()(const Box& b, double max_distance, double& distance) const {
+					if (b.is_void()) {
+						return false;
+					}
+					double sq = 0.;
+					for (int i = 0; i < 3; ++i) {
+						const double e = p[i] < b.min[i] ? b.min[i] - p[i] : (p[i] > b.max[i] ? p[i] - b.max[i] : 0.);
+						sq += e * e;
+					}
+					distance = std::sqrt(sq);
+					return distance <= max_distance;
+				}
+			};
+
+			// Best first traversal, visiting items in increasing order of the key of their
+			// box. As the key of a box is a lower bound for those of the boxes it contains,
+			// the traversal ends when the nearest entry is beyond the limit.
+			template <typename Key, typename Fn>
+			void traverse_ordered_(const Key& key, double limit, Fn& visit) const {
+				build();
+				double k;
+				std::vector<queue_entry> queue;
+				if (!nodes_.empty() && key(nodes_[0].bounds, limit, k)) {
+					const queue_entry root = { k, 0, false };
+					queue.push_back(root);
+				}
+				// Items added since the hierarchy was built
+				for (size_t i = indexed_; i < items_.size(); ++i) {
+					if (key(boxes_[i], limit, k)) {
+						const queue_entry item = { k, static_cast<boost::uint32_t>(i), true };
+						queue.push_back(item);
+					}
+				}
+				std::make_heap(queue.begin(), queue.end(), queue_greater());
+
+				while (!queue.empty()) {
+					std::pop_heap(queue.begin(), queue.end(), queue_greater());
+					const queue_entry e = queue.back();
+					queue.pop_back();
+					if (e.key > limit) {
+						break;
+					}
+					if (e.is_item) {
+						visit(items_[e.index], e.key, limit);
+						continue;
+					}
+					const node& nd = nodes_[e.index];
+					if (nd.count) {
+						for (boost::uint32_t i = nd.offset; i < nd.offset + nd.count; ++i) {
+							if (key(boxes_[i], limit, k)) {
+								const queue_entry item = { k, i, true };
+								queue.push_back(item);
+								std::push_heap(queue.begin(), queue.end(), queue_greater());
+							}
+						}
+					} else {
+						const boost::uint32_t children[2] = { e.index + 1, nd.offset };
+						for (int i = 0; i < 2; ++i) {
+							if (key(nodes_[children[i]].bounds, limit, k)) {
+								const queue_entry child = { k, children[i], false };
+								queue.push_back(child);
+								std::push_heap(queue.begin(), queue.end(), queue_greater());
+							}
+						}
+					}
+				}
+			}
+
+			// Partitions order[begin, end) and returns the start of the second subset,
+			// or end when a leaf is cheaper than any of the binned splits.
+			boost::uint32_t split_(std::vector<boost::uint32_t>& order, const std::vector<float>& centroids,
+				boost::uint32_t begin, boost::uint32_t end, const bvh_box& bounds, const bvh_node_box& centroid_bounds) const
+			{
+				const boost::uint32_t count = end - begin;
+
+				int best_axis = -1, best_bin = -1;
+				// Costs relative to the cost of intersecting an item, traversal is assumed to cost the same
+				double best_cost = static_cast<double>(count) * bounds.half_area();
+
+				for (int axis = 0; axis < 3; ++axis) {
+					const float lo = centroid_bounds.min[axis], hi = centroid_bounds.max[axis];
+					if (!(hi > lo)) {
+						continue;
+					}
+					const float scale = NUM_BINS / (hi - lo);
+
+					bvh_box bin_bounds[NUM_BINS];
+					boost::uint32_t bin_counts[NUM_BINS] = {};
+					for (boost::uint32_t i = begin; i < end; ++i) {
+						const int bin = bin_of_(centroids[3 * order[i] + axis], lo, scale);
+						bin_counts[bin] ++;
+						bin_bounds[bin].add(boxes_[order[i]]);
+					}
+
+					// Sweep from the right to obtain the cost of the second subset for every split
+					double right_costs[NUM_BINS];
+					bvh_box acc;
+					boost::uint32_t acc_count = 0;
+					for (int i = NUM_BINS - 1; i > 0; --i) {
+						acc.add(bin_bounds[i]);
+						acc_count += bin_counts[i];
+						right_costs[i] = static_cast<double>(acc_count) * acc.half_area();
+					}
+
+					acc = bvh_box();
+					acc_count = 0;
+					for (int i = 0; i < NUM_BINS - 1; ++i) {
+						acc.add(bin_bounds[i]);
+						acc_count += bin_counts[i];
+						if (acc_count == 0 || acc_count == count) {
+							continue;
+						}
+						const double cost = bounds.half_area() + static_cast<double>(acc_count) * acc.half_area() + right_costs[i + 1];
+						if (cost < best_cost) {
+							best_cost = cost;
+							best_axis = axis;
+							best_bin = i;
+						}
+					}
+				}
+
+				if (best_axis == -1) {
+					if (count <= static_cast<boost::uint32_t>(MAX_LEAF_SIZE) * 4) {
+						return end;
+					}
+					// Either all centroids coincide or no split improves on a leaf. Large
+					// leaves make for slow queries though, so split at the median instead.
+					int axis = 0;
+					for (int i = 1; i < 3; ++i) {
+						if (centroid_bounds.max[i] - centroid_bounds.min[i] > centroid_bounds.max[axis] - centroid_bounds.min[axis]) {
+							axis = i;
+						}
+					}
+					const boost::uint32_t mid = begin + count / 2;
+					std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, centroid_less(centroids, axis));
+					return mid;
+				}
+
+				const float lo = centroid_bounds.min[best_axis];
+				const float scale = NUM_BINS / (centroid_bounds.max[best_axis] - lo);
+				std::vector<boost::uint32_t>::iterator it = std::partition(order.begin() + begin, order.begin() + end,
+					in_first_bins(centroids, best_axis, best_bin, lo, scale));
+				return static_cast<boost::uint32_t>(it - order.begin());
+			}
+
+			static int bin_of_(float c, float lo, float scale) {
+				const int bin = static_cast<int>((c - lo) * scale);
+				return bin < 0 ? 0 : (bin >= NUM_BINS ? NUM_BINS - 1 : bin);
+			}
+
+			struct centroid_less {
+				const std::vector<float>& centroids;
+				int axis;
+				centroid_less(const std::vector<float>& centroids, int axis) : centroids(centroids), axis(axis) {}
+				bool operator()(boost::uint32_t a, boost::uint32_t b) const {
+					return centroids[3 * a + axis] < centroids[3 * b + axis];
+				}
+			};
+
+			struct in_first_bins {
+				const std::vector<float>& centroids;
+				int axis, last_bin;
+				float lo, scale;
+				in_first_bins(const std::vector<float>& centroids, int axis, int last_bin, float lo, float scale)
+					: centroids(centroids), axis(axis), last_bin(last_bin), lo(lo), scale(scale) {}
+				bool operator()(boost::uint32_t i) const {
+					return bin_of_(centroids[3 * i + axis], lo, scale) <= last_bin;
+				}
+			};
+
+			mutable std::vector<T> items_;
+			mutable std::vector<bvh_box> boxes_;
+			mutable std::vector<node> nodes_;
+			// Items from this index onwards were added after the last build
+			mutable size_t indexed_;
+			// Number of removed items in the hierarchy and of items of which the box changed
+			mutable size_t removed_, modified_;
+			mutable bool built_, needs_refit_;
+			// Positions of the items, maintained once needed to remove or update items
+			mutable position_map_t positions_;
+			mutable bool positions_valid_;
+		};
+
+	}
+
+}
+
+#endif
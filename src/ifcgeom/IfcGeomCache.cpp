@@ -0,0 +1,44 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#include <TopExp.hxx>
+#include <TopTools_IndexedMapOfShape.hxx>
+
+#include "../ifcgeom/IfcGeomCache.h"
+
+size_t IfcGeom::estimate_size(const TopoDS_Shape& shape) {
+	size_t size = sizeof(TopoDS_Shape);
+	if (shape.IsNull()) {
+		return size;
+	}
+
+	// Rough figures for the topological entities including their underlying
+	// geometry. Triangulations that are attached to the faces by the mesher
+	// after the shape has been cached are not accounted for.
+	TopTools_IndexedMapOfShape faces, edges, vertices;
+	TopExp::MapShapes(shape, TopAbs_FACE, faces);
+	TopExp::MapShapes(shape, TopAbs_EDGE, edges);
+	TopExp::MapShapes(shape, TopAbs_VERTEX, vertices);
+
+	size += static_cast<size_t>(faces.Extent()) * 640;
+	size += static_cast<size_t>(edges.Extent()) * 320;
+	size += static_cast<size_t>(vertices.Extent()) * 128;
+
+	return size;
+}
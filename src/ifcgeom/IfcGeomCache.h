@@ -0,0 +1,223 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+/********************************************************************************
+ *                                                                              *
+ * Containers for the conversion results cached by the Kernel. All maps of a    *
+ * cache share a single recency list, so that the least recently used results   *
+ * are evicted first once the memory budget is exceeded, regardless of their    *
+ * type. Entries are evicted based on an estimate of their memory footprint.    *
+ *                                                                              *
+ ********************************************************************************/
+
+#ifndef IFCGEOMCACHE_H
+#define IFCGEOMCACHE_H
+
+#include <map>
+#include <list>
+#include <limits>
+#include <cstddef>
+
+#include <boost/thread/locks.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+#include <gp_Trsf.hxx>
+#include <TopoDS_Shape.hxx>
+
+#include "ifc_geom_api.h"
+#include "../ifcparse/IfcBaseClass.h"
+
+namespace IfcGeom {
+
+	/// Estimates the memory footprint of a cached conversion result
+	template <typename T>
+	inline size_t estimate_size(const T&) { return sizeof(T); }
+	IFC_GEOM_API size_t estimate_size(const TopoDS_Shape& shape);
+
+	class CacheMapBase {
+	public:
+		virtual ~CacheMapBase() {}
+		virtual void evict(int id) = 0;
+	};
+
+	class IFC_GEOM_API CacheRecency {
+	public:
+		typedef std::list< std::pair<CacheMapBase*, int> > list_t;
+		typedef list_t::iterator position_t;
+
+		CacheRecency()
+			: budget_(std::numeric_limits<size_t>::max())
+			, size_(0)
+		{}
+
+		position_t add(CacheMapBase* map, int id, size_t size) {
+			list_.push_front(std::make_pair(map, id));
+			size_ += size;
+			return list_.begin();
+		}
+		void touch(position_t position) {
+			list_.splice(list_.begin(), list_, position);
+		}
+		void remove(position_t position, size_t size) {
+			list_.erase(position);
+			size_ -= size;
+		}
+
+		/// Evicts the least recently used entries until the budget is met
+		void enforce() {
+			while (size_ > budget_ && !list_.empty()) {
+				const std::pair<CacheMapBase*, int> lru = list_.back();
+				lru.first->evict(lru.second);
+			}
+		}
+
+		size_t budget() const { return budget_; }
+		void set_budget(size_t budget) {
+			budget_ = budget;
+			enforce();
+		}
+		size_t size() const { return size_; }
+
+	private:
+		CacheRecency(const CacheRecency&); // N/I
+		CacheRecency& operator=(const CacheRecency&); // N/I
+
+		list_t list_;
+		size_t budget_, size_;
+	};
+
+	/// A map of conversion results by instance id. Values are returned by copy,
+	/// so that evictions triggered by subsequent insertions do not invalidate them.
+	template <typename V>
+	class CacheMap : public CacheMapBase {
+	private:
+		// Book keeping overhead of the map and recency list nodes
+		static const size_t overhead = 96;
+
+		struct entry {
+			V value;
+			size_t size;
+			CacheRecency::position_t position;
+		};
+		typedef std::map<int, entry> map_t;
+
+		map_t map_;
+		CacheRecency* recency_;
+
+		CacheMap(const CacheMap&); // N/I
+		CacheMap& operator=(const CacheMap&); // N/I
+
+	public:
+		CacheMap()
+			: recency_(0)
+		{}
+
+		/// Needs to be called before the map is used
+		void set_recency(CacheRecency* recency) {
+			recency_ = recency;
+		}
+
+		bool find(int id, V& value) {
+			typename map_t::iterator it = map_.find(id);
+			if (it == map_.end()) {
+				return false;
+			}
+			recency_->touch(it->second.position);
+			value = it->second.value;
+			return true;
+		}
+
+		void insert(int id, const V& value) {
+			evict(id);
+			entry& e = map_[id];
+			e.value = value;
+			e.size = estimate_size(value) + overhead;
+			e.position = recency_->add(this, id, e.size);
+			recency_->enforce();
+		}
+
+		void evict(int id) {
+			typename map_t::iterator it = map_.find(id);
+			if (it != map_.end()) {
+				recency_->remove(it->second.position, it->second.size);
+				map_.erase(it);
+			}
+		}
+
+		void clear() {
+			for (typename map_t::iterator it = map_.begin(); it != map_.end(); ++it) {
+				recency_->remove(it->second.position, it->second.size);
+			}
+			map_.clear();
+		}
+
+		size_t size() const { return map_.size(); }
+	};
+
+	/// Placements of IfcLocalPlacements by instance id, resolved up to the
+	/// IfcProduct type relative to which placements are converted. Unlike the
+	/// Cache, this is never purged. As every placement is stored, a chain of
+	/// PlacementRelTo references is only traversed until the first placement
+	/// that has been resolved earlier. A memo can be shared between the
+	/// Kernels of multiple threads that process the same file.
+	class IFC_GEOM_API PlacementMemo {
+	public:
+		PlacementMemo(IfcSchema::Type::Enum placement_rel_to, double length_unit)
+			: placement_rel_to_(placement_rel_to)
+			, length_unit_(length_unit)
+		{}
+
+		/// Whether the placements have been computed using the same conversion settings
+		bool is_compatible(IfcSchema::Type::Enum placement_rel_to, double length_unit) const {
+			return placement_rel_to_ == placement_rel_to && length_unit_ == length_unit;
+		}
+
+		bool find(unsigned int id, gp_Trsf& trsf) const {
+			boost::shared_lock<boost::shared_mutex> lock(mutex_);
+			std::map<unsigned int, gp_Trsf>::const_iterator it = placements_.find(id);
+			if (it == placements_.end()) {
+				return false;
+			}
+			trsf = it->second;
+			return true;
+		}
+
+		void insert(unsigned int id, const gp_Trsf& trsf) {
+			boost::unique_lock<boost::shared_mutex> lock(mutex_);
+			placements_[id] = trsf;
+		}
+
+		size_t size() const {
+			boost::shared_lock<boost::shared_mutex> lock(mutex_);
+			return placements_.size();
+		}
+
+	private:
+		PlacementMemo(const PlacementMemo&); // N/I
+		PlacementMemo& operator=(const PlacementMemo&); // N/I
+
+		IfcSchema::Type::Enum placement_rel_to_;
+		double length_unit_;
+		std::map<unsigned int, gp_Trsf> placements_;
+		mutable boost::shared_mutex mutex_;
+	};
+
+}
+
+#endif
@@ -0,0 +1,452 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include <gp_Trsf.hxx>
+#include <BRepTools.hxx>
+#include <BRep_Builder.hxx>
+#include <Precision.hxx>
+#include <Standard_Failure.hxx>
+#include <Standard_Version.hxx>
+
+#include "../ifcparse/IfcLogger.h"
+
+#include "../ifcgeom/IfcGeomDiskCache.h"
+
+namespace fs = boost::filesystem;
+
+namespace {
+	const char MAGIC[] = "IfcOpenShell-geometry-cache";
+	const char EXTENSION[] = ".cache";
+
+	// Values are written in native byte order, the cache is not meant to be
+	// shared between machines.
+	template <typename T>
+	void write_value(std::ostream& s, const T& t) {
+		s.write(reinterpret_cast<const char*>(&t), sizeof(T));
+	}
+
+	template <typename T>
+	T read_value(std::istream& s) {
+		T t;
+		if (!s.read(reinterpret_cast<char*>(&t), sizeof(T))) {
+			throw std::runtime_error("Unexpected end of cache entry");
+		}
+		return t;
+	}
+
+	void write_string(std::ostream& s, const std::string& str) {
+		write_value<boost::uint64_t>(s, str.size());
+		s.write(str.data(), str.size());
+	}
+
+	std::string read_string(std::istream& s) {
+		const boost::uint64_t n = read_value<boost::uint64_t>(s);
+		std::string str(static_cast<size_t>(n), '\0');
+		if (n && !s.read(&str[0], n)) {
+			throw std::runtime_error("Unexpected end of cache entry");
+		}
+		return str;
+	}
+
+	template <typename T>
+	void write_vector(std::ostream& s, const std::vector<T>& v) {
+		write_value<boost::uint64_t>(s, v.size());
+		if (!v.empty()) {
+			s.write(reinterpret_cast<const char*>(&v[0]), v.size() * sizeof(T));
+		}
+	}
+
+	template <typename T>
+	std::vector<T> read_vector(std::istream& s) {
+		const boost::uint64_t n = read_value<boost::uint64_t>(s);
+		std::vector<T> v(static_cast<size_t>(n));
+		if (n && !s.read(reinterpret_cast<char*>(&v[0]), n * sizeof(T))) {
+			throw std::runtime_error("Unexpected end of cache entry");
+		}
+		return v;
+	}
+
+	void write_color(std::ostream& s, const boost::optional<IfcGeom::SurfaceStyle::ColorComponent>& c) {
+		write_value<boost::uint8_t>(s, c ? 1 : 0);
+		if (c) {
+			write_value(s, c->R());
+			write_value(s, c->G());
+			write_value(s, c->B());
+		}
+	}
+
+	boost::optional<IfcGeom::SurfaceStyle::ColorComponent> read_color(std::istream& s) {
+		boost::optional<IfcGeom::SurfaceStyle::ColorComponent> c;
+		if (read_value<boost::uint8_t>(s)) {
+			const double r = read_value<double>(s);
+			const double g = read_value<double>(s);
+			const double b = read_value<double>(s);
+			c = IfcGeom::SurfaceStyle::ColorComponent(r, g, b);
+		}
+		return c;
+	}
+
+	void write_optional(std::ostream& s, const boost::optional<double>& d) {
+		write_value<boost::uint8_t>(s, d ? 1 : 0);
+		if (d) {
+			write_value(s, *d);
+		}
+	}
+
+	boost::optional<double> read_optional(std::istream& s) {
+		boost::optional<double> d;
+		if (read_value<boost::uint8_t>(s)) {
+			d = read_value<double>(s);
+		}
+		return d;
+	}
+
+	bool equal_colors(const boost::optional<IfcGeom::SurfaceStyle::ColorComponent>& a, const boost::optional<IfcGeom::SurfaceStyle::ColorComponent>& b) {
+		if (!a || !b) {
+			return !a && !b;
+		}
+		return a->R() == b->R() && a->G() == b->G() && a->B() == b->B();
+	}
+
+	// The placement is stored as a matrix. For proper rigid transformations
+	// the form is retained so that the transformation can be reconstructed
+	// as a gp_Trsf, which is taken into account when applying it to shapes.
+	void write_placement(std::ostream& s, const gp_GTrsf& placement) {
+		write_value<boost::uint8_t>(s, placement.Form() == gp_Other ? 0 : 1);
+		for (int i = 1; i <= 3; ++i) {
+			for (int j = 1; j <= 4; ++j) {
+				write_value(s, placement.Value(i, j));
+			}
+		}
+	}
+
+	gp_GTrsf read_placement(std::istream& s) {
+		const bool is_trsf = read_value<boost::uint8_t>(s) != 0;
+		double m[3][4];
+		for (int i = 0; i < 3; ++i) {
+			for (int j = 0; j < 4; ++j) {
+				m[i][j] = read_value<double>(s);
+			}
+		}
+		if (is_trsf) {
+			gp_Trsf trsf;
+			trsf.SetValues(
+				m[0][0], m[0][1], m[0][2], m[0][3],
+				m[1][0], m[1][1], m[1][2], m[1][3],
+				m[2][0], m[2][1], m[2][2], m[2][3]
+#if OCC_VERSION_HEX < 0x60800
+				, Precision::Angular(), Precision::Confusion()
+#endif
+			);
+			return gp_GTrsf(trsf);
+		} else {
+			gp_GTrsf gtrsf;
+			for (int i = 0; i < 3; ++i) {
+				for (int j = 0; j < 4; ++j) {
+					gtrsf.SetValue(i + 1, j + 1, m[i][j]);
+				}
+			}
+			return gtrsf;
+		}
+	}
+}
+
+const boost::uint32_t IfcGeom::DiskCache::FORMAT_VERSION;
+
+IfcGeom::DiskCache::Style::Style(const SurfaceStyle& style)
+	: has_id(!!style.Id())
+	, original_name(style.original_name())
+	, diffuse(style.Diffuse())
+	, specular(style.Specular())
+	, transparency(style.Transparency())
+	, specularity(style.Specularity())
+{}
+
+bool IfcGeom::DiskCache::Style::matches(const SurfaceStyle& style) const {
+	return has_id == !!style.Id() &&
+		original_name == style.original_name() &&
+		equal_colors(diffuse, style.Diffuse()) &&
+		equal_colors(specular, style.Specular()) &&
+		transparency == style.Transparency() &&
+		specularity == style.Specularity();
+}
+
+int IfcGeom::DiskCache::Entry::style_index(const SurfaceStyle* style) {
+	std::vector<const SurfaceStyle*>::const_iterator it = std::find(stored_styles_.begin(), stored_styles_.end(), style);
+	if (it != stored_styles_.end()) {
+		return static_cast<int>(it - stored_styles_.begin());
+	}
+	stored_styles_.push_back(style);
+	styles.push_back(Style(*style));
+	return static_cast<int>(styles.size() - 1);
+}
+
+bool IfcGeom::DiskCache::Entry::resolve(const std::vector<const SurfaceStyle*>& candidates, std::vector<const SurfaceStyle*>& resolved) const {
+	resolved.clear();
+	for (std::vector<Style>::const_iterator it = styles.begin(); it != styles.end(); ++it) {
+		const SurfaceStyle* match = 0;
+		for (std::vector<const SurfaceStyle*>::const_iterator jt = candidates.begin(); jt != candidates.end(); ++jt) {
+			if (*jt && *jt != match && it->matches(**jt)) {
+				if (match) {
+					// Ambiguous, the entry can not be reconstructed reliably
+					return false;
+				}
+				match = *jt;
+			}
+		}
+		if (!match) {
+			return false;
+		}
+		resolved.push_back(match);
+	}
+	return true;
+}
+
+boost::shared_ptr<IfcGeom::Representation::BRep> IfcGeom::DiskCache::Entry::brep(const ElementSettings& settings, const std::string& id, const std::vector<const SurfaceStyle*>& resolved) const {
+	IfcRepresentationShapeItems items;
+	for (std::vector<ShapeItem>::const_iterator it = shapes.begin(); it != shapes.end(); ++it) {
+		items.push_back(IfcRepresentationShapeItem(it->placement, it->shape, it->style == -1 ? 0 : resolved[it->style]));
+	}
+	return boost::shared_ptr<Representation::BRep>(new Representation::BRep(settings, id, items));
+}
+
+IfcGeom::DiskCache::DiskCache(const std::string& directory, boost::uintmax_t size_limit)
+	: directory_(directory)
+	, size_limit_(size_limit)
+	, size_(0)
+{
+	fs::create_directories(directory_);
+	for (fs::directory_iterator it(directory_), end; it != end; ++it) {
+		const fs::path& p = it->path();
+		if (!fs::is_regular_file(p) || p.extension() != EXTENSION) {
+			continue;
+		}
+		file_info& info = files_[p.stem().string()];
+		info.size = fs::file_size(p);
+		info.access = access_.insert(std::make_pair(fs::last_write_time(p), p.stem().string()));
+		size_ += info.size;
+	}
+	evict_();
+}
+
+std::string IfcGeom::DiskCache::path_(const std::string& key) const {
+	return (fs::path(directory_) / (key + EXTENSION)).string();
+}
+
+void IfcGeom::DiskCache::touch_(const std::string& key, boost::uintmax_t size) {
+	forget_(key);
+	const std::time_t now = std::time(0);
+	file_info& info = files_[key];
+	info.size = size;
+	info.access = access_.insert(std::make_pair(now, key));
+	size_ += size;
+}
+
+void IfcGeom::DiskCache::forget_(const std::string& key) {
+	std::map<std::string, file_info>::iterator it = files_.find(key);
+	if (it != files_.end()) {
+		size_ -= it->second.size;
+		access_.erase(it->second.access);
+		files_.erase(it);
+	}
+}
+
+void IfcGeom::DiskCache::evict_() {
+	while (size_ > size_limit_ && !access_.empty()) {
+		const std::string key = access_.begin()->second;
+		boost::system::error_code ec;
+		fs::remove(path_(key), ec);
+		forget_(key);
+	}
+}
+
+bool IfcGeom::DiskCache::read(const std::string& key, boost::uint64_t digest, Entry& entry) {
+	const std::string path = path_(key);
+	std::ifstream stream(path.c_str(), std::ios_base::binary);
+	if (!stream) {
+		return false;
+	}
+
+	try {
+		std::string magic(sizeof(MAGIC) - 1, '\0');
+		if (!stream.read(&magic[0], magic.size()) || magic != MAGIC) {
+			throw std::runtime_error("Not a cache entry");
+		}
+		if (read_value<boost::uint32_t>(stream) != FORMAT_VERSION) {
+			throw std::runtime_error("Incompatible cache entry version");
+		}
+		if (read_value<boost::uint64_t>(stream) != digest) {
+			// A valid entry for different inputs with the same key, it is
+			// replaced once the geometry for these inputs is written.
+			Logger::Message(Logger::LOG_NOTICE, "Cache entry " + path + " does not match its key");
+			return false;
+		}
+
+		entry.id = read_string(stream);
+		entry.material_style_applied = read_value<boost::uint8_t>(stream) != 0;
+
+		const boost::uint64_t num_styles = read_value<boost::uint64_t>(stream);
+		for (boost::uint64_t i = 0; i < num_styles; ++i) {
+			Style style;
+			style.has_id = read_value<boost::uint8_t>(stream) != 0;
+			style.original_name = read_string(stream);
+			style.diffuse = read_color(stream);
+			style.specular = read_color(stream);
+			style.transparency = read_optional(stream);
+			style.specularity = read_optional(stream);
+			entry.styles.push_back(style);
+		}
+
+		const boost::uint64_t num_shapes = read_value<boost::uint64_t>(stream);
+		for (boost::uint64_t i = 0; i < num_shapes; ++i) {
+			ShapeItem item;
+			item.style = read_value<boost::int32_t>(stream);
+			if (item.style < -1 || item.style >= static_cast<int>(entry.styles.size())) {
+				throw std::runtime_error("Invalid style reference");
+			}
+			item.placement = read_placement(stream);
+			std::stringstream brep_data(read_string(stream));
+			BRep_Builder builder;
+			BRepTools::Read(item.shape, brep_data, builder);
+			if (item.shape.IsNull()) {
+				throw std::runtime_error("Invalid shape");
+			}
+			entry.shapes.push_back(item);
+		}
+
+		entry.has_triangulation = read_value<boost::uint8_t>(stream) != 0;
+		if (entry.has_triangulation) {
+			entry.verts = read_vector<double>(stream);
+			entry.faces = read_vector<int>(stream);
+			entry.edges = read_vector<int>(stream);
+			entry.normals = read_vector<double>(stream);
+			entry.uvs = read_vector<double>(stream);
+			entry.material_ids = read_vector<int>(stream);
+			entry.materials = read_vector<int>(stream);
+			for (std::vector<int>::const_iterator it = entry.materials.begin(); it != entry.materials.end(); ++it) {
+				if (*it < -1 || *it >= static_cast<int>(entry.styles.size())) {
+					throw std::runtime_error("Invalid style reference");
+				}
+			}
+		}
+	} catch (const std::exception& e) {
+		Logger::Message(Logger::LOG_WARNING, std::string("Removing invalid cache entry ") + path + ": " + e.what());
+		stream.close();
+		boost::system::error_code ec;
+		fs::remove(path, ec);
+		forget_(key);
+		entry = Entry();
+		return false;
+	} catch (const Standard_Failure&) {
+		Logger::Message(Logger::LOG_WARNING, "Removing invalid cache entry " + path);
+		stream.close();
+		boost::system::error_code ec;
+		fs::remove(path, ec);
+		forget_(key);
+		entry = Entry();
+		return false;
+	}
+
+	stream.close();
+
+	// Mark the entry as recently used
+	boost::system::error_code ec;
+	const std::time_t now = std::time(0);
+	fs::last_write_time(path, now, ec);
+	std::map<std::string, file_info>::const_iterator it = files_.find(key);
+	touch_(key, it != files_.end() ? it->second.size : fs::file_size(path, ec));
+
+	return true;
+}
+
+void IfcGeom::DiskCache::write(const std::string& key, boost::uint64_t digest, const Entry& entry) {
+	std::stringstream stream;
+	stream.write(MAGIC, sizeof(MAGIC) - 1);
+	write_value(stream, FORMAT_VERSION);
+	write_value(stream, digest);
+
+	write_string(stream, entry.id);
+	write_value<boost::uint8_t>(stream, entry.material_style_applied ? 1 : 0);
+
+	write_value<boost::uint64_t>(stream, entry.styles.size());
+	for (std::vector<Style>::const_iterator it = entry.styles.begin(); it != entry.styles.end(); ++it) {
+		write_value<boost::uint8_t>(stream, it->has_id ? 1 : 0);
+		write_string(stream, it->original_name);
+		write_color(stream, it->diffuse);
+		write_color(stream, it->specular);
+		write_optional(stream, it->transparency);
+		write_optional(stream, it->specularity);
+	}
+
+	write_value<boost::uint64_t>(stream, entry.shapes.size());
+	for (std::vector<ShapeItem>::const_iterator it = entry.shapes.begin(); it != entry.shapes.end(); ++it) {
+		write_value<boost::int32_t>(stream, it->style);
+		write_placement(stream, it->placement);
+		std::stringstream brep_data;
+		BRepTools::Write(it->shape, brep_data);
+		write_string(stream, brep_data.str());
+	}
+
+	write_value<boost::uint8_t>(stream, entry.has_triangulation ? 1 : 0);
+	if (entry.has_triangulation) {
+		write_vector(stream, entry.verts);
+		write_vector(stream, entry.faces);
+		write_vector(stream, entry.edges);
+		write_vector(stream, entry.normals);
+		write_vector(stream, entry.uvs);
+		write_vector(stream, entry.material_ids);
+		write_vector(stream, entry.materials);
+	}
+
+	const std::string data = stream.str();
+
+	// Write to a temporary file first, so that concurrent readers and
+	// interrupted writes never observe a partial entry.
+	const std::string path = path_(key);
+	const std::string temp_path = (fs::path(directory_) / fs::unique_path("%%%%-%%%%-%%%%-%%%%.tmp")).string();
+	{
+		std::ofstream file(temp_path.c_str(), std::ios_base::binary);
+		file.write(data.data(), data.size());
+		if (!file) {
+			Logger::Message(Logger::LOG_WARNING, "Failed to write cache entry " + path);
+			file.close();
+			boost::system::error_code ec;
+			fs::remove(temp_path, ec);
+			return;
+		}
+	}
+
+	boost::system::error_code ec;
+	fs::rename(temp_path, path, ec);
+	if (ec) {
+		Logger::Message(Logger::LOG_WARNING, "Failed to write cache entry " + path);
+		fs::remove(temp_path, ec);
+		return;
+	}
+
+	touch_(key, data.size());
+	evict_();
+}
@@ -0,0 +1,167 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#ifndef IFCGEOMDISKCACHE_H
+#define IFCGEOMDISKCACHE_H
+
+#include <map>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/optional.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <gp_GTrsf.hxx>
+#include <TopoDS_Shape.hxx>
+
+#include "../ifcgeom/IfcGeomRenderStyles.h"
+#include "../ifcgeom/IfcGeomRepresentation.h"
+
+namespace IfcGeom {
+
+	/// A persistent cache of converted representations, stored as one file per
+	/// entry in a user given directory. Entries are looked up by a key that
+	/// should capture everything the geometry depends on, see the Iterator for
+	/// how these are composed. When the total size of the entries exceeds the
+	/// size limit, the least recently used entries are removed. As keys are
+	/// hashes, every entry also stores a digest of the key inputs that is
+	/// computed independently of the key, and that needs to match on read.
+	///
+	/// Styles are stored by value, so that entries can be reused across
+	/// revisions of a model in which instance ids differ. Upon reading an
+	/// entry the styles need to be resolved to the SurfaceStyles of the model
+	/// being converted, see Entry::resolve().
+	class IFC_GEOM_API DiskCache {
+	public:
+		static const boost::uint32_t FORMAT_VERSION = 2;
+
+		class IFC_GEOM_API Style {
+		public:
+			bool has_id;
+			std::string original_name;
+			boost::optional<SurfaceStyle::ColorComponent> diffuse, specular;
+			boost::optional<double> transparency, specularity;
+
+			Style() : has_id(false) {}
+			explicit Style(const SurfaceStyle& style);
+
+			bool matches(const SurfaceStyle& style) const;
+		};
+
+		struct ShapeItem {
+			int style;
+			gp_GTrsf placement;
+			TopoDS_Shape shape;
+		};
+
+		class IFC_GEOM_API Entry {
+		public:
+			std::string id;
+			/// Whether the style of the single associated material has been applied to unstyled items
+			bool material_style_applied;
+			std::vector<Style> styles;
+			std::vector<ShapeItem> shapes;
+
+			bool has_triangulation;
+			std::vector<double> verts, normals, uvs;
+			std::vector<int> faces, edges, material_ids, materials;
+
+			Entry() : material_style_applied(false), has_triangulation(false) {}
+
+			template <typename P>
+			void store(const Representation::BRep& brep, const Representation::Triangulation<P>* triangulation) {
+				id = brep.id();
+				for (IfcRepresentationShapeItems::const_iterator it = brep.begin(); it != brep.end(); ++it) {
+					ShapeItem item;
+					item.style = it->hasStyle() ? style_index(&it->Style()) : -1;
+					item.placement = it->Placement();
+					item.shape = it->Shape();
+					shapes.push_back(item);
+				}
+				if (triangulation) {
+					has_triangulation = true;
+					verts.assign(triangulation->verts().begin(), triangulation->verts().end());
+					normals.assign(triangulation->normals().begin(), triangulation->normals().end());
+					uvs.assign(triangulation->uvs().begin(), triangulation->uvs().end());
+					faces = triangulation->faces();
+					edges = triangulation->edges();
+					material_ids = triangulation->material_ids();
+					for (std::vector<Material>::const_iterator it = triangulation->materials().begin(); it != triangulation->materials().end(); ++it) {
+						materials.push_back(it->surface_style() ? style_index(it->surface_style()) : -1);
+					}
+				}
+			}
+
+			/// Maps the stored styles onto the candidate styles of the model being converted.
+			/// Fails if a style does not have exactly one candidate with the same values.
+			bool resolve(const std::vector<const SurfaceStyle*>& candidates, std::vector<const SurfaceStyle*>& resolved) const;
+
+			boost::shared_ptr<Representation::BRep> brep(const ElementSettings& settings, const std::string& id, const std::vector<const SurfaceStyle*>& resolved) const;
+
+			template <typename P>
+			boost::shared_ptr< Representation::Triangulation<P> > triangulation(const ElementSettings& settings, const std::string& id, const std::vector<const SurfaceStyle*>& resolved) const {
+				std::vector<Material> ms;
+				for (std::vector<int>::const_iterator it = materials.begin(); it != materials.end(); ++it) {
+					ms.push_back(Material(*it == -1 ? 0 : resolved[*it]));
+				}
+				return boost::shared_ptr< Representation::Triangulation<P> >(new Representation::Triangulation<P>(settings, id,
+					std::vector<P>(verts.begin(), verts.end()), faces, edges,
+					std::vector<P>(normals.begin(), normals.end()), std::vector<P>(uvs.begin(), uvs.end()),
+					material_ids, ms));
+			}
+
+		private:
+			int style_index(const SurfaceStyle* style);
+			std::vector<const SurfaceStyle*> stored_styles_;
+		};
+
+		/// @param size_limit Maximum size of the cache directory in bytes
+		DiskCache(const std::string& directory, boost::uintmax_t size_limit);
+
+		bool read(const std::string& key, boost::uint64_t digest, Entry& entry);
+		void write(const std::string& key, boost::uint64_t digest, const Entry& entry);
+
+	private:
+		DiskCache(const DiskCache&); // N/I
+		DiskCache& operator=(const DiskCache&); // N/I
+
+		std::string path_(const std::string& key) const;
+		void touch_(const std::string& key, boost::uintmax_t size);
+		void forget_(const std::string& key);
+		void evict_();
+
+		std::string directory_;
+		boost::uintmax_t size_limit_, size_;
+
+		// Size and last access time of the cache entries, the latter indexed
+		// to quickly find the least recently used entries.
+		typedef std::multimap<std::time_t, std::string> access_index_t;
+		struct file_info {
+			boost::uintmax_t size;
+			access_index_t::iterator access;
+		};
+		std::map<std::string, file_info> files_;
+		access_index_t access_;
+	};
+
+}
+
+#endif
@@ -180,19 +180,42 @@ namespace IfcGeom {
 
 	template <typename P>
 	class TriangulationElement : public Element<P> {
+	public:
+		typedef std::vector< boost::shared_ptr< Representation::Triangulation<P> > > lod_list;
 	private:
 		boost::shared_ptr< Representation::Triangulation<P> > _geometry;
+		lod_list _lods;
 	public:
 		const Representation::Triangulation<P>& geometry() const { return *_geometry; }
 		const boost::shared_ptr< Representation::Triangulation<P> >& geometry_pointer() const { return _geometry; }
+		/// Additional levels of detail, in the order of IteratorSettings::lod_deflections()
+		const lod_list& lods() const { return _lods; }
 		TriangulationElement(const BRepElement<P>& shape_model)
 			: Element<P>(shape_model)
 			, _geometry(boost::shared_ptr<Representation::Triangulation<P> >(new Representation::Triangulation<P>(shape_model.geometry())))
+			, _lods(create_lods(shape_model.geometry()))
 		{}
-		TriangulationElement(const Element<P>& element, const boost::shared_ptr<Representation::Triangulation<P> >& geometry)
+		TriangulationElement(const Element<P>& element, const boost::shared_ptr<Representation::Triangulation<P> >& geometry, const lod_list& lods = lod_list())
 			: Element<P>(element)
 			, _geometry(geometry)
+			, _lods(lods)
 		{}
+
+		/// Triangulates the shapes once for every deflection in IteratorSettings::lod_deflections()
+		static lod_list create_lods(const Representation::BRep& brep) {
+			lod_list lods;
+			const std::vector<double>& deflections = brep.settings().lod_deflections();
+			for (std::vector<double>::const_iterator it = deflections.begin(); it != deflections.end(); ++it) {
+				ElementSettings settings(brep.settings());
+				if (settings.relative_deflection() > 0.) {
+					settings.set_relative_deflection(*it);
+				} else {
+					settings.set_deflection_tolerance(*it);
+				}
+				lods.push_back(boost::shared_ptr<Representation::Triangulation<P> >(new Representation::Triangulation<P>(brep, settings)));
+			}
+			return lods;
+		}
 	private:
 		TriangulationElement(const TriangulationElement& other);
 		TriangulationElement& operator=(const TriangulationElement& other);
@@ -63,6 +63,7 @@
 #include <GeomAPI_IntCS.hxx>
 #include <GeomAPI_IntSS.hxx>
 
+#include <Bnd_Box.hxx>
 #include <BRepBndLib.hxx>
 #include <BRepOffsetAPI_Sewing.hxx>
 #include <BRepBuilderAPI_MakeFace.hxx>
@@ -83,6 +84,7 @@
 #include <BRepBuilderAPI_MakeShell.hxx>
 #include <BRepBuilderAPI_MakeSolid.hxx>
 #include <BRepPrimAPI_MakeHalfSpace.hxx>
+#include <BRepPrimAPI_MakeBox.hxx>
 #include <BRepAlgoAPI_Cut.hxx>
 #include <BRepAlgoAPI_Fuse.hxx>
 #include <BRepAlgoAPI_Common.hxx>
@@ -352,6 +354,11 @@ bool IfcGeom::Kernel::convert_openings(const IfcSchema::IfcProduct* entity, cons
 
 		// Iterate over the shapes of the IfcOpeningElements
 		for ( IfcGeom::IfcRepresentationShapeItems::const_iterator it4 = opening_shapes.begin(); it4 != opening_shapes.end(); ++ it4 ) {
+			if (!consume_boolean_attempt()) {
+				Logger::Message(Logger::LOG_ERROR,"Boolean budget exhausted, remaining openings not subtracted:",entity->entity);
+				break;
+			}
+
 			TopoDS_Shape opening_shape_solid;
 			const TopoDS_Shape& opening_shape_unlocated = ensure_fit_for_subtraction(it4->Shape(),opening_shape_solid);
 			const gp_GTrsf& opening_shape_gtrsf = it4->Placement();
@@ -527,6 +534,10 @@ bool IfcGeom::Kernel::convert_openings_fast(const IfcSchema::IfcProduct* entity,
 		}
 		TopoDS_Shape entity_shape = apply_transformation(entity_shape_unlocated, entity_shape_gtrsf);
 
+		if (!consume_boolean_attempt()) {
+			return false;
+		}
+
 		BRepAlgoAPI_Cut brep_cut(entity_shape,opening_compound);
 
 		bool is_valid = false;
@@ -830,6 +841,20 @@ void IfcGeom::Kernel::setValue(GeomValue var, double value) {
 	case GV_DIMENSIONALITY:
 		dimensionality = value;
 		break;
+	case GV_MAX_BOOLEAN_ATTEMPTS:
+		max_boolean_attempts = value;
+		break;
+	case GV_BOOLEAN_TIMEOUT:
+		boolean_timeout = value;
+		break;
+	case GV_CACHE_MEMORY_LIMIT:
+		cache_memory_limit = value;
+#ifndef NO_CACHE
+		cache.set_budget(value < 0.
+			? std::numeric_limits<size_t>::max()
+			: static_cast<size_t>(value * 1024. * 1024.));
+#endif
+		break;
 	default:
 		assert(!"never reach here");
 	}
@@ -861,11 +886,71 @@ double IfcGeom::Kernel::getValue(GeomValue var) const {
 	case GV_DIMENSIONALITY:
 		return dimensionality;
 		break;
+	case GV_MAX_BOOLEAN_ATTEMPTS:
+		return max_boolean_attempts;
+		break;
+	case GV_BOOLEAN_TIMEOUT:
+		return boolean_timeout;
+		break;
+	case GV_CACHE_MEMORY_LIMIT:
+		return cache_memory_limit;
+		break;
 	}
 	assert(!"never reach here");
 	return 0;
 }
 
+void IfcGeom::Kernel::reset_boolean_budget() {
+	boolean_attempts = 0;
+	boolean_budget_exceeded = false;
+	boolean_budget_start = boost::posix_time::microsec_clock::universal_time();
+}
+
+bool IfcGeom::Kernel::consume_boolean_attempt() {
+	if (boolean_budget_exceeded) {
+		return false;
+	}
+	if (max_boolean_attempts >= 0. && boolean_attempts >= max_boolean_attempts) {
+		boolean_budget_exceeded = true;
+	} else if (boolean_timeout >= 0. && !boolean_budget_start.is_not_a_date_time()) {
+		const boost::posix_time::time_duration elapsed = boost::posix_time::microsec_clock::universal_time() - boolean_budget_start;
+		if (elapsed.total_microseconds() > boolean_timeout * 1.e6) {
+			boolean_budget_exceeded = true;
+		}
+	}
+	if (boolean_budget_exceeded) {
+		return false;
+	}
+	++ boolean_attempts;
+	return true;
+}
+
+void IfcGeom::Kernel::bounding_box_proxy(const IfcGeom::IfcRepresentationShapeItems& shapes, IfcGeom::IfcRepresentationShapeItems& proxies) {
+	const double precision = getValue(GV_PRECISION);
+	for (IfcGeom::IfcRepresentationShapeItems::const_iterator it = shapes.begin(); it != shapes.end(); ++it) {
+		const SurfaceStyle* style = it->hasStyle() ? &it->Style() : 0;
+		const TopoDS_Shape shape = apply_transformation(it->Shape(), it->Placement());
+
+		Bnd_Box box;
+		BRepBndLib::Add(shape, box);
+		if (box.IsVoid()) {
+			continue;
+		}
+
+		double xmin, ymin, zmin, xmax, ymax, zmax;
+		box.Get(xmin, ymin, zmin, xmax, ymax, zmax);
+
+		// BRepPrimAPI_MakeBox does not accept flat boxes, for those the original is retained
+		if (xmax - xmin < precision || ymax - ymin < precision || zmax - zmin < precision) {
+			proxies.push_back(IfcGeom::IfcRepresentationShapeItem(shape, style));
+			continue;
+		}
+
+		TopoDS_Shape proxy = BRepPrimAPI_MakeBox(gp_Pnt(xmin, ymin, zmin), gp_Pnt(xmax, ymax, zmax)).Solid();
+		proxies.push_back(IfcGeom::IfcRepresentationShapeItem(proxy, style));
+	}
+}
+
 // Returns the vertex part of an TopoDS_Edge edge that is not TopoDS_Vertex vertex
 TopoDS_Vertex find_other(const TopoDS_Edge& edge, const TopoDS_Vertex& vertex) {
 	TopExp_Explorer exp(edge, TopAbs_VERTEX);
@@ -1188,10 +1273,27 @@ IfcGeom::BRepElement<P>* IfcGeom::Kernel::create_brep_for_representation_and_pro
 	IfcGeom::Representation::BRep* shape;
 	IfcGeom::IfcRepresentationShapeItems shapes, shapes2;
 
+	reset_boolean_budget();
+
 	if ( !convert_shapes(representation, shapes) ) {
 		return 0;
 	}
 
+	// The budget can already be exhausted by the boolean operations of the representation
+	// items, in which case differences yield their un-cut first operand and other
+	// operations are dropped.
+	const bool items_exceeded_budget = is_boolean_budget_exceeded();
+	if (items_exceeded_budget) {
+		if (settings.get(IteratorSettings::BOOLEAN_BOUNDING_BOX_FALLBACK)) {
+			Logger::Message(Logger::LOG_ERROR,"Boolean budget exhausted, using bounding box for:",product->entity);
+			bounding_box_proxy(shapes, shapes2);
+			std::swap(shapes, shapes2);
+			shapes2.clear();
+		} else {
+			Logger::Message(Logger::LOG_ERROR,"Boolean budget exhausted, representation incomplete for:",product->entity);
+		}
+	}
+
 	if (settings.get(IteratorSettings::APPLY_LAYERSETS)) {
 		TopoDS_Shape merge;
 		if (flatten_shape_list(shapes, merge, false)) {
@@ -1301,6 +1403,21 @@ IfcGeom::BRepElement<P>* IfcGeom::Kernel::create_brep_for_representation_and_pro
 		} catch(...) { 
 			Logger::Message(Logger::LOG_ERROR,"Error processing openings for:",product->entity); 
 		}
+		if (is_boolean_budget_exceeded()) {
+			// Rather than a partially subtracted result, the product is represented
+			// by its un-cut shape or, if requested, by axis aligned bounding boxes.
+			opened_shapes.clear();
+			if (items_exceeded_budget) {
+				// Already reported and substituted above
+				opened_shapes = shapes;
+			} else if (settings.get(IteratorSettings::BOOLEAN_BOUNDING_BOX_FALLBACK)) {
+				Logger::Message(Logger::LOG_ERROR,"Boolean budget exhausted, using bounding box for:",product->entity);
+				bounding_box_proxy(shapes, opened_shapes);
+			} else {
+				Logger::Message(Logger::LOG_ERROR,"Boolean budget exhausted, using shape without openings for:",product->entity);
+				opened_shapes = shapes;
+			}
+		}
         if (settings.get(IteratorSettings::USE_WORLD_COORDS)) {
 			for ( IfcGeom::IfcRepresentationShapeItems::iterator it = opened_shapes.begin(); it != opened_shapes.end(); ++ it ) {
 				it->prepend(trsf);
@@ -1407,8 +1524,16 @@ IfcSchema::IfcProduct::list::ptr IfcGeom::Kernel::products_represented_by(const
 
 template <typename P>
 IfcGeom::BRepElement<P>* IfcGeom::Kernel::create_brep_for_processed_representation(
-    const IteratorSettings& /*settings*/, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product,
+    const IteratorSettings& settings, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product,
     IfcGeom::BRepElement<P>* brep)
+{
+	return create_brep_for_processed_representation<P>(settings, representation, product, brep->geometry_pointer());
+}
+
+template <typename P>
+IfcGeom::BRepElement<P>* IfcGeom::Kernel::create_brep_for_processed_representation(
+    const IteratorSettings& settings, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product,
+    const boost::shared_ptr<IfcGeom::Representation::BRep>& geometry)
 {
 	int parent_id = -1;
 	try {
@@ -1423,13 +1548,16 @@ IfcGeom::BRepElement<P>* IfcGeom::Kernel::create_brep_for_processed_representati
 	const std::string name = product->hasName() ? product->Name() : "";
 	const std::string guid = product->GlobalId();
 		
+	// With world coords enabled, the placement is already applied to the geometry
 	gp_Trsf trsf;
-	try {
-		convert(product->ObjectPlacement(),trsf);
-	} catch (const std::exception& e) {
-		Logger::Error(e);
-	} catch (...) {
-		Logger::Error("Failed to construct placement");
+	if (!settings.get(IteratorSettings::USE_WORLD_COORDS)) {
+		try {
+			convert(product->ObjectPlacement(),trsf);
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+		} catch (...) {
+			Logger::Error("Failed to construct placement");
+		}
 	}
 
 	std::string context_string = "";
@@ -1449,7 +1577,7 @@ IfcGeom::BRepElement<P>* IfcGeom::Kernel::create_brep_for_processed_representati
 		guid,
 		context_string,
 		trsf,
-		brep->geometry_pointer(),
+		geometry,
         product
 	);
 }
@@ -1550,6 +1678,11 @@ template IFC_GEOM_API IfcGeom::BRepElement<float>* IfcGeom::Kernel::create_brep_
 template IFC_GEOM_API IfcGeom::BRepElement<double>* IfcGeom::Kernel::create_brep_for_processed_representation<double>(
     const IteratorSettings& settings, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product, IfcGeom::BRepElement<double>* brep);
 
+template IFC_GEOM_API IfcGeom::BRepElement<float>* IfcGeom::Kernel::create_brep_for_processed_representation<float>(
+    const IteratorSettings& settings, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product, const boost::shared_ptr<IfcGeom::Representation::BRep>& geometry);
+template IFC_GEOM_API IfcGeom::BRepElement<double>* IfcGeom::Kernel::create_brep_for_processed_representation<double>(
+    const IteratorSettings& settings, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product, const boost::shared_ptr<IfcGeom::Representation::BRep>& geometry);
+
 std::pair<std::string, double> IfcGeom::Kernel::initializeUnits(IfcSchema::IfcUnitAssignment* unit_assignment) {
 	// Set default units, set length to meters, angles to undefined
 	setValue(IfcGeom::Kernel::GV_LENGTH_UNIT, 1.0);
@@ -2401,6 +2534,39 @@ IfcSchema::IfcRepresentation* IfcGeom::Kernel::find_representation(const IfcSche
 	return 0;
 }
 
+bool IfcGeom::Kernel::find_box_representation(const IfcSchema::IfcProduct* product, Bnd_Box& b) {
+	if (!product->hasObjectPlacement()) return false;
+	IfcSchema::IfcRepresentation* representation = find_representation(product, "Box");
+	if (!representation) return false;
+	IfcSchema::IfcRepresentationItem::list::ptr items = representation->Items();
+	if (items->size() != 1 || !(*items->begin())->is(IfcSchema::Type::IfcBoundingBox)) {
+		return false;
+	}
+	IfcSchema::IfcBoundingBox* box = (IfcSchema::IfcBoundingBox*)*items->begin();
+
+	gp_Trsf trsf;
+	gp_Pnt corner;
+	try {
+		if (!convert(product->ObjectPlacement(), trsf) || !convert(box->Corner(), corner)) {
+			return false;
+		}
+	} catch (const std::exception& e) {
+		Logger::Error(e);
+		return false;
+	}
+
+	const double unit = getValue(GV_LENGTH_UNIT);
+	const double dims[3] = { box->XDim() * unit, box->YDim() * unit, box->ZDim() * unit };
+	for (int i = 0; i < 8; ++i) {
+		gp_Pnt p(
+			corner.X() + ((i & 1) ? dims[0] : 0.),
+			corner.Y() + ((i & 2) ? dims[1] : 0.),
+			corner.Z() + ((i & 4) ? dims[2] : 0.));
+		b.Add(p.Transformed(trsf));
+	}
+	return true;
+}
+
 bool IfcGeom::Kernel::split_solid_by_surface(const TopoDS_Shape& input, const Handle_Geom_Surface& surface, TopoDS_Shape& front, TopoDS_Shape& back) {
 	// Use an unbounded surface, that isolate part of the input shape,
 	// to split this shape into two parts. Make sure that the addition
@@ -3020,6 +3186,9 @@ bool IfcGeom::Kernel::boolean_operation(const TopoDS_Shape& a, const TopTools_Li
 	return true;
 }
 bool IfcGeom::Kernel::boolean_operation(const TopoDS_Shape& a, const TopoDS_Shape& b, BOPAlgo_Operation op, TopoDS_Shape& result) {
+	if (!consume_boolean_attempt()) {
+		return false;
+	}
 	bool succesful = true;
 	BRepAlgoAPI_BooleanOperation* builder;
 	if (op == BOPAlgo_CUT) {
@@ -3095,6 +3264,9 @@ namespace {
 }
 
 bool IfcGeom::Kernel::boolean_operation(const TopoDS_Shape& a, const TopTools_ListOfShape& b, BOPAlgo_Operation op, TopoDS_Shape& result, double fuzziness) {
+	if (!consume_boolean_attempt()) {
+		return false;
+	}
 	bool success = false;
 	BRepAlgoAPI_BooleanOperation* builder;
 	if (op == BOPAlgo_CUT) {
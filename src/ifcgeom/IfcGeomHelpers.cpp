@@ -362,19 +362,25 @@ void IfcGeom::Kernel::set_conversion_placement_rel_to(IfcSchema::Type::Enum type
 }
 
 bool IfcGeom::Kernel::convert(const IfcSchema::IfcObjectPlacement* l, gp_Trsf& trsf) {
-	IN_CACHE(IfcObjectPlacement,l,gp_Trsf,trsf)
 	if ( ! l->is(IfcSchema::Type::IfcLocalPlacement) ) {
 		Logger::Message(Logger::LOG_ERROR, "Unsupported IfcObjectPlacement:", l->entity);
 		return false; 		
 	}
+	// Placements are memoized separately from the cache, so that placements of
+	// spatial structure elements shared by many products are resolved only once.
+	if ( !placement_memo || !placement_memo->is_compatible(placement_rel_to, ifc_length_unit) ) {
+		placement_memo.reset(new PlacementMemo(placement_rel_to, ifc_length_unit));
+	}
+	// Walk up the chain of PlacementRelTo references until a placement is
+	// found that has been resolved earlier.
+	std::vector<IfcSchema::IfcLocalPlacement*> chain;
+	gp_Trsf resolved;
 	IfcSchema::IfcLocalPlacement* current = (IfcSchema::IfcLocalPlacement*)l;
 	for (;;) {
-		gp_Trsf trsf2;
-		IfcSchema::IfcAxis2Placement* relplacement = current->RelativePlacement();
-		if ( relplacement->is(IfcSchema::Type::IfcAxis2Placement3D) ) {
-			IfcGeom::Kernel::convert((IfcSchema::IfcAxis2Placement3D*)relplacement,trsf2);
-			trsf.PreMultiply(trsf2);
+		if ( placement_memo->find(current->entity->id(), resolved) ) {
+			break;
 		}
+		chain.push_back(current);
 		if ( current->hasPlacementRelTo() ) {
 			IfcSchema::IfcObjectPlacement* parent = current->PlacementRelTo();
 			IfcSchema::IfcProduct::list::ptr parentPlaces = parent->PlacesObject();
@@ -390,6 +396,16 @@ bool IfcGeom::Kernel::convert(const IfcSchema::IfcObjectPlacement* l, gp_Trsf& t
 			else break;
 		} else break;
 	}
-	CACHE(IfcObjectPlacement,l,trsf)
+	// Resolve the remaining placements top-down, memoizing every one of them
+	for ( std::vector<IfcSchema::IfcLocalPlacement*>::reverse_iterator it = chain.rbegin(); it != chain.rend(); ++it ) {
+		IfcSchema::IfcAxis2Placement* relplacement = (*it)->RelativePlacement();
+		if ( relplacement->is(IfcSchema::Type::IfcAxis2Placement3D) ) {
+			gp_Trsf trsf2;
+			IfcGeom::Kernel::convert((IfcSchema::IfcAxis2Placement3D*)relplacement,trsf2);
+			resolved.Multiply(trsf2);
+		}
+		placement_memo->insert((*it)->entity->id(), resolved);
+	}
+	trsf.PreMultiply(resolved);
 	return true;
 }
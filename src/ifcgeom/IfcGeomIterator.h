@@ -62,6 +62,8 @@
 #include <set>
 #include <vector>
 #include <limits>
+#include <sstream>
+#include <iomanip>
 #include <algorithm>
 
 #include <boost/algorithm/string.hpp>
@@ -72,6 +74,7 @@
 #include <gp_GTrsf2d.hxx>
 #include <gp_Trsf.hxx>
 #include <gp_Trsf2d.hxx>
+#include <Bnd_Box.hxx>
 
 #include "../ifcparse/IfcFile.h"
 
@@ -81,6 +84,8 @@
 #include "../ifcgeom/IfcGeomIteratorSettings.h"
 #include "../ifcgeom/IfcRepresentationShapeItem.h"
 #include "../ifcgeom/IfcGeomFilter.h"
+#include "../ifcgeom/IfcGeomStructuralHash.h"
+#include "../ifcgeom/IfcGeomDiskCache.h"
 
 // The infamous min & max Win32 #defines can leak here from OCE depending on the build configuration
 #ifdef min
@@ -119,6 +124,38 @@ namespace IfcGeom {
 
         IfcSchema::IfcRepresentation::list::ptr ok_mapped_representations;
 
+		// Geometry shared between structurally identical representations, see
+		// IteratorSettings::DEDUPLICATE_REPRESENTATIONS. Geometries are grouped by
+		// the hash of the representation and the single material associated to
+		// the products. A group is released as soon as all of its representations
+		// have been processed.
+		struct deduplicated_geometry {
+			IfcSchema::IfcRepresentation* representation;
+			boost::shared_ptr<Representation::BRep> brep;
+			boost::shared_ptr< Representation::Triangulation<P> > triangulation;
+			typename TriangulationElement<P>::lod_list lods;
+		};
+		struct deduplication_group {
+			int remaining;
+			std::map<const IfcSchema::IfcMaterial*, deduplicated_geometry> geometries;
+			deduplication_group() : remaining(0) {}
+		};
+		StructuralHash structural_hash_;
+		std::map<unsigned int, StructuralHash::value_type> representation_hashes_;
+		std::map<StructuralHash::value_type, deduplication_group> deduplication_groups_;
+		deduplicated_geometry* current_deduplicated_geometry_;
+
+		// Persistent cache of converted representations, see IteratorSettings::cache_directory().
+		// Cache keys are based on a structural hash that compares surface styles by value, as
+		// instance ids are not stable across revisions of a model.
+		boost::shared_ptr<DiskCache> disk_cache_;
+		StructuralHash content_hash_;
+		// Seeded differently, for the digests that rule out collisions of disk cache keys
+		StructuralHash content_digest_;
+		std::string pending_disk_cache_key_;
+		StructuralHash::value_type pending_disk_cache_digest_;
+		boost::shared_ptr< Representation::Triangulation<P> > cached_triangulation_;
+
 		int done;
 		int total;
 
@@ -130,6 +167,14 @@ namespace IfcGeom {
 
         std::vector<filter_t> filters_;
 
+		// The selection of products to iterate over, see include_products() and
+		// include_box(). When restricted_ is false all products are considered.
+		IfcSchema::IfcProduct::list::ptr targeted_products_;
+		std::set<IfcSchema::IfcProduct*> targeted_product_set_;
+		bool targeted_box_;
+		gp_XYZ targeted_box_min_, targeted_box_max_;
+		bool restricted_;
+
         struct filter_match
         {
             filter_match(IfcSchema::IfcProduct *prod) : product(prod) {}
@@ -234,10 +279,17 @@ namespace IfcGeom {
 				}
 			}
 
+			restricted_ = targeted_products_ || targeted_box_;
+			std::set<IfcSchema::IfcRepresentationContext*> restricted_contexts;
+
 			for (it = filtered_contexts->begin(); it != filtered_contexts->end(); ++it) {
 				IfcSchema::IfcGeometricRepresentationContext* context = *it;
 
-				representations->push(context->RepresentationsInContext());
+				if (restricted_) {
+					restricted_contexts.insert(context);
+				} else {
+					representations->push(context->RepresentationsInContext());
+				}
 				try {
 					if (context->hasPrecision() && context->Precision() < lowest_precision_encountered) {
 						lowest_precision_encountered = context->Precision();
@@ -249,12 +301,23 @@ namespace IfcGeom {
 
 				IfcSchema::IfcGeometricRepresentationSubContext::list::ptr sub_contexts = context->HasSubContexts();
 				for (jt = sub_contexts->begin(); jt != sub_contexts->end(); ++jt) {
-					representations->push((*jt)->RepresentationsInContext());
+					if (restricted_) {
+						restricted_contexts.insert(*jt);
+					} else {
+						representations->push((*jt)->RepresentationsInContext());
+					}
 				}
 				// There is no need for full recursion as the following is governed by the schema:
 				// WR31: The parent context shall not be another geometric representation sub context. 
 			}
 
+			if (restricted_) {
+				// Rather than walking all representations in the file, only the ones
+				// referenced by the selected products are resolved.
+				resolve_targeted_products_();
+				collect_targeted_representations_(restricted_contexts);
+			}
+
 			if (any_precision_encountered) {
 				// Some arbitrary factor that has proven to work better for the models in the set of test files.
 				lowest_precision_encountered *= 10.;
@@ -275,6 +338,10 @@ namespace IfcGeom {
                 return false;
             }
 
+			if (settings.get(IteratorSettings::DEDUPLICATE_REPRESENTATIONS)) {
+				hash_representations_();
+			}
+
 			representation_iterator = representations->begin();
 			ifcproducts.reset();
 
@@ -290,27 +357,12 @@ namespace IfcGeom {
                 bounds_max_.SetCoord(i, -std::numeric_limits<double>::infinity());
             }
 
-            IfcSchema::IfcProduct::list::ptr products = ifc_file->entitiesByType<IfcSchema::IfcProduct>();
+            IfcSchema::IfcProduct::list::ptr products = restricted_
+				? targeted_products_
+				: ifc_file->entitiesByType<IfcSchema::IfcProduct>();
             for (IfcSchema::IfcProduct::list::it iter = products->begin(); iter != products->end(); ++iter) {
-                IfcSchema::IfcProduct* product = *iter;
-                if (product->hasObjectPlacement()) {
-					// Use a fresh trsf every time in order to prevent the result to be concatenated
-                    gp_Trsf trsf; 
-					bool success = false;
-					
-					try {
-						success = kernel.convert(product->ObjectPlacement(), trsf);
-					} catch (const std::exception& e) {
-						Logger::Error(e);
-					} catch (...) {
-						Logger::Error("Failed to construct placement");
-					}
-					
-					if (!success) {
-						continue;
-					}
-
-                    const gp_XYZ& pos = trsf.TranslationPart();
+                gp_XYZ pos;
+                if (placement_origin_(*iter, pos)) {
                     bounds_min_.SetX(std::min(bounds_min_.X(), pos.X()));
                     bounds_min_.SetY(std::min(bounds_min_.Y(), pos.Y()));
                     bounds_min_.SetZ(std::min(bounds_min_.Z(), pos.Z()));
@@ -340,15 +392,437 @@ namespace IfcGeom {
         const gp_XYZ& bounds_min() const { return bounds_min_; }
         const gp_XYZ& bounds_max() const { return bounds_max_; }
 
+		/// Restricts the iteration to the given products. Only the representations of
+		/// these products, and the representations they map to, are processed and
+		/// the bounds are computed for these products only. Needs to be called before
+		/// initialize(), successive calls extend the selection.
+		void include_products(const IfcSchema::IfcProduct::list::ptr& products) {
+			if (!targeted_products_) {
+				targeted_products_ = IfcSchema::IfcProduct::list::ptr(new IfcSchema::IfcProduct::list);
+			}
+			for (IfcSchema::IfcProduct::list::it it = products->begin(); it != products->end(); ++it) {
+				if (targeted_product_set_.insert(*it).second) {
+					targeted_products_->push(*it);
+				}
+			}
+		}
+
+		/// Shares the placements resolved by the kernel with the iterators over other copies
+		/// of the same file, see PlacementMemo. Needs to be called before initialize().
+		void set_placement_memo(const boost::shared_ptr<PlacementMemo>& memo) {
+			kernel.set_placement_memo(memo);
+		}
+
+		/// Selects products by GlobalId, see include_products(). Unknown GlobalIds are logged.
+		void include_guids(const std::vector<std::string>& guids) {
+			IfcSchema::IfcProduct::list::ptr products(new IfcSchema::IfcProduct::list);
+			for (std::vector<std::string>::const_iterator it = guids.begin(); it != guids.end(); ++it) {
+				try {
+					IfcSchema::IfcRoot* root = ifc_file->entityByGuid(*it);
+					if (root->is(IfcSchema::Type::IfcProduct)) {
+						products->push(static_cast<IfcSchema::IfcProduct*>(root));
+					} else {
+						Logger::Message(Logger::LOG_WARNING, "Instance with GlobalId '" + *it + "' is not a product:", root->entity);
+					}
+				} catch (const std::exception& e) {
+					Logger::Error(e);
+				}
+			}
+			include_products(products);
+		}
+
+		/// Selects products by entity type, including subtypes, see include_products().
+		void include_types(const std::vector<std::string>& types) {
+			IfcSchema::IfcProduct::list::ptr products(new IfcSchema::IfcProduct::list);
+			for (std::vector<std::string>::const_iterator it = types.begin(); it != types.end(); ++it) {
+				try {
+					IfcEntityList::ptr instances = ifc_file->entitiesByType(*it);
+					if (instances) {
+						products->push(instances->as<IfcSchema::IfcProduct>());
+					}
+				} catch (const std::exception& e) {
+					Logger::Error(e);
+				}
+			}
+			include_products(products);
+		}
+
+		/// Restricts the iteration to products that overlap with the box, in the coordinates
+		/// of bounds_min() and bounds_max(). As no geometry is converted at this point, the
+		/// extents of a product are taken from its 'Box' representation. Products without
+		/// one are selected when their placement origin lies within the box. Combined with
+		/// include_products() only the selected products are tested, otherwise all of them.
+		/// Needs to be called before initialize().
+		void include_box(const gp_XYZ& min, const gp_XYZ& max) {
+			targeted_box_ = true;
+			targeted_box_min_ = min;
+			targeted_box_max_ = max;
+		}
+
 	private:
+		bool placement_origin_(IfcSchema::IfcProduct* product, gp_XYZ& origin) {
+			if (!product->hasObjectPlacement()) {
+				return false;
+			}
+
+			// Use a fresh trsf every time in order to prevent the result to be concatenated
+			gp_Trsf trsf;
+			bool success = false;
+
+			try {
+				success = kernel.convert(product->ObjectPlacement(), trsf);
+			} catch (const std::exception& e) {
+				Logger::Error(e);
+			} catch (...) {
+				Logger::Error("Failed to construct placement");
+			}
+
+			if (success) {
+				origin = trsf.TranslationPart();
+			}
+			return success;
+		}
+
+		// Narrows the product selection down to the products within the box, if any
+		void resolve_targeted_products_() {
+			IfcSchema::IfcProduct::list::ptr candidates = targeted_products_
+				? targeted_products_
+				: ifc_file->entitiesByType<IfcSchema::IfcProduct>();
+
+			if (targeted_box_) {
+				Bnd_Box clip;
+				clip.Update(
+					targeted_box_min_.X(), targeted_box_min_.Y(), targeted_box_min_.Z(),
+					targeted_box_max_.X(), targeted_box_max_.Y(), targeted_box_max_.Z());
+
+				IfcSchema::IfcProduct::list::ptr products(new IfcSchema::IfcProduct::list);
+				for (IfcSchema::IfcProduct::list::it it = candidates->begin(); it != candidates->end(); ++it) {
+					Bnd_Box extents;
+					gp_XYZ pos;
+					bool inside;
+					if (kernel.find_box_representation(*it, extents)) {
+						inside = !clip.IsOut(extents);
+					} else {
+						inside = placement_origin_(*it, pos) && !clip.IsOut(gp_Pnt(pos));
+					}
+					if (inside) {
+						products->push(*it);
+					}
+				}
+				candidates = products;
+			}
+
+			targeted_products_ = candidates;
+			targeted_product_set_.clear();
+			targeted_product_set_.insert(candidates->begin(), candidates->end());
+		}
+
+		// Collects the representations of the selected products in the given contexts. The
+		// representations mapped to by means of IfcMappedItems are included as well, as these
+		// are processed instead when the geometry can be reused among their products.
+		void collect_targeted_representations_(const std::set<IfcSchema::IfcRepresentationContext*>& contexts) {
+			std::set<IfcSchema::IfcRepresentation*> collected;
+			for (IfcSchema::IfcProduct::list::it it = targeted_products_->begin(); it != targeted_products_->end(); ++it) {
+				IfcSchema::IfcProduct* product = *it;
+				if (!product->hasRepresentation()) {
+					continue;
+				}
+				IfcSchema::IfcRepresentation::list::ptr product_representations = product->Representation()->Representations();
+				for (IfcSchema::IfcRepresentation::list::it jt = product_representations->begin(); jt != product_representations->end(); ++jt) {
+					IfcSchema::IfcRepresentation* candidates[2] = { *jt, kernel.representation_mapped_to(*jt) };
+					for (int i = 0; i < 2; ++i) {
+						IfcSchema::IfcRepresentation* representation = candidates[i];
+						if (representation && contexts.find(representation->ContextOfItems()) != contexts.end() &&
+							collected.insert(representation).second)
+						{
+							representations->push(representation);
+						}
+					}
+				}
+			}
+		}
+
+		void hash_representations_() {
+			representation_hashes_.clear();
+			deduplication_groups_.clear();
+			for (IfcSchema::IfcRepresentation::list::it it = representations->begin(); it != representations->end(); ++it) {
+				try {
+					const StructuralHash::value_type h = structural_hash_(*it);
+					representation_hashes_[(*it)->entity->id()] = h;
+					++ deduplication_groups_[h].remaining;
+				} catch (const std::exception& e) {
+					Logger::Error(e);
+				}
+			}
+			// Only representations that have a structurally identical counterpart need to be tracked
+			std::map<unsigned int, StructuralHash::value_type>::iterator it = representation_hashes_.begin();
+			while (it != representation_hashes_.end()) {
+				if (deduplication_groups_[it->second].remaining < 2) {
+					deduplication_groups_.erase(it->second);
+					representation_hashes_.erase(it++);
+				} else {
+					++it;
+				}
+			}
+		}
+
+		deduplicated_geometry* find_deduplicated_geometry_(IfcSchema::IfcRepresentation* representation, const IfcSchema::IfcMaterial* material) {
+			std::map<unsigned int, StructuralHash::value_type>::const_iterator it = representation_hashes_.find(representation->entity->id());
+			if (it == representation_hashes_.end()) {
+				return 0;
+			}
+			deduplication_group& group = deduplication_groups_[it->second];
+			typename std::map<const IfcSchema::IfcMaterial*, deduplicated_geometry>::iterator jt = group.geometries.find(material);
+			if (jt == group.geometries.end()) {
+				deduplicated_geometry& geometry = group.geometries[material];
+				geometry.representation = representation;
+				return &geometry;
+			}
+			// Rule out hash collisions before sharing any geometry
+			if (structural_hash_.equal(representation, jt->second.representation)) {
+				return &jt->second;
+			}
+			return 0;
+		}
+
+		static void hash_style_(StructuralHash::value_type& h, const SurfaceStyle* style) {
+			if (!style) {
+				StructuralHash::combine(h, 0);
+				return;
+			}
+			StructuralHash::combine(h, style->Id() ? 2 : 1);
+			StructuralHash::combine(h, StructuralHash::hash(style->original_name()));
+			const boost::optional<SurfaceStyle::ColorComponent>* colors[] = { &style->Diffuse(), &style->Specular() };
+			for (int i = 0; i < 2; ++i) {
+				StructuralHash::combine(h, !!*colors[i]);
+				if (*colors[i]) {
+					StructuralHash::combine(h, StructuralHash::hash((*colors[i])->R()));
+					StructuralHash::combine(h, StructuralHash::hash((*colors[i])->G()));
+					StructuralHash::combine(h, StructuralHash::hash((*colors[i])->B()));
+				}
+			}
+			const boost::optional<double>* values[] = { &style->Transparency(), &style->Specularity() };
+			for (int i = 0; i < 2; ++i) {
+				StructuralHash::combine(h, !!*values[i]);
+				if (*values[i]) {
+					StructuralHash::combine(h, StructuralHash::hash(**values[i]));
+				}
+			}
+		}
+
+		static void hash_trsf_(StructuralHash::value_type& h, const gp_Trsf& trsf) {
+			for (int i = 1; i <= 3; ++i) {
+				for (int j = 1; j <= 4; ++j) {
+					StructuralHash::combine(h, StructuralHash::hash(trsf.Value(i, j)));
+				}
+			}
+		}
+
+		bool triangulation_required_() const {
+			return !settings.get(IteratorSettings::USE_BREP_DATA) && !settings.get(IteratorSettings::DISABLE_TRIANGULATION);
+		}
+
+		// Composes a key that captures everything the geometry created by
+		// create_brep_for_representation_and_product() and its triangulation
+		// depend on. Returns an empty string for products that are not cached.
+		// The digest is computed from the same inputs, but independently of the
+		// key, so that entries with colliding keys are not mistaken for a match.
+		std::string disk_cache_key_(IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product, StructuralHash::value_type& digest) {
+			// The layer set based slicing depends on too much context to capture reliably
+			if (settings.get(IteratorSettings::APPLY_LAYERSETS)) {
+				return "";
+			}
+
+			const StructuralHash::value_type h = disk_cache_hash_(content_hash_, DiskCache::FORMAT_VERSION, representation, product);
+			digest = disk_cache_hash_(content_digest_, DISK_CACHE_DIGEST_SEED ^ DiskCache::FORMAT_VERSION, representation, product);
+
+			std::stringstream ss;
+			ss << std::hex << std::setw(16) << std::setfill('0') << h;
+			return ss.str();
+		}
+
+		static const StructuralHash::value_type DISK_CACHE_DIGEST_SEED = 0x9ae16a3b2f90404fULL;
+
+		// Combines the inputs of the key into h, with the representations hashed by contents
+		StructuralHash::value_type disk_cache_hash_(StructuralHash& contents, StructuralHash::value_type h,
+			IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product)
+		{
+			StructuralHash::combine(h, contents(representation));
+			StructuralHash::combine(h, StructuralHash::hash(IfcSchema::Type::ToString(product->type())));
+
+			const IfcSchema::IfcMaterial* single_material = kernel.get_single_material_association(product);
+			hash_style_(h, single_material ? kernel.get_style(single_material) : 0);
+
+			gp_Trsf trsf;
+			if (product->hasObjectPlacement()) {
+				kernel.convert(product->ObjectPlacement(), trsf);
+			}
+
+			if (!settings.get(IteratorSettings::DISABLE_OPENING_SUBTRACTIONS)) {
+				IfcSchema::IfcRelVoidsElement::list::ptr openings = kernel.find_openings(product);
+				for (IfcSchema::IfcRelVoidsElement::list::it it = openings->begin(); it != openings->end(); ++it) {
+					IfcSchema::IfcFeatureElementSubtraction* opening = (*it)->RelatedOpeningElement();
+					StructuralHash::combine(h, static_cast<StructuralHash::value_type>(opening->type()));
+					if (!opening->is(IfcSchema::Type::IfcOpeningElement) || !opening->hasRepresentation()) {
+						continue;
+					}
+					// Openings are subtracted in the coordinate system of the product
+					gp_Trsf opening_trsf;
+					if (opening->hasObjectPlacement()) {
+						kernel.convert(opening->ObjectPlacement(), opening_trsf);
+					}
+					opening_trsf.PreMultiply(trsf.Inverted());
+					hash_trsf_(h, opening_trsf);
+					IfcSchema::IfcRepresentation::list::ptr opening_representations = opening->Representation()->Representations();
+					for (IfcSchema::IfcRepresentation::list::it jt = opening_representations->begin(); jt != opening_representations->end(); ++jt) {
+						StructuralHash::combine(h, contents(*jt));
+					}
+				}
+			}
+
+			if (settings.get(IteratorSettings::USE_WORLD_COORDS)) {
+				hash_trsf_(h, trsf);
+			}
+
+			for (int i = 0; i <= IteratorSettings::NUM_SETTINGS; ++i) {
+				StructuralHash::combine(h, settings.get(1 << i));
+			}
+			StructuralHash::combine(h, StructuralHash::hash(settings.deflection_tolerance()));
+			StructuralHash::combine(h, StructuralHash::hash(settings.relative_deflection()));
+			StructuralHash::combine(h, StructuralHash::hash(settings.min_deflection()));
+			StructuralHash::combine(h, StructuralHash::hash(settings.max_deflection()));
+			StructuralHash::combine(h, StructuralHash::hash(settings.angular_deflection()));
+			StructuralHash::combine(h, StructuralHash::hash(settings.simplification_ratio()));
+			StructuralHash::combine(h, StructuralHash::hash(settings.simplification_error()));
+
+			const Kernel::GeomValue values[] = {
+				Kernel::GV_DEFLECTION_TOLERANCE, Kernel::GV_WIRE_CREATION_TOLERANCE, Kernel::GV_MINIMAL_FACE_AREA,
+				Kernel::GV_POINT_EQUALITY_TOLERANCE, Kernel::GV_MAX_FACES_TO_SEW, Kernel::GV_LENGTH_UNIT,
+				Kernel::GV_PLANEANGLE_UNIT, Kernel::GV_PRECISION, Kernel::GV_DIMENSIONALITY
+			};
+			for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+				StructuralHash::combine(h, StructuralHash::hash(kernel.getValue(values[i])));
+			}
+			StructuralHash::combine(h, sizeof(P));
+			return h;
+		}
+
+		// The styles a cached entry can refer to: those of the representation items,
+		// the style of the associated material and the default style for the type.
+		std::vector<const SurfaceStyle*> disk_cache_styles_(IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product) {
+			std::vector<const SurfaceStyle*> styles;
+			IfcEntityList::ptr instances = ifc_file->traverse(representation);
+			for (IfcEntityList::it it = instances->begin(); it != instances->end(); ++it) {
+				const IfcSchema::IfcRepresentationItem* item = (*it)->as<IfcSchema::IfcRepresentationItem>();
+				if (item) {
+					styles.push_back(kernel.get_style(item));
+				}
+			}
+			const IfcSchema::IfcMaterial* single_material = kernel.get_single_material_association(product);
+			if (single_material) {
+				styles.push_back(kernel.get_style(single_material));
+			}
+			styles.push_back(get_default_style(IfcSchema::Type::ToString(product->type())));
+			return styles;
+		}
+
+		// Mirrors the representation id composed by create_brep_for_representation_and_product()
+		std::string disk_cache_representation_id_(IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product, const DiskCache::Entry& entry) {
+			std::stringstream ss;
+			ss << representation->entity->id();
+			if (entry.material_style_applied) {
+				const IfcSchema::IfcMaterial* single_material = kernel.get_single_material_association(product);
+				if (single_material) {
+					ss << "-material-" << single_material->entity->id();
+				}
+			}
+			if (!settings.get(IteratorSettings::DISABLE_OPENING_SUBTRACTIONS)) {
+				IfcSchema::IfcRelVoidsElement::list::ptr openings = kernel.find_openings(product);
+				if (openings && openings->size()) {
+					ss << "-openings";
+					for (IfcSchema::IfcRelVoidsElement::list::it it = openings->begin(); it != openings->end(); ++it) {
+						ss << "-" << (*it)->entity->id();
+					}
+				}
+			}
+			if (settings.get(IteratorSettings::USE_WORLD_COORDS)) {
+				ss << "-world-coords";
+			}
+			return ss.str();
+		}
+
+		// Attempts to construct the element from the disk cache. When the entry is
+		// missing or unusable, the key is retained so that the entry is written
+		// once the geometry has been created.
+		BRepElement<P>* read_disk_cache_(IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product) {
+			std::string key;
+			StructuralHash::value_type digest = 0;
+			try {
+				key = disk_cache_key_(representation, product, digest);
+			} catch (const std::exception& e) {
+				Logger::Error(e);
+			}
+			if (key.empty()) {
+				return 0;
+			}
+
+			DiskCache::Entry entry;
+			std::vector<const SurfaceStyle*> resolved_styles;
+			if (!disk_cache_->read(key, digest, entry) || !entry.resolve(disk_cache_styles_(representation, product), resolved_styles)) {
+				pending_disk_cache_key_ = key;
+				pending_disk_cache_digest_ = digest;
+				return 0;
+			}
+
+			// No boolean operations are performed for cached geometry
+			kernel.reset_boolean_budget();
+
+			const std::string product_type = IfcSchema::Type::ToString(product->type());
+			ElementSettings element_settings(settings, kernel.getValue(Kernel::GV_LENGTH_UNIT), product_type);
+			const std::string id = disk_cache_representation_id_(representation, product, entry);
+
+			BRepElement<P>* element = kernel.create_brep_for_processed_representation<P>(settings, representation, product,
+				entry.brep(element_settings, id, resolved_styles));
+
+			if (entry.has_triangulation) {
+				cached_triangulation_ = entry.triangulation<P>(element_settings, id, resolved_styles);
+			} else if (triangulation_required_()) {
+				// Complete the entry with the triangulation
+				pending_disk_cache_key_ = key;
+				pending_disk_cache_digest_ = digest;
+			}
+
+			return element;
+		}
+
+		void write_disk_cache_(const BRepElement<P>* shape_model, const TriangulationElement<P>* triangulation) {
+			// Results of exhausted boolean budgets are not retained, a later run might succeed
+			if (kernel.is_boolean_budget_exceeded()) {
+				return;
+			}
+			const Representation::Triangulation<P>* triangulation_geometry = triangulation ? &triangulation->geometry() : 0;
+			DiskCache::Entry entry;
+			entry.store(shape_model->geometry(), triangulation_geometry);
+			entry.material_style_applied = shape_model->geometry().id().find("-material-") != std::string::npos;
+			try {
+				disk_cache_->write(pending_disk_cache_key_, pending_disk_cache_digest_, entry);
+			} catch (const std::exception& e) {
+				Logger::Error(e);
+			}
+		}
+
 		// Move to the next IfcRepresentation
 		void _nextShape() {
-			// In order to conserve memory and reduce cache insertion times, the cache is
-			// cleared after an arbitary number of processed representations. This has been
-			// benchmarked extensively: https://github.com/IfcOpenShell/IfcOpenShell/pull/47
-			static const int clear_interval = 64;
-			if (done % clear_interval == clear_interval - 1) {
-				kernel.purge_cache();
+			// Memory usage of the kernel cache is bounded by IteratorSettings::cache_memory_limit()
+			current_deduplicated_geometry_ = 0;
+			if (representation_iterator != representations->end()) {
+				std::map<unsigned int, StructuralHash::value_type>::iterator it = representation_hashes_.find((*representation_iterator)->entity->id());
+				if (it != representation_hashes_.end()) {
+					if (-- deduplication_groups_[it->second].remaining == 0) {
+						deduplication_groups_.erase(it->second);
+					}
+					representation_hashes_.erase(it);
+				}
 			}
 			ifcproducts.reset();
 			++ representation_iterator;
@@ -446,12 +920,20 @@ namespace IfcGeom {
                     // Filter the products based on the set of entities and/or names being included or excluded for processing.
                     for (IfcSchema::IfcProduct::list::it jt = unfiltered_products->begin(); jt != unfiltered_products->end(); ++jt) {
                         IfcSchema::IfcProduct* prod = *jt;
-                        if (boost::all(filters_, filter_match(prod))) {
+                        if (boost::all(filters_, filter_match(prod)) &&
+							(!restricted_ || targeted_product_set_.find(prod) != targeted_product_set_.end()))
+						{
                             ifcproducts->push(prod);
                         }
                     }
 
 					ifcproduct_iterator = ifcproducts->begin();
+
+					current_deduplicated_geometry_ = 0;
+					if (geometry_reuse_ok_for_current_representation_ && !representation_hashes_.empty()) {
+						current_deduplicated_geometry_ = find_deduplicated_geometry_(representation,
+							kernel.get_single_material_association(*unfiltered_products->begin()));
+					}
 				}
 
 				// Have we reached the end of our list of IfcProducts?
@@ -464,8 +946,16 @@ namespace IfcGeom {
                 Logger::SetProduct(product);
 
 				BRepElement<P>* element;
-				if (ifcproduct_iterator == ifcproducts->begin() || !geometry_reuse_ok_for_current_representation_) {
-					element = kernel.create_brep_for_representation_and_product<P>(settings, representation, product);
+				if (current_deduplicated_geometry_ && current_deduplicated_geometry_->brep && ifcproduct_iterator == ifcproducts->begin()) {
+					element = kernel.create_brep_for_processed_representation<P>(settings, representation, product, current_deduplicated_geometry_->brep);
+				} else if (ifcproduct_iterator == ifcproducts->begin() || !geometry_reuse_ok_for_current_representation_) {
+					element = disk_cache_ ? read_disk_cache_(representation, product) : 0;
+					if (!element) {
+						element = kernel.create_brep_for_representation_and_product<P>(settings, representation, product);
+					}
+					if (element && current_deduplicated_geometry_) {
+						current_deduplicated_geometry_->brep = element->geometry_pointer();
+					}
 				} else {
 					element = kernel.create_brep_for_processed_representation(settings, representation, product, current_shape_model);
 				}
@@ -644,6 +1134,9 @@ namespace IfcGeom {
 			IfcGeom::SerializedElement<P>* next_serialization = 0;
 			IfcGeom::TriangulationElement<P>* next_triangulation = 0;
 
+			pending_disk_cache_key_.clear();
+			cached_triangulation_.reset();
+
 			try {
 				next_shape_model = create_shape_model_for_next_entity();
 			} catch (const std::exception& e) {
@@ -667,15 +1160,30 @@ namespace IfcGeom {
 					}
 				} else if (!settings.get(IteratorSettings::DISABLE_TRIANGULATION)) {
 					try {
-						if (ifcproduct_iterator == ifcproducts->begin() || !geometry_reuse_ok_for_current_representation_) {
-							next_triangulation = new TriangulationElement<P>(*next_shape_model);
+						if (current_deduplicated_geometry_ && current_deduplicated_geometry_->triangulation && ifcproduct_iterator == ifcproducts->begin()) {
+							next_triangulation = new TriangulationElement<P>(*next_shape_model, current_deduplicated_geometry_->triangulation, current_deduplicated_geometry_->lods);
+						} else if (ifcproduct_iterator == ifcproducts->begin() || !geometry_reuse_ok_for_current_representation_) {
+							if (cached_triangulation_) {
+								// Levels of detail are not cached, but the shapes they are triangulated from are
+								next_triangulation = new TriangulationElement<P>(*next_shape_model, cached_triangulation_,
+									TriangulationElement<P>::create_lods(next_shape_model->geometry()));
+							} else {
+								next_triangulation = new TriangulationElement<P>(*next_shape_model);
+							}
+							if (current_deduplicated_geometry_) {
+								current_deduplicated_geometry_->triangulation = next_triangulation->geometry_pointer();
+								current_deduplicated_geometry_->lods = next_triangulation->lods();
+							}
 						} else {
-							next_triangulation = new TriangulationElement<P>(*next_shape_model, current_triangulation->geometry_pointer());
+							next_triangulation = new TriangulationElement<P>(*next_shape_model, current_triangulation->geometry_pointer(), current_triangulation->lods());
 						}
 					} catch (...) {
                         Logger::Message(Logger::LOG_ERROR, "Getting a triangulation element from model failed.");
 					}
 				}
+				if (!pending_disk_cache_key_.empty() && (next_triangulation || !triangulation_required_())) {
+					write_disk_cache_(next_shape_model, next_triangulation);
+				}
 			}
 
 			free_shapes();
@@ -688,6 +1196,12 @@ namespace IfcGeom {
 		}
 	private:
 		void _initialize() {
+			current_deduplicated_geometry_ = 0;
+			targeted_box_ = false;
+			restricted_ = false;
+			content_hash_ = StructuralHash(false);
+			content_digest_ = StructuralHash(false, DISK_CACHE_DIGEST_SEED);
+			pending_disk_cache_digest_ = 0;
 			current_triangulation = 0;
 			current_shape_model = 0;
 			current_serialization = 0;
@@ -698,6 +1212,17 @@ namespace IfcGeom {
             kernel.setValue(IfcGeom::Kernel::GV_MAX_FACES_TO_SEW, settings.get(IteratorSettings::SEW_SHELLS) ? 1000 : -1);
             kernel.setValue(IfcGeom::Kernel::GV_DIMENSIONALITY, (settings.get(IteratorSettings::INCLUDE_CURVES)
                 ? (settings.get(IteratorSettings::EXCLUDE_SOLIDS_AND_SURFACES) ? -1. : 0.) : +1.));
+			kernel.setValue(IfcGeom::Kernel::GV_MAX_BOOLEAN_ATTEMPTS, settings.max_boolean_attempts());
+			kernel.setValue(IfcGeom::Kernel::GV_BOOLEAN_TIMEOUT, settings.boolean_timeout());
+			kernel.setValue(IfcGeom::Kernel::GV_CACHE_MEMORY_LIMIT, settings.cache_memory_limit());
+			if (!settings.cache_directory().empty()) {
+				try {
+					disk_cache_.reset(new DiskCache(settings.cache_directory(),
+						static_cast<boost::uintmax_t>(settings.cache_size_limit() * 1024. * 1024.)));
+				} catch (const std::exception& e) {
+					Logger::Error(e);
+				}
+			}
 			if (settings.get(IteratorSettings::BUILDING_LOCAL_PLACEMENT)) {
 				if (settings.get(IteratorSettings::SITE_LOCAL_PLACEMENT)) {
 					Logger::Message(Logger::LOG_WARNING, "building-local-placement takes precedence over site-local-placement");
@@ -20,6 +20,8 @@
 #ifndef IFCGEOMITERATORSETTINGS_H
 #define IFCGEOMITERATORSETTINGS_H
 
+#include <vector>
+
 #include "ifc_geom_api.h"
 #include "../ifcparse/IfcException.h"
 #include "../ifcparse/IfcBaseClass.h"
@@ -84,8 +86,16 @@ namespace IfcGeom
 			SITE_LOCAL_PLACEMENT = 1 << 15,
 			///
 			BUILDING_LOCAL_PLACEMENT = 1 << 16,
+			/// Represents products for which the boolean budget (see max_boolean_attempts()
+			/// and boolean_timeout()) is exhausted by the bounding boxes of their shapes
+			/// rather than by the shapes without the opening subtractions.
+			BOOLEAN_BOUNDING_BOX_FALLBACK = 1 << 17,
+			/// Shares the geometry of representations that are structurally identical,
+			/// i.e. of which the instance graphs only differ in instance names, between
+			/// the products that use them. Products then only differ in placement.
+			DEDUPLICATE_REPRESENTATIONS = 1 << 18,
 			/// Number of different setting flags.
-			NUM_SETTINGS = 16
+			NUM_SETTINGS = 18
         };
         /// Used to store logical OR combination of setting flags.
         typedef unsigned SettingField;
@@ -93,6 +103,16 @@ namespace IfcGeom
         IteratorSettings()
             : settings_(WELD_VERTICES) // OR options that default to true here
             , deflection_tolerance_(1.e-3)
+            , relative_deflection_(0.)
+            , min_deflection_(1.e-4)
+            , max_deflection_(1.e-1)
+            , angular_deflection_(0.5)
+            , simplification_ratio_(1.)
+            , simplification_error_(-1.)
+            , max_boolean_attempts_(-1)
+            , boolean_timeout_(-1.)
+            , cache_size_limit_(1024.)
+            , cache_memory_limit_(512.)
         {
         }
 
@@ -110,6 +130,90 @@ namespace IfcGeom
             }
         }
 
+        /// The deflection tolerance relative to the diagonal of the bounding box of a shape.
+        /// When positive, it takes precedence over deflection_tolerance(), so that small
+        /// parts are meshed finely and large curved elements coarsely. Zero by default.
+        double relative_deflection() const { return relative_deflection_; }
+        void set_relative_deflection(double value) { relative_deflection_ = value; }
+
+        /// The bounds within which the deflection derived from relative_deflection() is clamped.
+        double min_deflection() const { return min_deflection_; }
+        double max_deflection() const { return max_deflection_; }
+        void set_deflection_bounds(double min_value, double max_value)
+        {
+            min_deflection_ = min_value;
+            max_deflection_ = max_value;
+            if (min_deflection_ <= 1e-6) {
+                Logger::Message(Logger::LOG_WARNING, "Minimal deflection tolerance cannot be set to <= 1e-6; using the default value 1e-4");
+                min_deflection_ = 1e-4;
+            }
+            if (max_deflection_ < min_deflection_) {
+                Logger::Message(Logger::LOG_WARNING, "Maximal deflection tolerance is smaller than the minimal deflection tolerance; using the latter");
+                max_deflection_ = min_deflection_;
+            }
+        }
+
+        /// The deflection tolerance for a shape of which the bounding box has the given diagonal
+        double deflection_tolerance(double diagonal) const
+        {
+            if (relative_deflection_ <= 0. || diagonal <= 0.) {
+                return deflection_tolerance_;
+            }
+            const double value = relative_deflection_ * diagonal;
+            return value < min_deflection_ ? min_deflection_ : (value > max_deflection_ ? max_deflection_ : value);
+        }
+
+        /// The angular deflection in radians of the mesher, i.e. the maximal angle between
+        /// the normals of adjacent mesh elements on a curved surface. 0.5 by default.
+        double angular_deflection() const { return angular_deflection_; }
+        void set_angular_deflection(double value) { angular_deflection_ = value; }
+
+        /// The deflection tolerances of additional levels of detail, typically coarser, that are
+        /// triangulated from the same shapes, see TriangulationElement::lods(). When
+        /// relative_deflection() is enabled these are relative values as well. Empty by default.
+        const std::vector<double>& lod_deflections() const { return lod_deflections_; }
+        void set_lod_deflections(const std::vector<double>& values) { lod_deflections_ = values; }
+
+        /// The fraction of triangles to retain when simplifying triangulations by edge
+        /// collapses, see MeshSimplifier. One by default, i.e. no reduction by count.
+        double simplification_ratio() const { return simplification_ratio_; }
+        void set_simplification_ratio(double value) { simplification_ratio_ = value; }
+
+        /// The maximal geometric error in meters introduced when simplifying triangulations.
+        /// Non-positive values, the default, denote no bound.
+        double simplification_error() const { return simplification_error_; }
+        void set_simplification_error(double value) { simplification_error_ = value; }
+
+        /// Triangulations are simplified when a ratio below one or a positive error is set
+        bool simplify_triangulations() const { return simplification_ratio_ < 1. || simplification_error_ > 0.; }
+
+        /// The maximum number of boolean operations, including retries with an increased
+        /// fuzziness, performed for a single product. Negative values denote no limit.
+        int max_boolean_attempts() const { return max_boolean_attempts_; }
+        void set_max_boolean_attempts(int value) { max_boolean_attempts_ = value; }
+
+        /// The maximum time in seconds spent on boolean operations for a single product.
+        /// Negative values denote no limit. Note that an operation in progress is not
+        /// interrupted, the budget is checked before every subsequent operation.
+        double boolean_timeout() const { return boolean_timeout_; }
+        void set_boolean_timeout(double value) { boolean_timeout_ = value; }
+
+        /// Directory in which converted representations are cached between runs. An
+        /// empty string, the default, disables the cache.
+        const std::string& cache_directory() const { return cache_directory_; }
+        void set_cache_directory(const std::string& value) { cache_directory_ = value; }
+
+        /// The maximum size in megabytes of the cache directory, when exceeded the least
+        /// recently used entries are removed.
+        double cache_size_limit() const { return cache_size_limit_; }
+        void set_cache_size_limit(double value) { cache_size_limit_ = value; }
+
+        /// The memory budget in megabytes for the conversion results, such as placements and
+        /// profiles, that the kernel retains to be reused by subsequent products. When exceeded
+        /// the least recently used results are evicted. Negative values denote no limit.
+        double cache_memory_limit() const { return cache_memory_limit_; }
+        void set_cache_memory_limit(double value) { cache_memory_limit_ = value; }
+
         /// Get boolean value for a single settings or for a combination of settings.
         bool get(SettingField setting) const
         {
@@ -131,6 +235,15 @@ namespace IfcGeom
     protected:
         SettingField settings_;
         double deflection_tolerance_;
+        double relative_deflection_, min_deflection_, max_deflection_;
+        double angular_deflection_;
+        std::vector<double> lod_deflections_;
+        double simplification_ratio_, simplification_error_;
+        int max_boolean_attempts_;
+        double boolean_timeout_;
+        std::string cache_directory_;
+        double cache_size_limit_;
+        double cache_memory_limit_;
     };
 
     class IFC_GEOM_API ElementSettings : public IteratorSettings
@@ -32,4 +32,5 @@ double IfcGeom::Material::transparency() const { if (hasTransparency()) return *
 double IfcGeom::Material::specularity() const { if (hasSpecularity()) return *style->Specularity(); else return 0; }
 const std::string &IfcGeom::Material::name() const { return style->Name(); }
 const std::string &IfcGeom::Material::original_name() const { return style->original_name(); }
+const IfcGeom::SurfaceStyle* IfcGeom::Material::surface_style() const { return style; }
 bool IfcGeom::Material::operator==(const IfcGeom::Material& other) const { return style == other.style; }
@@ -43,6 +43,7 @@ namespace IfcGeom {
 		double specularity() const;
 		const std::string &name() const;
 		const std::string &original_name() const;
+		const IfcGeom::SurfaceStyle* surface_style() const;
 		bool operator==(const Material& other) const;
 	};
 
@@ -0,0 +1,169 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#include "../ifcgeom/IfcGeomMeshBuffer.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+	const size_t ALIGNMENT = 16;
+
+	size_t align(size_t offset) {
+		return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	}
+
+	double clamp(double v) {
+		return v < -1. ? -1. : (v > 1. ? 1. : v);
+	}
+
+	double sign(double v) {
+		return v < 0. ? -1. : 1.;
+	}
+
+	// Signed normalized integer with the given maximal magnitude
+	long snorm(double v, double max) {
+		const double s = clamp(v) * max;
+		return static_cast<long>(s < 0. ? s - 0.5 : s + 0.5);
+	}
+}
+
+IfcGeom::MeshBuffer::~MeshBuffer() {
+	delete[] raw_;
+}
+
+size_t IfcGeom::MeshBuffer::normal_size(NormalEncoding encoding) {
+	switch (encoding) {
+	case NORMALS_FLOAT32:
+		return 3 * sizeof(float);
+	case NORMALS_OCTAHEDRAL16:
+		return 2 * sizeof(boost::int16_t);
+	case NORMALS_PACKED_10_10_10:
+		return sizeof(boost::uint32_t);
+	default:
+		return 0;
+	}
+}
+
+void IfcGeom::MeshBuffer::encode_normal(double x, double y, double z, NormalEncoding encoding, unsigned char* out) {
+	if (encoding == NORMALS_FLOAT32) {
+		const float xyz[3] = { static_cast<float>(x), static_cast<float>(y), static_cast<float>(z) };
+		std::memcpy(out, xyz, sizeof(xyz));
+	} else if (encoding == NORMALS_OCTAHEDRAL16) {
+		// Project onto the octahedron |x| + |y| + |z| = 1 and fold the lower half outwards
+		const double l1 = std::fabs(x) + std::fabs(y) + std::fabs(z);
+		double u = 0., v = 0.;
+		if (l1 > 0.) {
+			u = x / l1;
+			v = y / l1;
+			if (z < 0.) {
+				const double fu = (1. - std::fabs(v)) * sign(u);
+				const double fv = (1. - std::fabs(u)) * sign(v);
+				u = fu;
+				v = fv;
+			}
+		}
+		const boost::int16_t uv[2] = { static_cast<boost::int16_t>(snorm(u, 32767.)), static_cast<boost::int16_t>(snorm(v, 32767.)) };
+		std::memcpy(out, uv, sizeof(uv));
+	} else if (encoding == NORMALS_PACKED_10_10_10) {
+		const boost::uint32_t packed =
+			(static_cast<boost::uint32_t>(snorm(x, 511.)) & 0x3ff) |
+			((static_cast<boost::uint32_t>(snorm(y, 511.)) & 0x3ff) << 10) |
+			((static_cast<boost::uint32_t>(snorm(z, 511.)) & 0x3ff) << 20);
+		std::memcpy(out, &packed, sizeof(packed));
+	}
+}
+
+void IfcGeom::MeshBuffer::decode_normal(const unsigned char* in, NormalEncoding encoding, float* xyz) {
+	if (encoding == NORMALS_FLOAT32) {
+		std::memcpy(xyz, in, 3 * sizeof(float));
+	} else if (encoding == NORMALS_OCTAHEDRAL16) {
+		boost::int16_t uv[2];
+		std::memcpy(uv, in, sizeof(uv));
+		double u = (std::max)(uv[0] / 32767., -1.), v = (std::max)(uv[1] / 32767., -1.);
+		const double z = 1. - std::fabs(u) - std::fabs(v);
+		if (z < 0.) {
+			const double fu = (1. - std::fabs(v)) * sign(u);
+			const double fv = (1. - std::fabs(u)) * sign(v);
+			u = fu;
+			v = fv;
+		}
+		const double length = std::sqrt(u * u + v * v + z * z);
+		if (length > 0.) {
+			xyz[0] = static_cast<float>(u / length);
+			xyz[1] = static_cast<float>(v / length);
+			xyz[2] = static_cast<float>(z / length);
+		} else {
+			xyz[0] = xyz[1] = xyz[2] = 0.f;
+		}
+	} else if (encoding == NORMALS_PACKED_10_10_10) {
+		boost::uint32_t packed;
+		std::memcpy(&packed, in, sizeof(packed));
+		for (int i = 0; i < 3; ++i) {
+			int c = static_cast<int>((packed >> (10 * i)) & 0x3ff);
+			// Sign extend the 10 bit component
+			if (c & 0x200) c -= 0x400;
+			xyz[i] = static_cast<float>((std::max)(c / 511., -1.));
+		}
+	} else {
+		xyz[0] = xyz[1] = xyz[2] = 0.f;
+	}
+}
+
+void IfcGeom::MeshBuffer::allocate(size_t num_vertices, NormalEncoding normal_encoding, IndexEncoding index_encoding, bool has_uvs,
+	size_t num_face_indices, size_t num_edge_indices, size_t num_material_ids)
+{
+	num_vertices_ = num_vertices;
+	num_face_indices_ = num_face_indices;
+	num_edge_indices_ = num_edge_indices;
+	num_material_ids_ = num_material_ids;
+	normal_encoding_ = normal_encoding;
+	has_uvs_ = has_uvs;
+	index_size_ = index_encoding == INDICES_NARROWEST && num_vertices <= 0xffff ? sizeof(boost::uint16_t) : sizeof(boost::uint32_t);
+
+	positions_offset_ = 0;
+	normals_offset_ = align(positions_offset_ + 3 * sizeof(float) * num_vertices);
+	uvs_offset_ = align(normals_offset_ + normal_size(normal_encoding) * num_vertices);
+	faces_offset_ = align(uvs_offset_ + (has_uvs ? 2 * sizeof(float) * num_vertices : 0));
+	edges_offset_ = align(faces_offset_ + index_size_ * num_face_indices);
+	material_ids_offset_ = align(edges_offset_ + index_size_ * num_edge_indices);
+	size_ = material_ids_offset_ + sizeof(boost::int32_t) * num_material_ids;
+
+	raw_ = new unsigned char[size_ + ALIGNMENT];
+	data_ = raw_ + (ALIGNMENT - reinterpret_cast<size_t>(raw_) % ALIGNMENT) % ALIGNMENT;
+	// Padding is zeroed so that the block can be written out as is
+	std::memset(data_, 0, size_);
+}
+
+void IfcGeom::MeshBuffer::write_index(size_t offset, size_t i, int index) {
+	if (index_size_ == sizeof(boost::uint16_t)) {
+		reinterpret_cast<boost::uint16_t*>(data_ + offset)[i] = static_cast<boost::uint16_t>(index);
+	} else {
+		reinterpret_cast<boost::uint32_t*>(data_ + offset)[i] = static_cast<boost::uint32_t>(index);
+	}
+}
+
+boost::uint32_t IfcGeom::MeshBuffer::read_index(size_t offset, size_t i) const {
+	if (index_size_ == sizeof(boost::uint16_t)) {
+		return reinterpret_cast<const boost::uint16_t*>(data_ + offset)[i];
+	} else {
+		return reinterpret_cast<const boost::uint32_t*>(data_ + offset)[i];
+	}
+}
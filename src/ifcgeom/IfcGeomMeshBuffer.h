@@ -0,0 +1,185 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+/********************************************************************************
+ *                                                                              *
+ * A compact representation of a triangulation for consumers that upload or    *
+ * transmit meshes, e.g. viewers. All arrays are stored in a single block of    *
+ * memory, each aligned to 16 bytes, so that they can be passed on without      *
+ * copying. Positions are single precision, normals are optionally quantized    *
+ * and indices are 16 bit wide when the number of vertices allows. See          *
+ * Triangulation::buffer() for obtaining one that is shared with the mesh.      *
+ *                                                                              *
+ ********************************************************************************/
+
+#ifndef IFCGEOMMESHBUFFER_H
+#define IFCGEOMMESHBUFFER_H
+
+#include <vector>
+#include <cstddef>
+
+#include <boost/cstdint.hpp>
+
+#include "../ifcgeom/ifc_geom_api.h"
+
+namespace IfcGeom {
+
+	namespace Representation {
+		template <typename P> class Triangulation;
+	}
+
+	class IFC_GEOM_API MeshBuffer {
+	public:
+		enum NormalEncoding {
+			/// No normals are stored
+			NORMALS_NONE,
+			/// Three 32 bit floats per normal
+			NORMALS_FLOAT32,
+			/// Two 16 bit signed normalized integers per normal, octahedron mapped
+			NORMALS_OCTAHEDRAL16,
+			/// A single 32 bit integer per normal, with 10 bit signed normalized
+			/// components x, y, z from the least significant bit onwards
+			NORMALS_PACKED_10_10_10
+		};
+
+		enum IndexEncoding {
+			/// 16 bit indices when all vertices can be addressed by them, 32 bit otherwise
+			INDICES_NARROWEST,
+			/// Always 32 bit indices, for consumers that do not handle 16 bit indices
+			INDICES_UINT32
+		};
+
+		template <typename P>
+		MeshBuffer(const Representation::Triangulation<P>& mesh, NormalEncoding normal_encoding = NORMALS_FLOAT32, IndexEncoding index_encoding = INDICES_NARROWEST)
+			: raw_(0)
+		{
+			assign(mesh.verts(), mesh.normals(), mesh.uvs(), mesh.faces(), mesh.edges(), mesh.material_ids(), normal_encoding, index_encoding);
+		}
+
+		/// Normals and uvs are omitted when they do not match the number of vertices
+		template <typename P>
+		MeshBuffer(const std::vector<P>& verts, const std::vector<P>& normals, const std::vector<P>& uvs,
+			const std::vector<int>& faces, const std::vector<int>& edges, const std::vector<int>& material_ids,
+			NormalEncoding normal_encoding = NORMALS_FLOAT32, IndexEncoding index_encoding = INDICES_NARROWEST)
+			: raw_(0)
+		{
+			assign(verts, normals, uvs, faces, edges, material_ids, normal_encoding, index_encoding);
+		}
+
+		~MeshBuffer();
+
+		size_t num_vertices() const { return num_vertices_; }
+		size_t num_triangles() const { return num_face_indices_ / 3; }
+		size_t num_edges() const { return num_edge_indices_ / 2; }
+
+		NormalEncoding normal_encoding() const { return normal_encoding_; }
+		/// Either 2 or 4 bytes, 2 when all vertices can be addressed by 16 bit indices
+		/// and INDICES_NARROWEST is used
+		size_t index_size() const { return index_size_; }
+
+		/// Three per vertex
+		const float* positions() const { return reinterpret_cast<const float*>(data_ + positions_offset_); }
+		/// Laid out according to normal_encoding(), 0 if there are none
+		const void* normals() const { return normal_encoding_ == NORMALS_NONE ? 0 : data_ + normals_offset_; }
+		/// Two per vertex, 0 if there are none
+		const float* uvs() const { return has_uvs_ ? reinterpret_cast<const float*>(data_ + uvs_offset_) : 0; }
+		/// Three indices of index_size() bytes per triangle
+		const void* faces() const { return data_ + faces_offset_; }
+		/// Two indices of index_size() bytes per edge
+		const void* edges() const { return data_ + edges_offset_; }
+		/// One per triangle, followed by one per vertex of loose edges, see Triangulation
+		const boost::int32_t* material_ids() const { return reinterpret_cast<const boost::int32_t*>(data_ + material_ids_offset_); }
+		size_t num_material_ids() const { return num_material_ids_; }
+
+		/// The i-th index of faces() and edges() respectively, regardless of index_size()
+		boost::uint32_t face_index(size_t i) const { return read_index(faces_offset_, i); }
+		boost::uint32_t edge_index(size_t i) const { return read_index(edges_offset_, i); }
+
+		/// The block of memory that contains all of the above
+		const unsigned char* data() const { return data_; }
+		size_t size() const { return size_; }
+
+		/// Size in bytes of a single encoded normal
+		static size_t normal_size(NormalEncoding encoding);
+		static void encode_normal(double x, double y, double z, NormalEncoding encoding, unsigned char* out);
+		static void decode_normal(const unsigned char* in, NormalEncoding encoding, float* xyz);
+
+	private:
+		MeshBuffer(const MeshBuffer&); // N/I
+		MeshBuffer& operator=(const MeshBuffer&); // N/I
+
+		void allocate(size_t num_vertices, NormalEncoding normal_encoding, IndexEncoding index_encoding, bool has_uvs,
+			size_t num_face_indices, size_t num_edge_indices, size_t num_material_ids);
+		void write_index(size_t offset, size_t i, int index);
+		boost::uint32_t read_index(size_t offset, size_t i) const;
+
+		template <typename P>
+		void assign(const std::vector<P>& verts, const std::vector<P>& normals, const std::vector<P>& uvs,
+			const std::vector<int>& faces, const std::vector<int>& edges, const std::vector<int>& material_ids,
+			NormalEncoding normal_encoding, IndexEncoding index_encoding)
+		{
+			const size_t num_vertices = verts.size() / 3;
+			if (normals.size() != verts.size()) {
+				normal_encoding = NORMALS_NONE;
+			}
+			const bool has_uvs = uvs.size() == 2 * num_vertices && num_vertices > 0;
+			allocate(num_vertices, normal_encoding, index_encoding, has_uvs, faces.size(), edges.size(), material_ids.size());
+
+			float* positions = reinterpret_cast<float*>(data_ + positions_offset_);
+			for (size_t i = 0; i < 3 * num_vertices; ++i) {
+				positions[i] = static_cast<float>(verts[i]);
+			}
+			if (normal_encoding_ != NORMALS_NONE) {
+				const size_t n = normal_size(normal_encoding_);
+				for (size_t i = 0; i < num_vertices; ++i) {
+					encode_normal(normals[3 * i], normals[3 * i + 1], normals[3 * i + 2], normal_encoding_, data_ + normals_offset_ + i * n);
+				}
+			}
+			if (has_uvs_) {
+				float* us = reinterpret_cast<float*>(data_ + uvs_offset_);
+				for (size_t i = 0; i < 2 * num_vertices; ++i) {
+					us[i] = static_cast<float>(uvs[i]);
+				}
+			}
+			for (size_t i = 0; i < faces.size(); ++i) {
+				write_index(faces_offset_, i, faces[i]);
+			}
+			for (size_t i = 0; i < edges.size(); ++i) {
+				write_index(edges_offset_, i, edges[i]);
+			}
+			boost::int32_t* ids = reinterpret_cast<boost::int32_t*>(data_ + material_ids_offset_);
+			for (size_t i = 0; i < material_ids.size(); ++i) {
+				ids[i] = static_cast<boost::int32_t>(material_ids[i]);
+			}
+		}
+
+		unsigned char* raw_;
+		unsigned char* data_;
+		size_t size_;
+
+		size_t num_vertices_, num_face_indices_, num_edge_indices_, num_material_ids_;
+		NormalEncoding normal_encoding_;
+		bool has_uvs_;
+		size_t index_size_;
+		size_t positions_offset_, normals_offset_, uvs_offset_, faces_offset_, edges_offset_, material_ids_offset_;
+	};
+
+}
+
+#endif
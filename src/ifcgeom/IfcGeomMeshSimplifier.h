@@ -0,0 +1,409 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+/********************************************************************************
+ *                                                                              *
+ * Simplification of triangle meshes by edge collapses ordered by the quadric   *
+ * error metric (Garland and Heckbert, 1997). A vertex is always collapsed onto *
+ * one of its neighbours, so that no new vertices are introduced and normals    *
+ * and texture coordinates remain valid. Vertices on boundary edges, on         *
+ * non-manifold edges and on the boundaries between materials are retained.     *
+ * Candidates of equal cost are ordered by vertex index, hence the result is    *
+ * deterministic. Connectivity is derived from vertex indices, so meshes with   *
+ * welded vertices simplify best; otherwise only face interiors are reduced.    *
+ *                                                                              *
+ ********************************************************************************/
+
+#ifndef IFCGEOMMESHSIMPLIFIER_H
+#define IFCGEOMMESHSIMPLIFIER_H
+
+#include <set>
+#include <cmath>
+#include <queue>
+#include <vector>
+#include <iterator>
+#include <utility>
+#include <algorithm>
+
+namespace IfcGeom {
+
+	template <typename P>
+	class MeshSimplifier {
+	private:
+		// A symmetric 4x4 matrix that sums the squared distances to a set of planes
+		struct quadric {
+			double aa, ab, ac, ad, bb, bc, bd, cc, cd, dd;
+
+			quadric() : aa(0), ab(0), ac(0), ad(0), bb(0), bc(0), bd(0), cc(0), cd(0), dd(0) {}
+			quadric(double a, double b, double c, double d)
+				: aa(a*a), ab(a*b), ac(a*c), ad(a*d), bb(b*b), bc(b*c), bd(b*d), cc(c*c), cd(c*d), dd(d*d)
+			{}
+
+			quadric& operator+=(const quadric& q) {
+				aa += q.aa; ab += q.ab; ac += q.ac; ad += q.ad; bb += q.bb;
+				bc += q.bc; bd += q.bd; cc += q.cc; cd += q.cd; dd += q.dd;
+				return *this;
+			}
+
+			double error(double x, double y, double z) const {
+				return aa*x*x + 2*ab*x*y + 2*ac*x*z + 2*ad*x + bb*y*y
+					+ 2*bc*y*z + 2*bd*y + cc*z*z + 2*cd*z + dd;
+			}
+		};
+
+		struct candidate {
+			double cost;
+			int from, to;
+			unsigned int from_stamp, to_stamp;
+
+			// Inverted, so that the priority queue yields the cheapest collapse first
+			bool operator<(const candidate& other) const {
+				if (cost != other.cost) return cost > other.cost;
+				if (from != other.from) return from > other.from;
+				return to > other.to;
+			}
+		};
+
+		std::vector<P>& verts_;
+		std::vector<int>& faces_;
+		std::vector<int>& edges_;
+		std::vector<P>& normals_;
+		std::vector<P>& uvs_;
+		std::vector<int>& material_ids_;
+
+		std::vector<quadric> quadrics_;
+		std::vector< std::vector<int> > vertex_triangles_;
+		std::vector<char> locked_, triangle_alive_;
+		std::vector<int> collapsed_to_;
+		std::vector<unsigned int> stamps_;
+		std::priority_queue<candidate> queue_;
+
+		void position(int v, double& x, double& y, double& z) const {
+			x = verts_[3 * v + 0];
+			y = verts_[3 * v + 1];
+			z = verts_[3 * v + 2];
+		}
+
+		// Unnormalized normal of the triangle, optionally with one vertex displaced
+		void triangle_normal(int t, int moved, int target, double* n) const {
+			double p[3][3];
+			for (int i = 0; i < 3; ++i) {
+				int v = faces_[3 * t + i];
+				if (v == moved) v = target;
+				position(v, p[i][0], p[i][1], p[i][2]);
+			}
+			const double e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+			const double e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+			n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+			n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+			n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+		}
+
+		// Returns the alive triangles incident to a vertex, after removing those that are no longer
+		const std::vector<int>& triangles_of(int v) {
+			std::vector<int>& ts = vertex_triangles_[v];
+			size_t n = 0;
+			for (size_t i = 0; i < ts.size(); ++i) {
+				if (triangle_alive_[ts[i]]) {
+					ts[n++] = ts[i];
+				}
+			}
+			ts.resize(n);
+			return ts;
+		}
+
+		void neighbours_of(int v, std::vector<int>& ns) {
+			ns.clear();
+			const std::vector<int>& ts = triangles_of(v);
+			for (std::vector<int>::const_iterator it = ts.begin(); it != ts.end(); ++it) {
+				for (int i = 0; i < 3; ++i) {
+					const int w = faces_[3 * *it + i];
+					if (w != v) ns.push_back(w);
+				}
+			}
+			std::sort(ns.begin(), ns.end());
+			ns.erase(std::unique(ns.begin(), ns.end()), ns.end());
+		}
+
+		void push(int from, int to) {
+			if (locked_[from]) return;
+			quadric q = quadrics_[from];
+			q += quadrics_[to];
+			double x, y, z;
+			position(to, x, y, z);
+			candidate c;
+			// Rounding can make the sum of squared distances slightly negative
+			c.cost = (std::max)(q.error(x, y, z), 0.);
+			c.from = from;
+			c.to = to;
+			c.from_stamp = stamps_[from];
+			c.to_stamp = stamps_[to];
+			queue_.push(c);
+		}
+
+		bool is_valid(int u, int v) {
+			std::vector<int> shared;
+			const std::vector<int>& ts = triangles_of(u);
+			for (std::vector<int>::const_iterator it = ts.begin(); it != ts.end(); ++it) {
+				const int* t = &faces_[3 * *it];
+				if (t[0] == v || t[1] == v || t[2] == v) {
+					shared.push_back(*it);
+				}
+			}
+			// u is not on a boundary nor on a non-manifold edge, as it would have been locked
+			if (shared.size() != 2) {
+				return false;
+			}
+
+			// Link condition: the only common neighbours are the opposite vertices of the shared triangles
+			std::vector<int> nu, nv, common;
+			neighbours_of(u, nu);
+			neighbours_of(v, nv);
+			std::set_intersection(nu.begin(), nu.end(), nv.begin(), nv.end(), std::back_inserter(common));
+			if (common.size() != 2) {
+				return false;
+			}
+
+			// The remaining triangles of u should not degenerate nor flip
+			const std::vector<int>& remaining = triangles_of(u);
+			for (std::vector<int>::const_iterator it = remaining.begin(); it != remaining.end(); ++it) {
+				if (*it == shared[0] || *it == shared[1]) continue;
+				double before[3], after[3];
+				triangle_normal(*it, -1, -1, before);
+				triangle_normal(*it, u, v, after);
+				const double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+				const double area = std::sqrt(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+				if (dot <= 0. || area <= 0.) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		void collapse(int u, int v) {
+			const std::vector<int> ts = triangles_of(u);
+			for (std::vector<int>::const_iterator it = ts.begin(); it != ts.end(); ++it) {
+				int* t = &faces_[3 * *it];
+				if (t[0] == v || t[1] == v || t[2] == v) {
+					triangle_alive_[*it] = 0;
+				} else {
+					for (int i = 0; i < 3; ++i) {
+						if (t[i] == u) t[i] = v;
+					}
+					vertex_triangles_[v].push_back(*it);
+				}
+			}
+			vertex_triangles_[u].clear();
+			quadrics_[v] += quadrics_[u];
+			collapsed_to_[u] = v;
+			++stamps_[u];
+			++stamps_[v];
+
+			std::vector<int> ns;
+			neighbours_of(v, ns);
+			for (std::vector<int>::const_iterator it = ns.begin(); it != ns.end(); ++it) {
+				push(v, *it);
+				push(*it, v);
+			}
+		}
+
+		int resolve(int v) const {
+			while (collapsed_to_[v] != -1) {
+				v = collapsed_to_[v];
+			}
+			return v;
+		}
+
+		MeshSimplifier(const MeshSimplifier&); // N/I
+		MeshSimplifier& operator=(const MeshSimplifier&); // N/I
+
+	public:
+		/// Normals and texture coordinates are optional and can be left empty.
+		/// The material ids should denote a material for every triangle.
+		MeshSimplifier(std::vector<P>& verts, std::vector<int>& faces, std::vector<int>& edges,
+			std::vector<P>& normals, std::vector<P>& uvs, std::vector<int>& material_ids)
+			: verts_(verts)
+			, faces_(faces)
+			, edges_(edges)
+			, normals_(normals)
+			, uvs_(uvs)
+			, material_ids_(material_ids)
+		{}
+
+		/// Collapses edges until at most ratio times the original number of triangles remain,
+		/// or until no collapse is possible of which the error is within max_error. The error
+		/// is the root of the summed squared distances to the planes of the original triangles
+		/// around a collapsed vertex. A ratio of one or more or a non-positive max_error
+		/// leave that criterion unbounded. Returns the number of removed triangles.
+		size_t simplify(double ratio, double max_error) {
+			const size_t num_verts = verts_.size() / 3;
+			const size_t num_triangles = faces_.size() / 3;
+			// Meshes with loose edges, of which the vertices have material ids, are not supported
+			if (num_triangles == 0 || material_ids_.size() != num_triangles) {
+				return 0;
+			}
+
+			const size_t target = ratio >= 1. ? 0 : static_cast<size_t>(std::ceil((std::max)(ratio, 0.) * num_triangles));
+			const double max_cost = max_error > 0. ? max_error * max_error : -1.;
+
+			quadrics_.assign(num_verts, quadric());
+			vertex_triangles_.assign(num_verts, std::vector<int>());
+			locked_.assign(num_verts, 0);
+			triangle_alive_.assign(num_triangles, 1);
+			collapsed_to_.assign(num_verts, -1);
+			stamps_.assign(num_verts, 0);
+
+			std::vector<int> material_of(num_verts, -1);
+			std::vector< std::pair< std::pair<int, int>, int > > half_edges;
+			half_edges.reserve(3 * num_triangles);
+
+			for (size_t t = 0; t < num_triangles; ++t) {
+				double n[3];
+				triangle_normal((int) t, -1, -1, n);
+				const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				double x, y, z;
+				position(faces_[3 * t], x, y, z);
+				const quadric q = length > 0.
+					? quadric(n[0] / length, n[1] / length, n[2] / length, -(n[0] * x + n[1] * y + n[2] * z) / length)
+					: quadric();
+
+				for (int i = 0; i < 3; ++i) {
+					const int v = faces_[3 * t + i];
+					const int w = faces_[3 * t + (i + 1) % 3];
+					quadrics_[v] += q;
+					vertex_triangles_[v].push_back((int) t);
+					if (material_of[v] == -1) {
+						material_of[v] = material_ids_[t];
+					} else if (material_of[v] != material_ids_[t]) {
+						locked_[v] = 1;
+					}
+					half_edges.push_back(std::make_pair(std::make_pair((std::min)(v, w), (std::max)(v, w)), (int) t));
+				}
+			}
+
+			// Edges used by a single or by more than two triangles are boundary or non-manifold edges
+			std::sort(half_edges.begin(), half_edges.end());
+			for (size_t i = 0; i < half_edges.size();) {
+				size_t j = i;
+				while (j < half_edges.size() && half_edges[j].first == half_edges[i].first) ++j;
+				if (j - i != 2) {
+					locked_[half_edges[i].first.first] = 1;
+					locked_[half_edges[i].first.second] = 1;
+				}
+				i = j;
+			}
+			std::vector< std::pair< std::pair<int, int>, int > >().swap(half_edges);
+
+			std::vector<int> ns;
+			for (size_t v = 0; v < num_verts; ++v) {
+				if (locked_[v]) continue;
+				neighbours_of((int) v, ns);
+				for (std::vector<int>::const_iterator it = ns.begin(); it != ns.end(); ++it) {
+					push((int) v, *it);
+				}
+			}
+
+			size_t alive = num_triangles;
+			while (alive > target && !queue_.empty()) {
+				const candidate c = queue_.top();
+				queue_.pop();
+				if (c.from_stamp != stamps_[c.from] || c.to_stamp != stamps_[c.to]) {
+					continue;
+				}
+				if (max_cost >= 0. && c.cost > max_cost) {
+					// No cheaper candidates remain
+					break;
+				}
+				if (!is_valid(c.from, c.to)) {
+					continue;
+				}
+				collapse(c.from, c.to);
+				alive -= 2;
+			}
+			std::priority_queue<candidate>().swap(queue_);
+
+			if (alive == num_triangles) {
+				return 0;
+			}
+
+			// Compact the triangles and edges
+			std::vector<int> faces, material_ids, edges;
+			faces.reserve(3 * alive);
+			material_ids.reserve(alive);
+			for (size_t t = 0; t < num_triangles; ++t) {
+				if (!triangle_alive_[t]) continue;
+				faces.insert(faces.end(), faces_.begin() + 3 * t, faces_.begin() + 3 * t + 3);
+				material_ids.push_back(material_ids_[t]);
+			}
+			std::set< std::pair<int, int> > seen;
+			for (size_t i = 0; i + 1 < edges_.size(); i += 2) {
+				const int a = resolve(edges_[i]), b = resolve(edges_[i + 1]);
+				if (a == b || !seen.insert(std::make_pair((std::min)(a, b), (std::max)(a, b))).second) {
+					continue;
+				}
+				edges.push_back(a);
+				edges.push_back(b);
+			}
+
+			// Remove the vertices that are no longer referenced
+			std::vector<int> new_index(num_verts, -1);
+			for (std::vector<int>::const_iterator it = faces.begin(); it != faces.end(); ++it) new_index[*it] = 0;
+			for (std::vector<int>::const_iterator it = edges.begin(); it != edges.end(); ++it) new_index[*it] = 0;
+			const bool has_normals = normals_.size() == verts_.size();
+			const bool has_uvs = uvs_.size() == 2 * num_verts;
+			int n = 0;
+			for (size_t v = 0; v < num_verts; ++v) {
+				if (new_index[v] == -1) continue;
+				new_index[v] = n;
+				for (int i = 0; i < 3; ++i) {
+					verts_[3 * n + i] = verts_[3 * v + i];
+					if (has_normals) normals_[3 * n + i] = normals_[3 * v + i];
+				}
+				if (has_uvs) {
+					uvs_[2 * n + 0] = uvs_[2 * v + 0];
+					uvs_[2 * n + 1] = uvs_[2 * v + 1];
+				}
+				++n;
+			}
+			verts_.resize(3 * n);
+			if (has_normals) normals_.resize(3 * n);
+			if (has_uvs) uvs_.resize(2 * n);
+			for (std::vector<int>::iterator it = faces.begin(); it != faces.end(); ++it) *it = new_index[*it];
+			for (std::vector<int>::iterator it = edges.begin(); it != edges.end(); ++it) *it = new_index[*it];
+
+			faces_.swap(faces);
+			material_ids_.swap(material_ids);
+			edges_.swap(edges);
+
+			// Release the working memory
+			std::vector<quadric>().swap(quadrics_);
+			std::vector< std::vector<int> >().swap(vertex_triangles_);
+			std::vector<char>().swap(locked_);
+			std::vector<char>().swap(triangle_alive_);
+			std::vector<int>().swap(collapsed_to_);
+			std::vector<unsigned int>().swap(stamps_);
+
+			return num_triangles - alive;
+		}
+	};
+
+}
+
+#endif
@@ -22,6 +22,17 @@
 #include <BRep_Builder.hxx>
 
 #include <TopoDS_Compound.hxx>
+#include <BRepGProp_Face.hxx>
+#include <BRepAdaptor_Surface.hxx>
+#include <GeomAbs_SurfaceType.hxx>
+#include <TShort_Array1OfShortReal.hxx>
+#include <Geom_SphericalSurface.hxx>
+#include <Poly_Triangulation.hxx>
+
+#include <boost/bind.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 #include "../ifcgeom/IfcGeom.h"
 
@@ -72,4 +83,211 @@ TopoDS_Compound IfcGeom::Representation::BRep::as_compound() const {
 		builder.Add(compound, moved_shape);
 	}
 	return compound;
-}
\ No newline at end of file
+}
+
+namespace {
+	boost::thread_specific_ptr<IfcGeom::Representation::TriangulationScratch> triangulation_scratch;
+}
+
+IfcGeom::Representation::TriangulationScratch& IfcGeom::Representation::TriangulationScratch::for_current_thread() {
+	TriangulationScratch* scratch = triangulation_scratch.get();
+	if (!scratch) {
+		scratch = new TriangulationScratch;
+		triangulation_scratch.reset(scratch);
+	}
+	return *scratch;
+}
+
+void IfcGeom::Representation::FaceTriangulation::extract(const TopoDS_Face& face, const gp_GTrsf& trsf, bool calculate_normals) {
+	nodes.clear();
+	normals.clear();
+	triangles.clear();
+
+	TopLoc_Location loc;
+	Handle_Poly_Triangulation tri = BRep_Tool::Triangulation(face, loc);
+	if (tri.IsNull()) {
+		return;
+	}
+
+	// A 3x3 matrix to rotate the vertex normals
+	const gp_Mat rotation_matrix = trsf.VectorialPart();
+
+	const TColgp_Array1OfPnt& mesh_nodes = tri->Nodes();
+	const TColgp_Array1OfPnt2d& uvs = tri->UVNodes();
+	BRepGProp_Face prop(face);
+
+	nodes.reserve(mesh_nodes.Length());
+
+	// Rather than evaluating the surface at every node, the normal of planar faces is
+	// computed once and normals that are stored in the triangulation are reused.
+	bool is_planar = false, has_triangulation_normals = false;
+	gp_XYZ planar_normal;
+	if (calculate_normals) {
+		normals.reserve(mesh_nodes.Length());
+
+		BRepAdaptor_Surface surface(face);
+		if (surface.GetType() == GeomAbs_Plane) {
+			// The orientation of the parametrization, the axis placement can be left-handed
+			const gp_Ax3& position = surface.Plane().Position();
+			gp_Dir direction = position.XDirection().Crossed(position.YDirection());
+			if (face.Orientation() == TopAbs_REVERSED) {
+				direction.Reverse();
+			}
+			planar_normal = gp_Dir(direction.XYZ() * rotation_matrix).XYZ();
+			is_planar = true;
+		} else {
+			has_triangulation_normals = tri->HasNormals() == Standard_True;
+		}
+	}
+
+	for (int i = 1; i <= mesh_nodes.Length(); ++i) {
+		gp_XYZ xyz = mesh_nodes(i).Transformed(loc).XYZ();
+		trsf.Transforms(xyz);
+		nodes.push_back(xyz);
+
+		if (is_planar) {
+			normals.push_back(planar_normal);
+		} else if (has_triangulation_normals) {
+			// Stored normals are those of the surface, in the coordinate system of the triangulation
+#if OCC_VERSION_HEX >= 0x70600
+			gp_Dir direction = tri->Normal(i);
+#else
+			const TShort_Array1OfShortReal& stored = tri->Normals();
+			gp_Dir direction(stored(3 * i - 2), stored(3 * i - 1), stored(3 * i));
+#endif
+			direction.Transform(loc.Transformation());
+			if (face.Orientation() == TopAbs_REVERSED) {
+				direction.Reverse();
+			}
+			normals.push_back(gp_Dir(direction.XYZ() * rotation_matrix).XYZ());
+		} else if (calculate_normals) {
+			const gp_Pnt2d& uv = uvs(i);
+			gp_Pnt p;
+			gp_Vec normal_direction;
+			prop.Normal(uv.X(), uv.Y(), p, normal_direction);
+			gp_Vec normal(0., 0., 0.);
+			if (normal_direction.Magnitude() > ALMOST_ZERO) {
+				normal = gp_Dir(normal_direction.XYZ() * rotation_matrix);
+			} else {
+				Handle_Geom_Surface surf = BRep_Tool::Surface(face);
+				// Special case the normal at the poles of a spherical surface
+				if (surf->DynamicType() == STANDARD_TYPE(Geom_SphericalSurface)) {
+					if (ALMOST_THE_SAME(fabs(uv.Y()), M_PI / 2.)) {
+						const bool is_top = uv.Y() > 0;
+						const bool is_forward = face.Orientation() == TopAbs_FORWARD;
+						const double z = (is_top == is_forward) ? 1. : -1.;
+						normal = gp_Dir(gp_XYZ(0, 0, z) * rotation_matrix);
+					}
+				}
+				// TODO: Do the same for conical surfaces, but they are rare in IFC.
+			}
+			normals.push_back(normal.XYZ());
+		}
+	}
+
+	const Poly_Array1OfTriangle& mesh_triangles = tri->Triangles();
+	triangles.reserve(3 * mesh_triangles.Length());
+
+	for (int i = 1; i <= mesh_triangles.Length(); ++i) {
+		int n1, n2, n3;
+		if (face.Orientation() == TopAbs_REVERSED) {
+			mesh_triangles(i).Get(n3, n2, n1);
+		} else {
+			mesh_triangles(i).Get(n1, n2, n3);
+		}
+
+		/* An alternative would be to calculate normals based
+		 * on the coordinates of the mesh vertices */
+		/*
+		const gp_XYZ pt1 = nodes[n1-1];
+		const gp_XYZ pt2 = nodes[n2-1];
+		const gp_XYZ pt3 = nodes[n3-1];
+		const gp_XYZ v1 = pt2-pt1;
+		const gp_XYZ v2 = pt3-pt2;
+		gp_Dir normal = gp_Dir(v1^v2);
+		*/
+
+		triangles.push_back(n1 - 1);
+		triangles.push_back(n2 - 1);
+		triangles.push_back(n3 - 1);
+	}
+}
+
+namespace {
+	// Hands out chunks of faces to the worker threads, so that
+	// faces with a dense mesh do not stall a single thread.
+	class face_chunks {
+	public:
+		static const size_t CHUNK_SIZE = 16;
+
+		face_chunks(size_t num_faces)
+			: next_(0)
+			, num_faces_(num_faces)
+			, failed_(false)
+		{}
+
+		bool next(size_t& begin, size_t& end) {
+			boost::mutex::scoped_lock lock(mutex_);
+			if (failed_ || next_ >= num_faces_) {
+				return false;
+			}
+			begin = next_;
+			end = next_ = (std::min)(next_ + CHUNK_SIZE, num_faces_);
+			return true;
+		}
+
+		void fail() {
+			boost::mutex::scoped_lock lock(mutex_);
+			failed_ = true;
+		}
+
+		bool failed() const { return failed_; }
+
+	private:
+		boost::mutex mutex_;
+		size_t next_, num_faces_;
+		bool failed_;
+	};
+
+	void extract_face_chunks(face_chunks* chunks, const std::vector<TopoDS_Face>* faces, const gp_GTrsf* trsf, bool calculate_normals, std::vector<IfcGeom::Representation::FaceTriangulation>* results) {
+		size_t begin, end;
+		// Exceptions can not be propagated from a worker thread
+		try {
+			while (chunks->next(begin, end)) {
+				for (size_t i = begin; i < end; ++i) {
+					(*results)[i].extract((*faces)[i], *trsf, calculate_normals);
+				}
+			}
+		} catch (...) {
+			chunks->fail();
+		}
+	}
+}
+
+bool IfcGeom::Representation::FaceTriangulation::extract(const std::vector<TopoDS_Face>& faces, const gp_GTrsf& trsf, bool calculate_normals, std::vector<FaceTriangulation>& results) {
+	results.resize(faces.size());
+
+#if OCC_VERSION_HEX >= 0x70000
+	const size_t num_chunks = (faces.size() + face_chunks::CHUNK_SIZE - 1) / face_chunks::CHUNK_SIZE;
+	const size_t num_threads = (std::min)(static_cast<size_t>((std::max)(boost::thread::hardware_concurrency(), 1U)), num_chunks);
+#else
+	// Surface evaluation, e.g. of the normals by BRepGProp_Face, is not thread-safe
+	// before Open CASCADE 7, so that the faces are extracted on the calling thread
+	const size_t num_threads = 1;
+#endif
+
+	face_chunks chunks(faces.size());
+	boost::thread_group threads;
+	try {
+		// The calling thread processes chunks as well
+		for (size_t i = 1; i < num_threads; ++i) {
+			threads.create_thread(boost::bind(&extract_face_chunks, &chunks, &faces, &trsf, calculate_normals, &results));
+		}
+	} catch (const boost::thread_resource_error&) {
+		// Continue with the threads that could be created
+	}
+	extract_face_chunks(&chunks, &faces, &trsf, calculate_normals, &results);
+	threads.join_all();
+
+	return !chunks.failed();
+}
@@ -20,6 +20,7 @@
 #ifndef IFCGEOMREPRESENTATION_H
 #define IFCGEOMREPRESENTATION_H
 
+#include <Standard_Version.hxx>
 #include <BRepMesh_IncrementalMesh.hxx>
 #include <BRepGProp_Face.hxx>
 
@@ -27,6 +28,9 @@
 #include <TColgp_Array1OfPnt.hxx>
 #include <TColgp_Array1OfPnt2d.hxx>
 
+#include <TopoDS_Face.hxx>
+#include <Bnd_Box.hxx>
+#include <BRepBndLib.hxx>
 #include <TopExp_Explorer.hxx>
 #include <BRepTools.hxx>
 
@@ -34,8 +38,14 @@
 #include <GCPnts_QuasiUniformDeflection.hxx>
 #include <Geom_SphericalSurface.hxx>
 
+#include <cstring>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
 #include "../ifcgeom/IfcGeomIteratorSettings.h"
 #include "../ifcgeom/IfcGeomMaterial.h"
+#include "../ifcgeom/IfcGeomMeshBuffer.h"
+#include "../ifcgeom/IfcGeomMeshSimplifier.h"
 #include "../ifcgeom/IfcRepresentationShapeItem.h"
 
 #include <TopoDS_Compound.hxx>
@@ -94,15 +104,203 @@ namespace IfcGeom {
 			Serialization& operator=(const Serialization&);
 		};
 
+		/// The mesh of a single face, with the nodes and normals transformed
+		/// by the placement of the shape item the face belongs to.
+		class IFC_GEOM_API FaceTriangulation {
+		public:
+			std::vector<gp_XYZ> nodes;
+			/// Only populated when normals are calculated, one for every node
+			std::vector<gp_XYZ> normals;
+			/// Node indices, three per triangle, in the winding order of the face
+			std::vector<int> triangles;
+
+			/// Left empty if no triangulation has been computed for the face
+			void extract(const TopoDS_Face& face, const gp_GTrsf& trsf, bool calculate_normals);
+
+			/// Extracts the meshes of the faces of a single shape using multiple threads,
+			/// or on the calling thread only before Open CASCADE 7. Returns false if any
+			/// of the faces failed, in which case the faces should be processed
+			/// sequentially to report the error.
+			static bool extract(const std::vector<TopoDS_Face>& faces, const gp_GTrsf& trsf, bool calculate_normals, std::vector<FaceTriangulation>& results);
+		};
+
+		/// Scratch space used by the Triangulation to process the faces of a shape.
+		/// The buffers are retained between faces and between the elements that
+		/// are processed by the same thread, so that no allocations are needed per
+		/// face once they are large enough.
+		class IFC_GEOM_API TriangulationScratch {
+		private:
+			// An open addressing hash table of edges keyed by their vertex indices.
+			// Slots are marked as empty by stamping them with an older generation,
+			// so that the table does not need to be cleared in between faces.
+			struct slot {
+				boost::uint64_t key;
+				unsigned int generation;
+				int count;
+				slot() : key(0), generation(0), count(0) {}
+			};
+			std::vector<slot> slots_;
+			std::vector<size_t> order_;
+			unsigned int generation_;
+
+			static boost::uint64_t key(int a, int b) {
+				return (static_cast<boost::uint64_t>(static_cast<boost::uint32_t>(a)) << 32) | static_cast<boost::uint32_t>(b);
+			}
+
+			static size_t hash(boost::uint64_t k) {
+				k = (k ^ (k >> 30)) * 0xbf58476d1ce4e5b9ULL;
+				k = (k ^ (k >> 27)) * 0x94d049bb133111ebULL;
+				return static_cast<size_t>(k ^ (k >> 31));
+			}
+
+			TriangulationScratch(const TriangulationScratch&); // N/I
+			TriangulationScratch& operator=(const TriangulationScratch&); // N/I
+
+		public:
+			/// The mesh of the face being processed
+			FaceTriangulation face;
+			/// Vertex indices by mesh node of the face being processed
+			std::vector<int> node_indices;
+
+			TriangulationScratch() : generation_(0) {}
+
+			/// Returns the scratch space of the calling thread
+			static TriangulationScratch& for_current_thread();
+
+			/// Prepares for counting the edges of a face with at most num_edges distinct edges
+			void begin_edges(size_t num_edges) {
+				size_t capacity = 16;
+				while (capacity < 2 * num_edges) {
+					capacity *= 2;
+				}
+				if (capacity > slots_.size() || ++generation_ == 0) {
+					slots_.assign((std::max)(capacity, slots_.size()), slot());
+					generation_ = 1;
+				}
+				order_.clear();
+			}
+
+			void add_edge(int n1, int n2) {
+				const boost::uint64_t k = key((std::min)(n1, n2), (std::max)(n1, n2));
+				const size_t mask = slots_.size() - 1;
+				for (size_t i = hash(k) & mask;; i = (i + 1) & mask) {
+					slot& s = slots_[i];
+					if (s.generation != generation_) {
+						s.key = k;
+						s.generation = generation_;
+						s.count = 1;
+						order_.push_back(i);
+						return;
+					}
+					if (s.key == k) {
+						++s.count;
+						return;
+					}
+				}
+			}
+
+			/// Appends the vertex indices of the edges that have been added exactly once,
+			/// in the order in which they have been first added.
+			void boundary_edges(std::vector<int>& edges) const {
+				for (std::vector<size_t>::const_iterator it = order_.begin(); it != order_.end(); ++it) {
+					const slot& s = slots_[*it];
+					if (s.count == 1) {
+						edges.push_back(static_cast<int>(s.key >> 32));
+						edges.push_back(static_cast<int>(s.key & 0xffffffffULL));
+					}
+				}
+			}
+		};
+
 		template <typename P>
 		class Triangulation : public Representation {
 		private:
-			// A nested pair of floats and a material index to be able to store an XYZ coordinate in a map.
-			// TODO: Make this a std::tuple when compilers add support for that.
-			typedef typename std::pair<P, std::pair<P, P> > Coordinate;
-			typedef typename std::pair<int, Coordinate> VertexKey;
-			typedef std::map<VertexKey, int> VertexKeyMap;
-			typedef std::pair<int, int> Edge;
+			// An open addressing hash table of welded vertices, keyed by material index and
+			// the exact coordinate values. Linear probing with a load factor of at most one
+			// half. The table is sized upfront from the number of mesh nodes of a shape.
+			class WeldTable {
+			private:
+				struct slot {
+					P x, y, z;
+					int material;
+					int index;
+					slot() : x(0), y(0), z(0), material(0), index(-1) {}
+				};
+				std::vector<slot> slots_;
+				size_t count_;
+
+				// Positive and negative zero compare equal, so they need to hash equally too
+				static P normalize(P v) { return v == 0 ? P(0) : v; }
+
+				static boost::uint64_t bits(P v) {
+					boost::uint64_t b = 0;
+					std::memcpy(&b, &v, sizeof(P));
+					return b;
+				}
+
+				static size_t hash(int material, P x, P y, P z) {
+					boost::uint64_t h = static_cast<boost::uint64_t>(material) * 0x9e3779b97f4a7c15ULL;
+					const boost::uint64_t vs[3] = { bits(x), bits(y), bits(z) };
+					for (int i = 0; i < 3; ++i) {
+						h = (h ^ vs[i]) * 0xbf58476d1ce4e5b9ULL;
+						h ^= h >> 31;
+					}
+					h ^= h >> 29;
+					return static_cast<size_t>(h);
+				}
+
+				void rehash(size_t capacity) {
+					std::vector<slot> old(capacity);
+					old.swap(slots_);
+					const size_t mask = slots_.size() - 1;
+					for (typename std::vector<slot>::const_iterator it = old.begin(); it != old.end(); ++it) {
+						if (it->index == -1) continue;
+						size_t i = hash(it->material, it->x, it->y, it->z) & mask;
+						while (slots_[i].index != -1) {
+							i = (i + 1) & mask;
+						}
+						slots_[i] = *it;
+					}
+				}
+
+			public:
+				WeldTable() : count_(0) {}
+
+				size_t size() const { return count_; }
+
+				void reserve(size_t n) {
+					size_t capacity = 16;
+					while (capacity < 2 * n) {
+						capacity *= 2;
+					}
+					if (capacity > slots_.size()) {
+						rehash(capacity);
+					}
+				}
+
+				/// Returns the index of the vertex with the same key, or inserts the key with the
+				/// index provided and returns -1 if no such vertex exists.
+				int insert(int material, P x, P y, P z, int index) {
+					if (2 * (count_ + 1) > slots_.size()) {
+						rehash(slots_.empty() ? 16 : slots_.size() * 2);
+					}
+					x = normalize(x); y = normalize(y); z = normalize(z);
+					const size_t mask = slots_.size() - 1;
+					for (size_t i = hash(material, x, y, z) & mask;; i = (i + 1) & mask) {
+						slot& s = slots_[i];
+						if (s.index == -1) {
+							s.x = x; s.y = y; s.z = z;
+							s.material = material;
+							s.index = index;
+							++count_;
+							return -1;
+						}
+						if (s.material == material && s.x == x && s.y == y && s.z == z) {
+							return s.index;
+						}
+					}
+				}
+			};
 
 			std::string id_;
 			std::vector<P> _verts;
@@ -112,7 +310,11 @@ namespace IfcGeom {
             std::vector<P> uvs_;
 			std::vector<int> _material_ids;
 			std::vector<Material> _materials;
-			VertexKeyMap welds;
+			WeldTable welds;
+
+			mutable boost::shared_ptr<const MeshBuffer> buffer_;
+			mutable MeshBuffer::NormalEncoding buffer_normal_encoding_;
+			mutable MeshBuffer::IndexEncoding buffer_index_encoding_;
 
 		public:
 			const std::string& id() const { return id_; }
@@ -124,10 +326,101 @@ namespace IfcGeom {
 			const std::vector<int>& material_ids() const { return _material_ids; }
 			const std::vector<Material>& materials() const { return _materials; }
 
+			/// A compact copy of the mesh in a single aligned block, for consumers that upload or
+			/// transmit it. It is built on first use and rebuilt only when other encodings are
+			/// requested. Borrowers may hold on to it beyond the lifetime of the triangulation.
+			/// Not thread-safe.
+			boost::shared_ptr<const MeshBuffer> buffer(MeshBuffer::NormalEncoding normal_encoding = MeshBuffer::NORMALS_FLOAT32,
+				MeshBuffer::IndexEncoding index_encoding = MeshBuffer::INDICES_NARROWEST) const
+			{
+				if (!buffer_ || buffer_normal_encoding_ != normal_encoding || buffer_index_encoding_ != index_encoding) {
+					buffer_.reset(new MeshBuffer(*this, normal_encoding, index_encoding));
+					buffer_normal_encoding_ = normal_encoding;
+					buffer_index_encoding_ = index_encoding;
+				}
+				return buffer_;
+			}
+
 			Triangulation(const BRep& shape_model)
 					: Representation(shape_model.settings())
 					, id_(shape_model.id())
+					, buffer_normal_encoding_(MeshBuffer::NORMALS_NONE)
+					, buffer_index_encoding_(MeshBuffer::INDICES_NARROWEST)
+			{
+				triangulate(shape_model);
+			}
+
+			/// Triangulates the shapes using other settings than those of the BRep,
+			/// e.g. a different deflection tolerance for another level of detail.
+			Triangulation(const BRep& shape_model, const ElementSettings& settings)
+					: Representation(settings)
+					, id_(shape_model.id())
+					, buffer_normal_encoding_(MeshBuffer::NORMALS_NONE)
+					, buffer_index_encoding_(MeshBuffer::INDICES_NARROWEST)
 			{
+				triangulate(shape_model);
+			}
+
+			/// Constructs a triangulation from previously computed data, e.g. read from a cache.
+			Triangulation(const ElementSettings& settings, const std::string& id,
+				const std::vector<P>& verts, const std::vector<int>& faces, const std::vector<int>& edges,
+				const std::vector<P>& normals, const std::vector<P>& uvs,
+				const std::vector<int>& material_ids, const std::vector<Material>& materials)
+				: Representation(settings)
+				, id_(id)
+				, _verts(verts)
+				, _faces(faces)
+				, _edges(edges)
+				, _normals(normals)
+				, uvs_(uvs)
+				, _material_ids(material_ids)
+				, _materials(materials)
+				, buffer_normal_encoding_(MeshBuffer::NORMALS_NONE)
+				, buffer_index_encoding_(MeshBuffer::INDICES_NARROWEST)
+			{}
+
+			virtual ~Triangulation() {}
+
+            /// Generates UVs for a single mesh using box projection.
+            /// @todo Very simple impl. Assumes that input vertices and normals match 1:1.
+            static std::vector<P> box_project_uvs(const std::vector<P> &vertices, const std::vector<P> &normals)
+            {
+                std::vector<P> uvs;
+                uvs.resize(vertices.size() / 3 * 2);
+                for (size_t uv_idx = 0, v_idx = 0;
+                uv_idx < uvs.size() && v_idx < vertices.size() && v_idx < normals.size();
+                    uv_idx += 2, v_idx += 3) {
+
+                    P n_x = normals[v_idx], n_y = normals[v_idx + 1], n_z = normals[v_idx + 2];
+                    P v_x = vertices[v_idx], v_y = vertices[v_idx + 1], v_z = vertices[v_idx + 2];
+
+                    if (std::abs(n_x) > std::abs(n_y) && std::abs(n_x) > std::abs(n_z)) {
+                        uvs[uv_idx] = v_z;
+                        uvs[uv_idx + 1] = v_y;
+                    }
+                    if (std::abs(n_y) > std::abs(n_x) && std::abs(n_y) > std::abs(n_z)) {
+                        uvs[uv_idx] = v_x;
+                        uvs[uv_idx + 1] = v_z;
+                    }
+                    if (std::abs(n_z) > std::abs(n_x) && std::abs(n_z) > std::abs(n_y)) {
+                        uvs[uv_idx] = v_x;
+                        uvs[uv_idx + 1] = v_y;
+                    }
+                }
+
+                return uvs;
+            }
+
+		private:
+			// Shapes with at least this number of faces are meshed using multiple threads
+			static const size_t PARALLEL_MESH_FACES = 64;
+			// Shapes with at least this number of mesh nodes are processed using multiple threads
+			static const size_t PARALLEL_EXTRACTION_NODES = 20000;
+
+			void triangulate(const BRep& shape_model)
+			{
+				TriangulationScratch& scratch = TriangulationScratch::for_current_thread();
+
 				for ( IfcGeom::IfcRepresentationShapeItems::const_iterator iit = shape_model.begin(); iit != shape_model.end(); ++ iit ) {
 
 					int surface_style_id = -1;
@@ -156,9 +449,29 @@ namespace IfcGeom {
 					const TopoDS_Shape& s = iit->Shape();
 					const gp_GTrsf& trsf = iit->Placement();
 
-					// Triangulate the shape
+					std::vector<TopoDS_Face> faces;
+					for (TopExp_Explorer exp(s, TopAbs_FACE); exp.More(); exp.Next()) {
+						faces.push_back(TopoDS::Face(exp.Current()));
+					}
+					const int num_faces = (int) faces.size();
+
+					// The deflection is optionally relative to the size of the shape
+					double deflection = settings().deflection_tolerance();
+					if (settings().relative_deflection() > 0.) {
+						Bnd_Box box;
+						BRepBndLib::Add(s, box);
+						if (!box.IsVoid()) {
+							deflection = settings().deflection_tolerance(sqrt(box.SquareExtent()));
+						}
+					}
+
+					// Triangulate the shape, shapes with many faces are meshed in parallel
 					try {
-						BRepMesh_IncrementalMesh(s, settings().deflection_tolerance());
+						BRepMesh_IncrementalMesh(s, deflection, Standard_False, settings().angular_deflection()
+#if OCC_VERSION_HEX >= 0x60800
+							, faces.size() >= PARALLEL_MESH_FACES
+#endif
+						);
 					} catch(...) {
 
 						// TODO: Catch outside
@@ -167,104 +480,37 @@ namespace IfcGeom {
 						continue;
 					}
 
-					// Iterates over the faces of the shape
-					int num_faces = 0;
-					TopExp_Explorer exp;
-					for ( exp.Init(s,TopAbs_FACE); exp.More(); exp.Next(), ++num_faces ) {
-						TopoDS_Face face = TopoDS::Face(exp.Current());
+					size_t num_nodes = 0;
+					for (std::vector<TopoDS_Face>::const_iterator it = faces.begin(); it != faces.end(); ++it) {
 						TopLoc_Location loc;
-						Handle_Poly_Triangulation tri = BRep_Tool::Triangulation(face,loc);
-
-						if ( ! tri.IsNull() ) {
-
-							// A 3x3 matrix to rotate the vertex normals
-							const gp_Mat rotation_matrix = trsf.VectorialPart();
-			
-							// Keep track of the number of times an edge is used
-							// Manifold edges (i.e. edges used twice) are deemed invisible
-							std::map<std::pair<int,int>,int> edgecount;
-							std::vector<std::pair<int,int> > edges_temp;
-
-							const TColgp_Array1OfPnt& nodes = tri->Nodes();
-							const TColgp_Array1OfPnt2d& uvs = tri->UVNodes();
-							std::vector<gp_XYZ> coords;
-							BRepGProp_Face prop(face);
-							std::map<int,int> dict;
-
-                            // Vertex normals are only calculated if vertices are not welded and calculation is not disable explicitly.
-                            const bool calculate_normals = !settings().get(IteratorSettings::WELD_VERTICES) &&
-                                !settings().get(IteratorSettings::NO_NORMALS);
-
-							for( int i = 1; i <= nodes.Length(); ++ i ) {
-								coords.push_back(nodes(i).Transformed(loc).XYZ());
-								trsf.Transforms(*coords.rbegin());
-								dict[i] = addVertex(surface_style_id, *coords.rbegin());
-					
-								if ( calculate_normals ) {
-									const gp_Pnt2d& uv = uvs(i);
-									gp_Pnt p;
-									gp_Vec normal_direction;
-									prop.Normal(uv.X(),uv.Y(),p,normal_direction);
-									gp_Vec normal(0., 0., 0.);
-									if (normal_direction.Magnitude() > ALMOST_ZERO) {
-										normal = gp_Dir(normal_direction.XYZ() * rotation_matrix);
-									} else {
-										Handle_Geom_Surface surf = BRep_Tool::Surface(face);
-										// Special case the normal at the poles of a spherical surface
-										if (surf->DynamicType() == STANDARD_TYPE(Geom_SphericalSurface)) {
-											if (ALMOST_THE_SAME(fabs(uv.Y()), M_PI / 2.)) {
-												const bool is_top = uv.Y() > 0;
-												const bool is_forward = face.Orientation() == TopAbs_FORWARD;
-												const double z = (is_top == is_forward) ? 1. : -1.;
-												normal = gp_Dir(gp_XYZ(0, 0, z) * rotation_matrix);
-											}
-										}
-										// TODO: Do the same for conical surfaces, but they are rare in IFC.
-									}
-									_normals.push_back(static_cast<P>(normal.X()));
-									_normals.push_back(static_cast<P>(normal.Y()));
-									_normals.push_back(static_cast<P>(normal.Z()));
-								}
-							}
-
-							const Poly_Array1OfTriangle& triangles = tri->Triangles();			
-							for( int i = 1; i <= triangles.Length(); ++ i ) {
-								int n1,n2,n3;
-								if ( face.Orientation() == TopAbs_REVERSED )
-									triangles(i).Get(n3,n2,n1);
-								else triangles(i).Get(n1,n2,n3);
-
-								/* An alternative would be to calculate normals based
-									* on the coordinates of the mesh vertices */
-								/*
-								const gp_XYZ pt1 = coords[n1-1];
-								const gp_XYZ pt2 = coords[n2-1];
-								const gp_XYZ pt3 = coords[n3-1];
-								const gp_XYZ v1 = pt2-pt1;
-								const gp_XYZ v2 = pt3-pt2;
-								gp_Dir normal = gp_Dir(v1^v2);
-								_normals.push_back((float)normal.X());
-								_normals.push_back((float)normal.Y());
-								_normals.push_back((float)normal.Z());
-								*/
-
-								_faces.push_back(dict[n1]);
-								_faces.push_back(dict[n2]);
-								_faces.push_back(dict[n3]);
+						Handle_Poly_Triangulation tri = BRep_Tool::Triangulation(*it, loc);
+						if (!tri.IsNull()) {
+							num_nodes += tri->NbNodes();
+						}
+					}
 
-								_material_ids.push_back(surface_style_id);
+					if (settings().get(IteratorSettings::WELD_VERTICES)) {
+						// Size the weld table for the worst case of no vertices being shared
+						welds.reserve(welds.size() + num_nodes);
+					}
 
-								addEdge(dict[n1], dict[n2], edgecount, edges_temp);
-								addEdge(dict[n2], dict[n3], edgecount, edges_temp);
-								addEdge(dict[n3], dict[n1], edgecount, edges_temp);
-							}
-							for ( std::vector<std::pair<int,int> >::const_iterator jt = edges_temp.begin(); jt != edges_temp.end(); ++jt ) {
-								if (edgecount[*jt] == 1) {
-									// non manifold edge, face boundary
-									_edges.push_back(jt->first);
-									_edges.push_back(jt->second);
-								}
-							}
+					// Vertex normals are only calculated if vertices are not welded and calculation is not disable explicitly.
+					const bool calculate_normals = !settings().get(IteratorSettings::WELD_VERTICES) &&
+						!settings().get(IteratorSettings::NO_NORMALS);
+
+					// The nodes and normals of the faces of large shapes are extracted in parallel. They are
+					// merged in the order of the faces, so that the result does not depend on scheduling.
+					std::vector<FaceTriangulation> face_triangulations;
+					if (faces.size() > 1 && num_nodes >= PARALLEL_EXTRACTION_NODES &&
+						FaceTriangulation::extract(faces, trsf, calculate_normals, face_triangulations))
+					{
+						for (std::vector<FaceTriangulation>::const_iterator it = face_triangulations.begin(); it != face_triangulations.end(); ++it) {
+							addFace(surface_style_id, *it, scratch);
+						}
+					} else {
+						for (std::vector<TopoDS_Face>::const_iterator it = faces.begin(); it != faces.end(); ++it) {
+							scratch.face.extract(*it, trsf, calculate_normals);
+							addFace(surface_style_id, scratch.face, scratch);
 						}
 					}
 
@@ -279,7 +525,7 @@ namespace IfcGeom {
 						// belong to any face.
 						for (TopExp_Explorer texp(s, TopAbs_EDGE); texp.More(); texp.Next()) {
 							BRepAdaptor_Curve crv(TopoDS::Edge(texp.Current()));
-							GCPnts_QuasiUniformDeflection tessellater(crv, settings().deflection_tolerance());
+							GCPnts_QuasiUniformDeflection tessellater(crv, deflection);
 							int n = tessellater.NbPoints();
 							int start = (int)_verts.size() / 3;
 							for (int i = 1; i <= n; ++i) {
@@ -343,40 +589,53 @@ namespace IfcGeom {
 
                     BRepTools::Clean(s);
 				}
+
+				// The weld table is only needed during construction
+				welds = WeldTable();
+
+				if (settings().simplify_triangulations()) {
+					double max_error = settings().simplification_error();
+					if (max_error > 0. && settings().get(IteratorSettings::CONVERT_BACK_UNITS)) {
+						max_error /= settings().unit_magnitude();
+					}
+					MeshSimplifier<P>(_verts, _faces, _edges, _normals, uvs_, _material_ids).simplify(settings().simplification_ratio(), max_error);
+				}
 			}
-			virtual ~Triangulation() {}
 
-            /// Generates UVs for a single mesh using box projection.
-            /// @todo Very simple impl. Assumes that input vertices and normals match 1:1.
-            static std::vector<P> box_project_uvs(const std::vector<P> &vertices, const std::vector<P> &normals)
-            {
-                std::vector<P> uvs;
-                uvs.resize(vertices.size() / 3 * 2);
-                for (size_t uv_idx = 0, v_idx = 0;
-                uv_idx < uvs.size() && v_idx < vertices.size() && v_idx < normals.size();
-                    uv_idx += 2, v_idx += 3) {
+			void addFace(int surface_style_id, const FaceTriangulation& face, TriangulationScratch& scratch) {
+				std::vector<int>& dict = scratch.node_indices;
+				dict.resize(face.nodes.size());
+				for (size_t i = 0; i < face.nodes.size(); ++i) {
+					dict[i] = addVertex(surface_style_id, face.nodes[i]);
+				}
+				for (std::vector<gp_XYZ>::const_iterator it = face.normals.begin(); it != face.normals.end(); ++it) {
+					_normals.push_back(static_cast<P>(it->X()));
+					_normals.push_back(static_cast<P>(it->Y()));
+					_normals.push_back(static_cast<P>(it->Z()));
+				}
 
-                    P n_x = normals[v_idx], n_y = normals[v_idx + 1], n_z = normals[v_idx + 2];
-                    P v_x = vertices[v_idx], v_y = vertices[v_idx + 1], v_z = vertices[v_idx + 2];
+				// Keep track of the number of times an edge is used
+				// Manifold edges (i.e. edges used twice) are deemed invisible
+				scratch.begin_edges(face.triangles.size());
 
-                    if (std::abs(n_x) > std::abs(n_y) && std::abs(n_x) > std::abs(n_z)) {
-                        uvs[uv_idx] = v_z;
-                        uvs[uv_idx + 1] = v_y;
-                    }
-                    if (std::abs(n_y) > std::abs(n_x) && std::abs(n_y) > std::abs(n_z)) {
-                        uvs[uv_idx] = v_x;
-                        uvs[uv_idx + 1] = v_z;
-                    }
-                    if (std::abs(n_z) > std::abs(n_x) && std::abs(n_z) > std::abs(n_y)) {
-                        uvs[uv_idx] = v_x;
-                        uvs[uv_idx + 1] = v_y;
-                    }
-                }
+				for (std::vector<int>::const_iterator it = face.triangles.begin(); it != face.triangles.end(); it += 3) {
+					const int n1 = dict[*it], n2 = dict[*(it + 1)], n3 = dict[*(it + 2)];
 
-                return uvs;
-            }
+					_faces.push_back(n1);
+					_faces.push_back(n2);
+					_faces.push_back(n3);
+
+					_material_ids.push_back(surface_style_id);
+
+					scratch.add_edge(n1, n2);
+					scratch.add_edge(n2, n3);
+					scratch.add_edge(n3, n1);
+				}
+
+				// non manifold edges, face boundary
+				scratch.boundary_edges(_edges);
+			}
 
-		private:
 			// Welds vertices that belong to different faces
 			int addVertex(int material_index, const gp_XYZ& p) {
                 const bool convert = settings().get(IteratorSettings::CONVERT_BACK_UNITS);
@@ -385,23 +644,15 @@ namespace IfcGeom {
 				const P Z = static_cast<P>(convert ? (p.Z() / settings().unit_magnitude()) : p.Z());
 				int i = (int) _verts.size() / 3;
 				if (settings().get(IteratorSettings::WELD_VERTICES)) {
-					const VertexKey key = std::make_pair(material_index, std::make_pair(X, std::make_pair(Y, Z)));
-					typename VertexKeyMap::const_iterator it = welds.find(key);
-					if ( it != welds.end() ) return it->second;
 					i = (int) welds.size();
-					welds[key] = i;
+					const int existing = welds.insert(material_index, X, Y, Z, i);
+					if ( existing != -1 ) return existing;
 				}
 				_verts.push_back(X);
 				_verts.push_back(Y);
 				_verts.push_back(Z);
 				return i;
 			}
-			inline void addEdge(int n1, int n2, std::map<std::pair<int,int>,int>& edgecount, std::vector<std::pair<int,int> >& edges_temp) {
-				const Edge e = Edge( (std::min)(n1,n2),(std::max)(n1,n2) );
-				if ( edgecount.find(e) == edgecount.end() ) edgecount[e] = 1;
-				else edgecount[e] ++;
-				edges_temp.push_back(e);
-			}
 			Triangulation();
 			Triangulation(const Triangulation&);
 			Triangulation& operator=(const Triangulation&);
@@ -0,0 +1,291 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#include "../ifcgeom/IfcGeomStructuralHash.h"
+#include "../ifcparse/IfcParse.h"
+
+#include <cstring>
+
+namespace {
+	typedef IfcGeom::StructuralHash::value_type value_type;
+
+	// Tags to distinguish the different kinds of attribute values that are hashed
+	enum { TAG_NULL = 1, TAG_ENTITY, TAG_AGGREGATE, TAG_VALUE, TAG_STYLES };
+
+	inline void combine(value_type& seed, value_type v) {
+		IfcGeom::StructuralHash::combine(seed, v);
+	}
+
+	const IfcSchema::IfcStyledItem::list::ptr styled_by_item(const IfcUtil::IfcBaseClass* instance) {
+		const IfcSchema::IfcRepresentationItem* item = instance->as<IfcSchema::IfcRepresentationItem>();
+		if (item) {
+			return item->StyledByItem();
+		}
+		return IfcSchema::IfcStyledItem::list::ptr(new IfcSchema::IfcStyledItem::list);
+	}
+}
+
+IfcGeom::StructuralHash::value_type IfcGeom::StructuralHash::hash(const std::string& s, value_type seed) {
+	// 64-bit FNV-1a, the seed perturbs the offset basis
+	value_type h = 0xcbf29ce484222325ULL ^ seed;
+	for (std::string::const_iterator it = s.begin(); it != s.end(); ++it) {
+		h ^= static_cast<unsigned char>(*it);
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+IfcGeom::StructuralHash::value_type IfcGeom::StructuralHash::hash(double d) {
+	// Normalize negative zero, otherwise hash on the bit pattern
+	if (d == 0.) {
+		d = 0.;
+	}
+	value_type v;
+	std::memcpy(&v, &d, sizeof(v));
+	return v;
+}
+
+IfcGeom::StructuralHash::value_type IfcGeom::StructuralHash::operator()(const IfcUtil::IfcBaseClass* instance) {
+	const unsigned int id = instance->entity->id();
+	if (id) {
+		std::map<unsigned int, value_type>::const_iterator it = hashes_.find(id);
+		if (it != hashes_.end()) {
+			return it->second;
+		}
+	}
+
+	value_type h = seed_ + TAG_ENTITY;
+	combine(h, static_cast<value_type>(instance->type()));
+
+	if (surface_styles_by_identity_ && instance->is(IfcSchema::Type::IfcSurfaceStyle)) {
+		// Surface styles are internalized by the Kernel based on their id
+		combine(h, static_cast<value_type>(id));
+	} else {
+		const unsigned int n = instance->entity->getArgumentCount();
+		for (unsigned int i = 0; i < n; ++i) {
+			combine(h, hash_argument(instance->entity->getArgument(i)));
+		}
+		combine(h, hash_styles(instance));
+	}
+
+	if (id) {
+		hashes_[id] = h;
+	}
+
+	return h;
+}
+
+IfcGeom::StructuralHash::value_type IfcGeom::StructuralHash::operator()(const IfcSchema::IfcRepresentation* representation) {
+	IfcSchema::IfcRepresentationItem::list::ptr items = representation->Items();
+	value_type h = seed_ + TAG_AGGREGATE;
+	for (IfcSchema::IfcRepresentationItem::list::it it = items->begin(); it != items->end(); ++it) {
+		combine(h, (*this)(*it));
+	}
+	return h;
+}
+
+IfcGeom::StructuralHash::value_type IfcGeom::StructuralHash::hash_argument(Argument* argument) {
+	value_type h;
+	if (argument->isNull()) {
+		h = seed_ + TAG_NULL;
+		return h;
+	}
+
+	const IfcUtil::ArgumentType type = argument->type();
+	if (type == IfcUtil::Argument_ENTITY_INSTANCE) {
+		h = seed_ + TAG_ENTITY;
+		IfcUtil::IfcBaseClass* instance = *argument;
+		combine(h, (*this)(instance));
+	} else if (type == IfcUtil::Argument_AGGREGATE_OF_ENTITY_INSTANCE) {
+		h = seed_ + TAG_AGGREGATE;
+		IfcEntityList::ptr instances = *argument;
+		for (IfcEntityList::it it = instances->begin(); it != instances->end(); ++it) {
+			combine(h, (*this)(*it));
+		}
+	} else if (type == IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_ENTITY_INSTANCE) {
+		h = seed_ + TAG_AGGREGATE;
+		IfcEntityListList::ptr instances = *argument;
+		for (IfcEntityListList::outer_it it = instances->begin(); it != instances->end(); ++it) {
+			value_type inner = seed_ + TAG_AGGREGATE;
+			for (IfcEntityListList::inner_it jt = it->begin(); jt != it->end(); ++jt) {
+				combine(inner, (*this)(*jt));
+			}
+			combine(h, inner);
+		}
+	} else if (type == IfcUtil::Argument_UNKNOWN && dynamic_cast<IfcParse::ArgumentList*>(argument)) {
+		// Aggregates of mixed types, e.g. of SELECT types, can contain instance references
+		h = seed_ + TAG_AGGREGATE;
+		const unsigned int n = argument->size();
+		for (unsigned int i = 0; i < n; ++i) {
+			combine(h, hash_argument((*argument)[i]));
+		}
+	} else {
+		h = seed_ + TAG_VALUE;
+		combine(h, hash(argument->toString(), seed_));
+	}
+
+	return h;
+}
+
+IfcGeom::StructuralHash::value_type IfcGeom::StructuralHash::hash_styles(const IfcUtil::IfcBaseClass* instance) {
+	value_type h = seed_ + TAG_STYLES;
+	IfcSchema::IfcStyledItem::list::ptr styled_items = styled_by_item(instance);
+	for (IfcSchema::IfcStyledItem::list::it it = styled_items->begin(); it != styled_items->end(); ++it) {
+		// Only the Styles attribute, the Item attribute refers back to the instance
+		combine(h, hash_argument((*it)->entity->getArgument(1)));
+	}
+	return h;
+}
+
+bool IfcGeom::StructuralHash::equal(const IfcUtil::IfcBaseClass* a, const IfcUtil::IfcBaseClass* b) {
+	if (a == b) {
+		return true;
+	}
+	if (a->type() != b->type() || (surface_styles_by_identity_ && a->is(IfcSchema::Type::IfcSurfaceStyle))) {
+		return false;
+	}
+
+	const unsigned int id_a = a->entity->id();
+	const unsigned int id_b = b->entity->id();
+	const bool memoize = id_a && id_b;
+	if (memoize) {
+		if (equal_.find(std::make_pair(id_a, id_b)) != equal_.end()) {
+			return true;
+		}
+		if ((*this)(a) != (*this)(b)) {
+			return false;
+		}
+	}
+
+	const unsigned int n = a->entity->getArgumentCount();
+	if (n != b->entity->getArgumentCount()) {
+		return false;
+	}
+	for (unsigned int i = 0; i < n; ++i) {
+		if (!equal_arguments(a->entity->getArgument(i), b->entity->getArgument(i))) {
+			return false;
+		}
+	}
+	if (!equal_styles(a, b)) {
+		return false;
+	}
+
+	if (memoize) {
+		equal_.insert(std::make_pair(id_a, id_b));
+	}
+
+	return true;
+}
+
+bool IfcGeom::StructuralHash::equal(const IfcSchema::IfcRepresentation* a, const IfcSchema::IfcRepresentation* b) {
+	IfcSchema::IfcRepresentationItem::list::ptr items_a = a->Items();
+	IfcSchema::IfcRepresentationItem::list::ptr items_b = b->Items();
+	if (items_a->size() != items_b->size()) {
+		return false;
+	}
+	IfcSchema::IfcRepresentationItem::list::it it = items_a->begin();
+	IfcSchema::IfcRepresentationItem::list::it jt = items_b->begin();
+	for (; it != items_a->end(); ++it, ++jt) {
+		if (!equal(*it, *jt)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool IfcGeom::StructuralHash::equal_arguments(Argument* a, Argument* b) {
+	if (a->isNull() || b->isNull()) {
+		return a->isNull() && b->isNull();
+	}
+
+	const IfcUtil::ArgumentType type = a->type();
+	if (type != b->type()) {
+		return false;
+	}
+
+	if (type == IfcUtil::Argument_ENTITY_INSTANCE) {
+		IfcUtil::IfcBaseClass* instance_a = *a;
+		IfcUtil::IfcBaseClass* instance_b = *b;
+		return equal(instance_a, instance_b);
+	} else if (type == IfcUtil::Argument_AGGREGATE_OF_ENTITY_INSTANCE) {
+		IfcEntityList::ptr instances_a = *a;
+		IfcEntityList::ptr instances_b = *b;
+		if (instances_a->size() != instances_b->size()) {
+			return false;
+		}
+		IfcEntityList::it it = instances_a->begin();
+		IfcEntityList::it jt = instances_b->begin();
+		for (; it != instances_a->end(); ++it, ++jt) {
+			if (!equal(*it, *jt)) {
+				return false;
+			}
+		}
+		return true;
+	} else if (type == IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_ENTITY_INSTANCE) {
+		IfcEntityListList::ptr instances_a = *a;
+		IfcEntityListList::ptr instances_b = *b;
+		if (instances_a->size() != instances_b->size()) {
+			return false;
+		}
+		IfcEntityListList::outer_it it = instances_a->begin();
+		IfcEntityListList::outer_it jt = instances_b->begin();
+		for (; it != instances_a->end(); ++it, ++jt) {
+			if (it->size() != jt->size()) {
+				return false;
+			}
+			IfcEntityListList::inner_it kt = it->begin();
+			IfcEntityListList::inner_it lt = jt->begin();
+			for (; kt != it->end(); ++kt, ++lt) {
+				if (!equal(*kt, *lt)) {
+					return false;
+				}
+			}
+		}
+		return true;
+	} else if (type == IfcUtil::Argument_UNKNOWN && dynamic_cast<IfcParse::ArgumentList*>(a) && dynamic_cast<IfcParse::ArgumentList*>(b)) {
+		const unsigned int n = a->size();
+		if (n != b->size()) {
+			return false;
+		}
+		for (unsigned int i = 0; i < n; ++i) {
+			if (!equal_arguments((*a)[i], (*b)[i])) {
+				return false;
+			}
+		}
+		return true;
+	} else {
+		return a->toString() == b->toString();
+	}
+}
+
+bool IfcGeom::StructuralHash::equal_styles(const IfcUtil::IfcBaseClass* a, const IfcUtil::IfcBaseClass* b) {
+	IfcSchema::IfcStyledItem::list::ptr styled_items_a = styled_by_item(a);
+	IfcSchema::IfcStyledItem::list::ptr styled_items_b = styled_by_item(b);
+	if (styled_items_a->size() != styled_items_b->size()) {
+		return false;
+	}
+	IfcSchema::IfcStyledItem::list::it it = styled_items_a->begin();
+	IfcSchema::IfcStyledItem::list::it jt = styled_items_b->begin();
+	for (; it != styled_items_a->end(); ++it, ++jt) {
+		if (!equal_arguments((*it)->entity->getArgument(1), (*jt)->entity->getArgument(1))) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,93 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#ifndef IFCGEOMSTRUCTURALHASH_H
+#define IFCGEOMSTRUCTURALHASH_H
+
+#include "ifc_geom_api.h"
+#ifdef USE_IFC4
+#include "../ifcparse/Ifc4.h"
+#else
+#include "../ifcparse/Ifc2x3.h"
+#endif
+
+#include <boost/cstdint.hpp>
+
+#include <map>
+#include <set>
+#include <string>
+
+namespace IfcGeom {
+
+	/// Computes hashes over the instance graph that is referenced by an entity
+	/// instance, based on entity types and attribute values only. Instance ids
+	/// are ignored, so two byte-identical subgraphs that only differ in the
+	/// names of their instances yield the same hash. Styles assigned to
+	/// representation items by means of IfcStyledItem are included. By default
+	/// IfcSurfaceStyles are compared by identity as these are internalized by
+	/// the Kernel based on their id, optionally they are compared by value.
+	///
+	/// Hashes are memoized for every instance visited, so that a shared
+	/// subgraph (e.g. a profile definition) is only traversed once.
+	///
+	/// Hashes computed with different seeds are independent of each other,
+	/// so that a second seed can be used to rule out collisions of the first
+	/// where a deep comparison is not possible, e.g. for persisted hashes.
+	class IFC_GEOM_API StructuralHash {
+	public:
+		typedef boost::uint64_t value_type;
+
+		explicit StructuralHash(bool surface_styles_by_identity = true, value_type seed = 0)
+			: surface_styles_by_identity_(surface_styles_by_identity)
+			, seed_(seed)
+		{}
+
+		value_type operator()(const IfcUtil::IfcBaseClass* instance);
+		value_type operator()(const IfcSchema::IfcRepresentation* representation);
+
+		/// Deep comparison of the subgraphs, can be used to rule out hash collisions.
+		bool equal(const IfcUtil::IfcBaseClass* a, const IfcUtil::IfcBaseClass* b);
+		bool equal(const IfcSchema::IfcRepresentation* a, const IfcSchema::IfcRepresentation* b);
+
+		void clear() {
+			hashes_.clear();
+			equal_.clear();
+		}
+
+		static void combine(value_type& seed, value_type v) {
+			seed ^= v + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+		}
+		static value_type hash(const std::string& s, value_type seed = 0);
+		static value_type hash(double d);
+
+	private:
+		value_type hash_argument(Argument* argument);
+		value_type hash_styles(const IfcUtil::IfcBaseClass* instance);
+		bool equal_arguments(Argument* a, Argument* b);
+		bool equal_styles(const IfcUtil::IfcBaseClass* a, const IfcUtil::IfcBaseClass* b);
+
+		bool surface_styles_by_identity_;
+		value_type seed_;
+		std::map<unsigned int, value_type> hashes_;
+		std::set< std::pair<unsigned int, unsigned int> > equal_;
+	};
+
+}
+
+#endif
@@ -22,41 +22,199 @@
 
 #include "../ifcparse/IfcFile.h"
 #include "../ifcgeom/IfcGeomIterator.h"
+#include "../ifcgeom/IfcGeomBvh.h"
+#include "../ifcgeom/IfcGeomTriangleMesh.h"
+#include "../ifcgeom/IfcGeomStructuralHash.h"
 
-#include <NCollection_UBTree.hxx>
 #include <BRepBndLib.hxx>
 #include <Bnd_Box.hxx>
 #include <BRepAlgoAPI_Common.hxx>
 #include <BRepAlgoAPI_Cut.hxx>
 #include <BRepClass3d_SolidClassifier.hxx>
+#include <BRepExtrema_DistShapeShape.hxx>
+#include <BRepBuilderAPI_MakeVertex.hxx>
+#include <IntCurvesFace_ShapeIntersector.hxx>
+#include <BRepTools.hxx>
+#include <BRep_Builder.hxx>
+#include <TopoDS_Compound.hxx>
+#include <TopoDS_Iterator.hxx>
+#include <BRepMesh_IncrementalMesh.hxx>
+#include <BRepBuilderAPI_Copy.hxx>
+#include <BRep_Tool.hxx>
+#include <TopoDS.hxx>
+#include <gp_GTrsf.hxx>
+#include <gp_Lin.hxx>
+#include <Precision.hxx>
+
+#include <boost/ref.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
 
 namespace IfcGeom {
 
 	namespace impl {
+
+		/// A pair of elements that intersect, or that are closer to each other than the clearance
+		template <typename T>
+		struct clash {
+			enum clash_type { COLLISION, CLEARANCE };
+
+			T a, b;
+			clash_type type;
+			/// For collisions an estimate of the penetration depth, the smallest extent of the
+			/// region in which the elements overlap. For clearance clashes the distance between
+			/// the elements.
+			double distance;
+			/// The center of the region in which the elements overlap, or the point halfway
+			/// between the closest points of the elements
+			gp_Pnt point;
+		};
+
+		/// An element hit by a ray, or near a point
+		template <typename T>
+		struct element_hit {
+			T element;
+			/// The distance along the ray to the first intersection with the element, or the
+			/// distance from the query point to the element
+			double distance;
+			/// The point of intersection, or the point on the element closest to the query point
+			gp_Pnt point;
+		};
+
+		/// Contacts between elements and the containment of elements in spaces, as edge
+		/// lists of indices into the elements and spaces for which it is computed
+		struct adjacency_graph {
+			/// Pairs (i, j), i < j, of elements that are within the tolerance of each other
+			std::vector< std::pair<size_t, size_t> > contacts;
+			/// Pairs (i, j) of an element i and a space j of which the interiors overlap
+			std::vector< std::pair<size_t, size_t> > containment;
+		};
+
 		template <typename T>
 		class tree {
 
 		public:
 
+			tree()
+				: mesh_narrow_phase_(false)
+				, mesh_tolerance_(0.)
+				, mesh_deflection_(1.e-3)
+				, meshes_mutex_(new boost::mutex)
+			{}
+
+			/// Performs the narrow phase of the intersection and point queries on triangle
+			/// meshes of the shapes, rather than with boolean operations and solid classifiers.
+			/// The meshes are computed with the given deflection when first needed. Surfaces
+			/// need to penetrate by more than the tolerance to intersect, points within the
+			/// deflection of a surface may be classified either way. Boolean operations remain
+			/// in use for the completely_within tests and for shapes without a closed mesh.
+			void set_mesh_narrow_phase(bool enabled, double tolerance = 0., double deflection = 1.e-3) {
+				boost::lock_guard<boost::mutex> lock(*meshes_mutex_);
+				if (deflection != mesh_deflection_) {
+					meshes_.clear();
+				}
+				mesh_narrow_phase_ = enabled;
+				mesh_tolerance_ = tolerance;
+				mesh_deflection_ = deflection;
+			}
+
 			void add(const T& t, const Bnd_Box& b) {
-				tree_.Add(t, b);
+				tree_.add(t, to_bvh_box(b));
 			}
 
 			void add(const T& t, const TopoDS_Shape& s) {
 				Bnd_Box b;
 				BRepBndLib::AddClose(s, b);
+				add(t, s, b);
+			}
+
+			/// Adds a shape of which the bounding box has been computed beforehand. Shapes
+			/// with a void box cannot be selected and are not added.
+			void add(const T& t, const TopoDS_Shape& s, const Bnd_Box& b) {
+				if (b.IsVoid()) {
+					return;
+				}
 				add(t, b);
 				shapes_[t] = s;
+				boost::lock_guard<boost::mutex> lock(*meshes_mutex_);
+				meshes_.erase(t);
 			}
 
-			std::vector<T> select_box(const T& t, bool completely_within = false, double extend=-1.e-5) const {
-				typename map_t::const_iterator it = shapes_.find(t);
-				if (it == shapes_.end()) {
-					return std::vector<T>();
+			/// Adds an element without a shape, which is only considered by select_box()
+			void add_box(const T& t, const Bnd_Box& b) {
+				if (b.IsVoid()) {
+					return;
 				}
+				add(t, b);
+				boxes_[t] = b;
+			}
 
+			/// Removes the element and its shape, returns false if it was not present. The
+			/// hierarchy is refit rather than rebuilt, so that queries reflect small edits
+			/// quickly.
+			bool remove(const T& t) {
+				const bool removed = tree_.remove(t);
+				shapes_.erase(t);
+				boxes_.erase(t);
+				boost::lock_guard<boost::mutex> lock(*meshes_mutex_);
+				meshes_.erase(t);
+				return removed;
+			}
+
+			/// Replaces the shape of the element, or adds it if it is not present
+			void update(const T& t, const TopoDS_Shape& s) {
 				Bnd_Box b;
-				BRepBndLib::AddClose(it->second, b);
+				BRepBndLib::AddClose(s, b);
+				update(t, s, b);
+			}
+
+			/// As update(), with a bounding box that has been computed beforehand. A void
+			/// box removes the element, as it could no longer be selected.
+			void update(const T& t, const TopoDS_Shape& s, const Bnd_Box& b) {
+				if (b.IsVoid()) {
+					remove(t);
+					return;
+				}
+				tree_.update(t, to_bvh_box(b));
+				shapes_[t] = s;
+				boxes_.erase(t);
+				boost::lock_guard<boost::mutex> lock(*meshes_mutex_);
+				meshes_.erase(t);
+			}
+
+			/// Replaces the element by one without a shape, see add_box()
+			void update_box(const T& t, const Bnd_Box& b) {
+				if (b.IsVoid()) {
+					remove(t);
+					return;
+				}
+				tree_.update(t, to_bvh_box(b));
+				shapes_.erase(t);
+				boxes_[t] = b;
+				boost::lock_guard<boost::mutex> lock(*meshes_mutex_);
+				meshes_.erase(t);
+			}
+
+			std::vector<T> select_box(const T& t, bool completely_within = false, double extend=-1.e-5) const {
+				Bnd_Box b;
+				typename map_t::const_iterator it = shapes_.find(t);
+				if (it != shapes_.end()) {
+					BRepBndLib::AddClose(it->second, b);
+				} else {
+					typename box_map_t::const_iterator jt = boxes_.find(t);
+					if (jt == boxes_.end()) {
+						return std::vector<T>();
+					}
+					b = jt->second;
+				}
 
 				// Gap is assumed to be positive throughout the codebase,
 				// but at least for IsOut() in the selector a negative
@@ -73,33 +231,7 @@ namespace IfcGeom {
 			}
 
 			std::vector<T> select_box(const Bnd_Box& b, bool completely_within = false) const {
-				selector s(b);
-				tree_.Select(s);
-				if (completely_within) {
-					std::vector<T> ts = s.results();
-					std::vector<T> ts_filtered;
-					ts_filtered.reserve(ts.size());
-					typename std::vector<T>::const_iterator it = ts.begin();
-					for (; it != ts.end(); ++it) {
-						const TopoDS_Shape& shp = shapes_.find(*it)->second;
-						Bnd_Box B;
-						BRepBndLib::AddClose(shp, B);
-
-						// BndBox::CornerMin() /-Max() introduced in OCCT 6.8
-						double x1, y1, z1, x2, y2, z2;
-						b.Get(x1, y1, z1, x2, y2, z2);
-						double gap = B.GetGap();
-						gp_Pnt p1(x1 - gap, y1 - gap, z1 - gap);
-						gp_Pnt p2(x2 + gap, y2 + gap, z2 + gap);
-						
-						if (!b.IsOut(p1) && !b.IsOut(p2)) {
-							ts_filtered.push_back(*it);
-						}
-					}
-					return ts_filtered;
-				} else {
-					return s.results();
-				}
+				return tree_.select_box(to_bvh_box(b), completely_within);
 			}
 
 			std::vector<T> select(const T& t, bool completely_within = false) const {
@@ -110,7 +242,11 @@ namespace IfcGeom {
 
 				std::vector<T> ts_filtered;
 
-				const TopoDS_Shape& A = shapes_.find(t)->second;
+				typename map_t::const_iterator a = shapes_.find(t);
+				if (a == shapes_.end()) {
+					return ts_filtered;
+				}
+				const TopoDS_Shape& A = a->second;
 				if (IfcGeom::Kernel::count(A, TopAbs_SHELL) == 0) {
 					return ts_filtered;
 				}
@@ -119,7 +255,11 @@ namespace IfcGeom {
 
 				typename std::vector<T>::const_iterator it = ts.begin();
 				for (it = ts.begin(); it != ts.end(); ++it) {
-					const TopoDS_Shape& B = shapes_.find(*it)->second;
+					typename map_t::const_iterator b = shapes_.find(*it);
+					if (b == shapes_.end()) {
+						continue;
+					}
+					const TopoDS_Shape& B = b->second;
 					if (IfcGeom::Kernel::count(B, TopAbs_SHELL) == 0) {
 						continue;
 					}
@@ -131,13 +271,8 @@ namespace IfcGeom {
 								ts_filtered.push_back(*it);
 							}
 						}
-					} else {
-						BRepAlgoAPI_Common common(A, B);
-						if (common.IsDone()) {
-							if (IfcGeom::Kernel::count(common.Shape(), TopAbs_SHELL) > 0) {
-								ts_filtered.push_back(*it);
-							}
-						}
+					} else if (shapes_intersect_(A, element_mesh_(t), B, element_mesh_(*it))) {
+						ts_filtered.push_back(*it);
 					}
 				}
 
@@ -163,19 +298,22 @@ namespace IfcGeom {
 				std::vector<T> ts_filtered;
 				ts_filtered.reserve(ts.size());
 
+				const mesh_ptr_t mesh = query_mesh_(s);
+
 				typename std::vector<T>::const_iterator it = ts.begin();
 				for (it = ts.begin(); it != ts.end(); ++it) {
-					const TopoDS_Shape& B = shapes_.find(*it)->second;
+					typename map_t::const_iterator b = shapes_.find(*it);
+					if (b == shapes_.end()) {
+						continue;
+					}
+					const TopoDS_Shape& B = b->second;
 					
 					if (IfcGeom::Kernel::count(B, TopAbs_SHELL) == 0) {
 						continue;
 					}
 
-					BRepAlgoAPI_Common common(s, B);
-					if (common.IsDone()) {
-						if (IfcGeom::Kernel::count(common.Shape(), TopAbs_SHELL) > 0) {
-							ts_filtered.push_back(*it);
-						}
+					if (shapes_intersect_(s, mesh, B, element_mesh_(*it))) {
+						ts_filtered.push_back(*it);
 					}
 				}
 
@@ -191,53 +329,1057 @@ namespace IfcGeom {
 				std::vector<T> ts_filtered;
 				ts_filtered.reserve(ts.size());
 
+				const double q[3] = { p.X(), p.Y(), p.Z() };
+
 				typename std::vector<T>::const_iterator it = ts.begin();
 				for (it = ts.begin(); it != ts.end(); ++it) {
-					const TopoDS_Shape& B = shapes_.find(*it)->second;
-					TopExp_Explorer exp(B, TopAbs_SOLID);
-					for (; exp.More(); exp.Next()) {
-						BRepClass3d_SolidClassifier cls(exp.Current(), p, 1e-5);
-						if (cls.State() != TopAbs_OUT) {
-							ts_filtered.push_back(*it);
-							break;
-						}
-					}					
+					typename map_t::const_iterator b = shapes_.find(*it);
+					if (b == shapes_.end()) {
+						continue;
+					}
+					const mesh_ptr_t mesh = element_mesh_(*it);
+					if (mesh ? mesh->contains(q) : contains_point_(b->second, p)) {
+						ts_filtered.push_back(*it);
+					}
 				}
 
 				return ts_filtered;
 			}
 
+			/// Batch variants of the queries above that return the results of every query in
+			/// order. The broad phase and the exact narrow phase are distributed over the given
+			/// number of threads. Candidate work is shared between queries where possible:
+			/// points are classified against a solid using a single classifier per solid, and
+			/// intersection tests between two elements are only performed once per pair. With
+			/// the mesh narrow phase enabled, points are classified individually against the
+			/// meshes of the elements, which are computed beforehand, so that large numbers of
+			/// points, such as scans, can be assigned to e.g. spaces quickly.
+
+			std::vector< std::vector<T> > select_box(const std::vector<Bnd_Box>& bs, bool completely_within = false, int num_threads = 1) const {
+				tree_.build();
+				std::vector< std::vector<T> > results(bs.size());
+				box_query q(*this, bs, completely_within, results);
+				parallel_for_(bs.size(), num_threads, q);
+				return results;
+			}
+
+			std::vector< std::vector<T> > select(const std::vector<gp_Pnt>& ps, int num_threads = 1) const {
+				return select_points_(ps, 0, num_threads);
+			}
+
+			/// As above, but only classifies the points against the given elements, such as
+			/// the IfcSpace elements of a model, which saves the meshing or classification
+			/// of all other elements near the points.
+			std::vector< std::vector<T> > select(const std::vector<gp_Pnt>& ps, const std::vector<T>& elements, int num_threads = 1) const {
+				const std::set<T> restriction(elements.begin(), elements.end());
+				return select_points_(ps, &restriction, num_threads);
+			}
+
+			std::vector< std::vector<T> > select(const std::vector<TopoDS_Shape>& ss, int num_threads = 1) const {
+				std::vector<Bnd_Box> bs(ss.size());
+				std::vector<char> query_has_shells(ss.size());
+				for (size_t i = 0; i < ss.size(); ++i) {
+					BRepBndLib::AddClose(ss[i], bs[i]);
+					query_has_shells[i] = IfcGeom::Kernel::count(ss[i], TopAbs_SHELL) > 0;
+					if (!query_has_shells[i]) {
+						bs[i].SetVoid();
+					}
+				}
+				candidate_list candidates(select_box(bs, false, num_threads));
+
+				const std::map<T, char> element_has_shells = has_shells_(candidates);
+				std::vector<mesh_ptr_t> meshes(ss.size());
+				if (mesh_narrow_phase_) {
+					for (size_t i = 0; i < ss.size(); ++i) {
+						if (query_has_shells[i]) {
+							meshes[i] = query_mesh_(ss[i]);
+						}
+					}
+				}
+				shape_intersection q(*this, ss, meshes, candidates, element_has_shells);
+				parallel_for_(candidates.size(), num_threads, q);
+
+				return candidates.filter();
+			}
+
+			std::vector< std::vector<T> > select(const std::vector<T>& ts, bool completely_within = false, int num_threads = 1) const {
+				std::vector<Bnd_Box> bs(ts.size());
+				for (size_t i = 0; i < ts.size(); ++i) {
+					typename map_t::const_iterator it = shapes_.find(ts[i]);
+					if (it != shapes_.end() && IfcGeom::Kernel::count(it->second, TopAbs_SHELL) > 0) {
+						BRepBndLib::AddClose(it->second, bs[i]);
+						bs[i].SetGap(bs[i].GetGap() - 1.e-5);
+					}
+				}
+				candidate_list candidates(select_box(bs, false, num_threads));
+
+				// The intersection of two elements is symmetric, so that every pair of elements
+				// is tested once. The containment test is not, and only identical queries share.
+				typedef std::map<std::pair<T, T>, size_t> pair_map_t;
+				pair_map_t unique_pairs;
+				std::vector< std::pair<T, T> > tests;
+				std::vector<size_t> test_of_candidate(candidates.size());
+				for (size_t i = 0; i < candidates.size(); ++i) {
+					std::pair<T, T> p(ts[candidates.query(i)], candidates.item(i));
+					if (!completely_within && p.second < p.first) {
+						std::swap(p.first, p.second);
+					}
+					typename pair_map_t::const_iterator it = unique_pairs.find(p);
+					if (it == unique_pairs.end()) {
+						it = unique_pairs.insert(std::make_pair(p, tests.size())).first;
+						tests.push_back(p);
+					}
+					test_of_candidate[i] = it->second;
+				}
+
+				// As pairs are ordered, the query element can be the second of a pair
+				std::map<T, char> element_has_shells = has_shells_(candidates);
+				for (size_t i = 0; i < ts.size(); ++i) {
+					element_has_shells[ts[i]] = !bs[i].IsVoid();
+				}
+				std::vector<char> outcomes(tests.size());
+				element_test q(*this, tests, element_has_shells, completely_within, outcomes);
+				parallel_for_(tests.size(), num_threads, q);
+
+				for (size_t i = 0; i < candidates.size(); ++i) {
+					candidates.set_hit(i, outcomes[test_of_candidate[i]] != 0);
+				}
+				return candidates.filter();
+			}
+
+			typedef clash<T> clash_t;
+
+			/// Finds the pairs of elements from a and b of which the estimated penetration depth
+			/// exceeds the tolerance, and with a positive clearance also the remaining pairs that
+			/// are closer to each other than the clearance. Elements that occur in both sets are
+			/// paired only once. The clashes are ordered by the position of their first element
+			/// in a, then by that of their second element in b.
+			std::vector<clash_t> clashes(const std::vector<T>& a, const std::vector<T>& b, double tolerance = 0., double clearance = 0., int num_threads = 1) const {
+				std::vector<Bnd_Box> bs(a.size());
+				for (size_t i = 0; i < a.size(); ++i) {
+					typename map_t::const_iterator it = shapes_.find(a[i]);
+					if (it != shapes_.end() && IfcGeom::Kernel::count(it->second, TopAbs_SHELL) > 0) {
+						BRepBndLib::AddClose(it->second, bs[i]);
+						if (clearance > 0.) {
+							bs[i].SetGap(bs[i].GetGap() + clearance);
+						} else {
+							bs[i] = shrink_box_(bs[i], (std::max)(tolerance, 1.e-5));
+						}
+					}
+				}
+				candidate_list candidates(select_box(bs, false, num_threads));
+
+				std::map<T, size_t> b_index;
+				for (size_t i = 0; i < b.size(); ++i) {
+					b_index.insert(std::make_pair(b[i], i));
+				}
+				const std::map<T, char> element_has_shells = has_shells_(candidates);
+
+				// Pairs are tested once regardless of the order of their elements
+				std::set< std::pair<T, T> > pairs;
+				std::vector<clash_t> tests;
+				std::vector< std::pair< std::pair<size_t, size_t>, size_t > > order;
+				for (size_t i = 0; i < candidates.size(); ++i) {
+					const T& x = a[candidates.query(i)];
+					const T& y = candidates.item(i);
+					typename std::map<T, size_t>::const_iterator jt = b_index.find(y);
+					if (x == y || jt == b_index.end() || !element_has_shells.find(y)->second) {
+						continue;
+					}
+					if (!pairs.insert(x < y ? std::make_pair(x, y) : std::make_pair(y, x)).second) {
+						continue;
+					}
+					clash_t c;
+					c.a = x;
+					c.b = y;
+					order.push_back(std::make_pair(std::make_pair(candidates.query(i), jt->second), tests.size()));
+					tests.push_back(c);
+				}
+
+				std::vector<char> outcomes(tests.size());
+				clash_test q(*this, tests, tolerance, clearance, outcomes);
+				parallel_for_(tests.size(), num_threads, q);
+
+				std::sort(order.begin(), order.end());
+				std::vector<clash_t> results;
+				for (size_t i = 0; i < order.size(); ++i) {
+					if (outcomes[order[i].second]) {
+						results.push_back(tests[order[i].second]);
+					}
+				}
+				return results;
+			}
+
+			/// Determines which of the elements touch or overlap, i.e. are within the tolerance
+			/// of each other, and which overlap with the spaces by more than the tolerance, so
+			/// that e.g. elements are assigned to the IfcSpace volumes they occupy. Spaces that
+			/// are also among the elements yield contacts with the elements that bound them.
+			/// Both are determined on the meshes of the elements, or with distance computations
+			/// and boolean operations for elements that do not have a closed mesh. Elements
+			/// that occur more than once are related by their first occurrence. The edges are
+			/// sorted.
+			adjacency_graph adjacency(const std::vector<T>& elements, const std::vector<T>& spaces, double tolerance, int num_threads = 1) const {
+				std::vector<Bnd_Box> bs(elements.size());
+				for (size_t i = 0; i < elements.size(); ++i) {
+					typename map_t::const_iterator it = shapes_.find(elements[i]);
+					if (it != shapes_.end() && IfcGeom::Kernel::count(it->second, TopAbs_SHELL) > 0) {
+						BRepBndLib::AddClose(it->second, bs[i]);
+						bs[i].SetGap(bs[i].GetGap() + tolerance);
+					}
+				}
+				candidate_list candidates(select_box(bs, false, num_threads));
+
+				std::map<T, size_t> element_index, space_index;
+				for (size_t i = 0; i < elements.size(); ++i) {
+					element_index.insert(std::make_pair(elements[i], i));
+				}
+				for (size_t i = 0; i < spaces.size(); ++i) {
+					space_index.insert(std::make_pair(spaces[i], i));
+				}
+				const std::map<T, char> element_has_shells = has_shells_(candidates);
+
+				std::vector<graph_edge> edges;
+				for (size_t i = 0; i < candidates.size(); ++i) {
+					const size_t a = candidates.query(i);
+					const T& y = candidates.item(i);
+					if (y == elements[a] || element_index.find(elements[a])->second != a || !element_has_shells.find(y)->second) {
+						continue;
+					}
+					typename std::map<T, size_t>::const_iterator it = element_index.find(y);
+					if (it != element_index.end() && it->second > a) {
+						const graph_edge e = { a, it->second, false };
+						edges.push_back(e);
+					}
+					it = space_index.find(y);
+					if (it != space_index.end()) {
+						const graph_edge e = { a, it->second, true };
+						edges.push_back(e);
+					}
+				}
+
+				std::vector<char> outcomes(edges.size());
+				graph_edge_test q(*this, elements, spaces, edges, tolerance, outcomes);
+				parallel_for_(edges.size(), num_threads, q);
+
+				adjacency_graph graph;
+				for (size_t i = 0; i < edges.size(); ++i) {
+					if (outcomes[i]) {
+						(edges[i].containment ? graph.containment : graph.contacts).push_back(std::make_pair(edges[i].a, edges[i].b));
+					}
+				}
+				std::sort(graph.contacts.begin(), graph.contacts.end());
+				std::sort(graph.containment.begin(), graph.containment.end());
+				return graph;
+			}
+
+			typedef element_hit<T> hit_t;
+
+			/// The elements hit by the ray from origin along direction within max_distance, in
+			/// order of the distance to their first intersection. Unless all_hits is set only
+			/// the closest element is returned, so that the traversal ends as soon as the
+			/// remaining boxes lie beyond it. Intersections are computed on the meshes of the
+			/// elements, or on the exact shapes of elements that do not have a closed mesh.
+			/// Elements added without a shape are not considered.
+			std::vector<hit_t> select_ray(const gp_Pnt& origin, const gp_Dir& direction,
+				double max_distance = std::numeric_limits<double>::infinity(), bool all_hits = false) const
+			{
+				const double o[3] = { origin.X(), origin.Y(), origin.Z() };
+				const double d[3] = { direction.X(), direction.Y(), direction.Z() };
+				std::vector<hit_t> hits;
+				ray_visitor visitor(*this, origin, direction, all_hits, hits);
+				tree_.traverse_ray(o, d, max_distance, visitor);
+				std::sort(hits.begin(), hits.end(), hit_less());
+				return hits;
+			}
+
+			/// The k elements nearest to p within max_distance, nearest first, or all elements
+			/// within max_distance when k is zero. Points in the interior of an element are at
+			/// distance zero. Boxes further away than the k-th nearest element found so far are
+			/// not visited. Distances are computed on the meshes of the elements, accurate up
+			/// to the mesh deflection, or on the exact shapes of elements that do not have a
+			/// closed mesh. Elements added without a shape are not considered.
+			std::vector<hit_t> select_nearest(const gp_Pnt& p, int k = 1, double max_distance = std::numeric_limits<double>::infinity()) const {
+				const double q[3] = { p.X(), p.Y(), p.Z() };
+				std::vector<hit_t> hits;
+				nearest_visitor visitor(*this, p, static_cast<size_t>((std::max)(k, 0)), hits);
+				tree_.traverse_nearest(q, max_distance, visitor);
+				std::sort(hits.begin(), hits.end(), hit_less());
+				return hits;
+			}
+
+			/// Batch variants of select_ray() and select_nearest(), distributed over the given number of threads
+
+			std::vector< std::vector<hit_t> > select_ray(const std::vector<gp_Pnt>& origins, const std::vector<gp_Dir>& directions,
+				double max_distance = std::numeric_limits<double>::infinity(), bool all_hits = false, int num_threads = 1) const
+			{
+				if (origins.size() != directions.size()) {
+					throw std::runtime_error("Number of ray origins and directions differ");
+				}
+				tree_.build();
+				std::vector< std::vector<hit_t> > results(origins.size());
+				ray_query q(*this, origins, directions, max_distance, all_hits, results);
+				parallel_for_(origins.size(), num_threads, q);
+				return results;
+			}
+
+			std::vector< std::vector<hit_t> > select_nearest(const std::vector<gp_Pnt>& ps, int k = 1,
+				double max_distance = std::numeric_limits<double>::infinity(), int num_threads = 1) const
+			{
+				tree_.build();
+				std::vector< std::vector<hit_t> > results(ps.size());
+				nearest_query q(*this, ps, k, max_distance, results);
+				parallel_for_(ps.size(), num_threads, q);
+				return results;
+			}
+
 		protected:
 
-			typedef NCollection_UBTree<T, Bnd_Box> tree_t;
+			typedef bvh<T> tree_t;
 			typedef std::map<T, TopoDS_Shape> map_t;
+			typedef std::map<T, Bnd_Box> box_map_t;
 			tree_t tree_;
 			map_t shapes_;
+			box_map_t boxes_;
 
-			class selector : public tree_t::Selector
-			{
+			typedef boost::shared_ptr<TriangleMesh> mesh_ptr_t;
+			typedef std::map<T, mesh_ptr_t> mesh_map_t;
+			bool mesh_narrow_phase_;
+			double mesh_tolerance_, mesh_deflection_;
+			// Meshes of the elements, computed on first use
+			mutable mesh_map_t meshes_;
+			// Shared between copies, as mutexes cannot be copied
+			boost::shared_ptr<boost::mutex> meshes_mutex_;
+
+			// The mesh of the shape, or a null pointer when the mesh narrow phase is disabled
+			// or the shape does not result in a closed mesh
+			mesh_ptr_t query_mesh_(const TopoDS_Shape& s) const {
+				if (!mesh_narrow_phase_) {
+					return mesh_ptr_t();
+				}
+				return mesh_(s);
+			}
+
+			mesh_ptr_t element_mesh_(const T& t) const {
+				if (!mesh_narrow_phase_) {
+					return mesh_ptr_t();
+				}
+				return cached_mesh_(t);
+			}
+
+			// The mesh of the element, regardless of whether the mesh narrow phase is enabled.
+			// Only the lookup and insertion are guarded, so that elements are meshed in
+			// parallel. When two threads mesh the same element the first result is kept.
+			mesh_ptr_t cached_mesh_(const T& t) const {
+				{
+					boost::lock_guard<boost::mutex> lock(*meshes_mutex_);
+					typename mesh_map_t::const_iterator it = meshes_.find(t);
+					if (it != meshes_.end()) {
+						return it->second;
+					}
+				}
+				mesh_ptr_t mesh;
+				typename map_t::const_iterator jt = shapes_.find(t);
+				if (jt != shapes_.end()) {
+					mesh = mesh_(jt->second);
+				}
+				boost::lock_guard<boost::mutex> lock(*meshes_mutex_);
+				return meshes_.insert(std::make_pair(t, mesh)).first->second;
+			}
+
+			// Meshing stores triangulations on the faces, which can be shared with other
+			// shapes and other threads. Therefore a copy is meshed, which is discarded along
+			// with its triangulations once the vertices and triangles are extracted.
+			mesh_ptr_t mesh_(const TopoDS_Shape& original) const {
+				TopExp_Explorer exp(original, TopAbs_SHELL);
+				if (!exp.More()) {
+					return mesh_ptr_t();
+				}
+				for (; exp.More(); exp.Next()) {
+					if (!BRep_Tool::IsClosed(exp.Current())) {
+						return mesh_ptr_t();
+					}
+				}
+
+				mesh_ptr_t mesh(new TriangleMesh);
+				try {
+					const TopoDS_Shape s = BRepBuilderAPI_Copy(original).Shape();
+					BRepMesh_IncrementalMesh(s, mesh_deflection_);
+					IfcGeom::Representation::FaceTriangulation face;
+					for (exp.Init(s, TopAbs_FACE); exp.More(); exp.Next()) {
+						face.extract(TopoDS::Face(exp.Current()), gp_GTrsf(), false);
+						if (face.triangles.empty()) {
+							return mesh_ptr_t();
+						}
+						const int offset = static_cast<int>(mesh->num_vertices());
+						for (std::vector<gp_XYZ>::const_iterator it = face.nodes.begin(); it != face.nodes.end(); ++it) {
+							mesh->add_vertex(it->X(), it->Y(), it->Z());
+						}
+						for (size_t i = 0; i < face.triangles.size(); i += 3) {
+							mesh->add_triangle(offset + face.triangles[i], offset + face.triangles[i + 1], offset + face.triangles[i + 2]);
+						}
+					}
+				} catch (const Standard_Failure&) {
+					Logger::Error("Failed to mesh shape");
+					return mesh_ptr_t();
+				}
+				mesh->build();
+				return mesh;
+			}
+
+			// Tests whether the shapes collide by more than the tolerance and estimates the
+			// penetration depth from the bounds of the region in which they overlap
+			bool collide_(const TopoDS_Shape& A, const mesh_ptr_t& a, const TopoDS_Shape& B, const mesh_ptr_t& b, double tolerance, clash_t& c) const {
+				double lo[3], hi[3];
+				if (a && b) {
+					if (!a->intersection_bounds(*b, tolerance, lo, hi)) {
+						return false;
+					}
+				} else {
+					BRepAlgoAPI_Common common(A, B);
+					if (!common.IsDone() || IfcGeom::Kernel::count(common.Shape(), TopAbs_SHELL) == 0) {
+						return false;
+					}
+					Bnd_Box box;
+					BRepBndLib::AddClose(common.Shape(), box);
+					if (box.IsVoid()) {
+						return false;
+					}
+					box.Get(lo[0], lo[1], lo[2], hi[0], hi[1], hi[2]);
+				}
+				const double depth = (std::min)(hi[0] - lo[0], (std::min)(hi[1] - lo[1], hi[2] - lo[2]));
+				if (depth <= tolerance) {
+					return false;
+				}
+				c.type = clash_t::COLLISION;
+				c.distance = depth;
+				c.point = gp_Pnt((lo[0] + hi[0]) / 2., (lo[1] + hi[1]) / 2., (lo[2] + hi[2]) / 2.);
+				return true;
+			}
+
+			bool within_clearance_(const TopoDS_Shape& A, const TopoDS_Shape& B, double clearance, clash_t& c) const {
+				BRepExtrema_DistShapeShape dist(A, B);
+				if (!dist.IsDone() || dist.NbSolution() == 0 || dist.Value() > clearance) {
+					return false;
+				}
+				c.type = clash_t::CLEARANCE;
+				c.distance = dist.Value();
+				c.point = gp_Pnt((dist.PointOnShape1(1).XYZ() + dist.PointOnShape2(1).XYZ()) / 2.);
+				return true;
+			}
+
+			static bool contains_point_(const TopoDS_Shape& s, const gp_Pnt& p) {
+				TopExp_Explorer exp(s, TopAbs_SOLID);
+				for (; exp.More(); exp.Next()) {
+					BRepClass3d_SolidClassifier cls(exp.Current(), p, 1e-5);
+					if (cls.State() != TopAbs_OUT) {
+						return true;
+					}
+				}
+				return false;
+			}
+
+			// Classifies the points against the elements in the restriction, or against all
+			// elements if it is null
+			std::vector< std::vector<T> > select_points_(const std::vector<gp_Pnt>& ps, const std::set<T>* restriction, int num_threads) const {
+				if (mesh_narrow_phase_) {
+					return select_on_meshes_(ps, restriction, num_threads);
+				}
+
+				std::vector<Bnd_Box> bs(ps.size());
+				for (size_t i = 0; i < ps.size(); ++i) {
+					bs[i].Add(ps[i]);
+				}
+				candidate_list candidates(select_box(bs, false, num_threads));
+
+				// Invert the candidates, so that the points are classified per element
+				typedef std::map< T, std::vector<size_t> > element_map_t;
+				element_map_t by_element;
+				for (size_t i = 0; i < candidates.size(); ++i) {
+					if (!restriction || restriction->find(candidates.item(i)) != restriction->end()) {
+						by_element[candidates.item(i)].push_back(i);
+					}
+				}
+				std::vector<T> elements;
+				std::vector< std::vector<size_t> > pairs;
+				elements.reserve(by_element.size());
+				pairs.reserve(by_element.size());
+				for (typename element_map_t::iterator it = by_element.begin(); it != by_element.end(); ++it) {
+					elements.push_back(it->first);
+					pairs.push_back(std::vector<size_t>());
+					pairs.back().swap(it->second);
+				}
+
+				point_classification q(*this, ps, candidates, elements, pairs);
+				parallel_for_(elements.size(), num_threads, q);
+
+				return candidates.filter();
+			}
+
+			// Classifies the points one by one on the meshes of the elements. The meshes of
+			// all elements near any of the points are obtained beforehand, in parallel, so
+			// that the classification does not need to lock.
+			std::vector< std::vector<T> > select_on_meshes_(const std::vector<gp_Pnt>& ps, const std::set<T>* restriction, int num_threads) const {
+				Bnd_Box bounds;
+				for (std::vector<gp_Pnt>::const_iterator it = ps.begin(); it != ps.end(); ++it) {
+					bounds.Add(*it);
+				}
+				std::vector<T> elements;
+				const std::vector<T> near = select_box(bounds);
+				for (typename std::vector<T>::const_iterator it = near.begin(); it != near.end(); ++it) {
+					if (!restriction || restriction->find(*it) != restriction->end()) {
+						elements.push_back(*it);
+					}
+				}
+				std::vector<mesh_ptr_t> element_meshes(elements.size());
+				mesh_task m(*this, elements, element_meshes);
+				parallel_for_(elements.size(), num_threads, m);
+
+				// Elements not in the map, i.e. outside of the restriction, are skipped
+				mesh_map_t meshes;
+				for (size_t i = 0; i < elements.size(); ++i) {
+					meshes[elements[i]] = element_meshes[i];
+				}
+
+				std::vector< std::vector<T> > results(ps.size());
+				mesh_point_classification q(*this, ps, meshes, results);
+				parallel_for_(ps.size(), num_threads, q);
+				return results;
+			}
+
+			// The first intersection of the ray with the element within max_t
+			bool ray_hit_(const T& t, const gp_Pnt& o, const gp_Dir& d, double max_t, hit_t& hit) const {
+				typename map_t::const_iterator it = shapes_.find(t);
+				if (it == shapes_.end()) {
+					return false;
+				}
+				hit.element = t;
+				try {
+					const mesh_ptr_t mesh = cached_mesh_(t);
+					if (mesh) {
+						const double o_[3] = { o.X(), o.Y(), o.Z() };
+						const double d_[3] = { d.X(), d.Y(), d.Z() };
+						if (!mesh->intersect_ray(o_, d_, max_t, hit.distance)) {
+							return false;
+						}
+						hit.point = o.Translated(gp_Vec(d) * hit.distance);
+						return true;
+					}
+					IntCurvesFace_ShapeIntersector intersector;
+					intersector.Load(it->second, Precision::Confusion());
+					intersector.Perform(gp_Lin(o, d), 0., (std::min)(max_t, Precision::Infinite()));
+					if (!intersector.IsDone()) {
+						return false;
+					}
+					bool found = false;
+					for (int i = 1; i <= intersector.NbPnt(); ++i) {
+						if (!found || intersector.WParameter(i) < hit.distance) {
+							found = true;
+							hit.distance = intersector.WParameter(i);
+							hit.point = intersector.Pnt(i);
+						}
+					}
+					return found;
+				} catch (const Standard_Failure&) {
+					Logger::Error("Failed to intersect ray with shape");
+				}
+				return false;
+			}
+
+			// The distance from p to the element, if within max_distance
+			bool nearest_point_(const T& t, const gp_Pnt& p, double max_distance, hit_t& hit) const {
+				typename map_t::const_iterator it = shapes_.find(t);
+				if (it == shapes_.end()) {
+					return false;
+				}
+				hit.element = t;
+				try {
+					const mesh_ptr_t mesh = cached_mesh_(t);
+					if (mesh) {
+						const double q[3] = { p.X(), p.Y(), p.Z() };
+						if (mesh->contains(q)) {
+							hit.distance = 0.;
+							hit.point = p;
+							return true;
+						}
+						double r[3];
+						if (!mesh->nearest_point(q, max_distance, hit.distance, r)) {
+							return false;
+						}
+						hit.point = gp_Pnt(r[0], r[1], r[2]);
+						return true;
+					}
+					if (contains_point_(it->second, p)) {
+						hit.distance = 0.;
+						hit.point = p;
+						return true;
+					}
+					BRepExtrema_DistShapeShape dist(BRepBuilderAPI_MakeVertex(p).Vertex(), it->second);
+					if (!dist.IsDone() || dist.NbSolution() == 0 || dist.Value() > max_distance) {
+						return false;
+					}
+					hit.distance = dist.Value();
+					hit.point = dist.PointOnShape2(1);
+					return true;
+				} catch (const Standard_Failure&) {
+					Logger::Error("Failed to compute distance to shape");
+				}
+				return false;
+			}
+
+			// Whether the shapes are within the tolerance of each other, or overlap
+			bool touch_(const TopoDS_Shape& A, const mesh_ptr_t& a, const TopoDS_Shape& B, const mesh_ptr_t& b, double tolerance) const {
+				if (a && b) {
+					return a->within_distance(*b, tolerance);
+				}
+				BRepExtrema_DistShapeShape dist(A, B);
+				if (dist.IsDone() && dist.NbSolution() > 0 && dist.Value() <= tolerance) {
+					return true;
+				}
+				return shapes_intersect_(A, mesh_ptr_t(), B, mesh_ptr_t());
+			}
+
+			// The narrow phase of the intersection queries, on the meshes when both are available
+			bool shapes_intersect_(const TopoDS_Shape& A, const mesh_ptr_t& a, const TopoDS_Shape& B, const mesh_ptr_t& b) const {
+				if (a && b) {
+					return a->intersects(*b, mesh_tolerance_);
+				}
+				BRepAlgoAPI_Common common(A, B);
+				return common.IsDone() && IfcGeom::Kernel::count(common.Shape(), TopAbs_SHELL) > 0;
+			}
+
+			// Shrinks the box by d, but by at most half of its extent per axis, so that elements
+			// thinner than 2d still yield the plane or line through their center
+			static Bnd_Box shrink_box_(const Bnd_Box& b, double d) {
+				double x1, y1, z1, x2, y2, z2;
+				b.Get(x1, y1, z1, x2, y2, z2);
+				const double dx = (std::min)(d, (x2 - x1) / 2.);
+				const double dy = (std::min)(d, (y2 - y1) / 2.);
+				const double dz = (std::min)(d, (z2 - z1) / 2.);
+				Bnd_Box r;
+				r.Update(x1 + dx, y1 + dy, z1 + dz, x2 - dx, y2 - dy, z2 - dz);
+				return r;
+			}
+
+			// Bnd_Box::Get() includes the gap, void boxes are never selected
+			static bvh_box to_bvh_box(const Bnd_Box& b) {
+				if (b.IsVoid()) {
+					return bvh_box();
+				}
+				double x1, y1, z1, x2, y2, z2;
+				b.Get(x1, y1, z1, x2, y2, z2);
+				return bvh_box(x1, y1, z1, x2, y2, z2);
+			}
+
+			// Number of consecutive indices that a thread claims at once in parallel_for_()
+			static const size_t PARALLEL_CHUNK_SIZE = 16;
+
+			template <typename Fn>
+			class parallel_worker {
 			public:
-				selector(const Bnd_Box& b)
-					: tree_t::Selector()
-					, bounds_(b)
-				{}
+				parallel_worker(size_t n, Fn& fn) : n_(n), next_(0), fn_(fn) {}
+
+				void operator()() {
+					for (;;) {
+						size_t begin, end;
+						{
+							boost::lock_guard<boost::mutex> lock(mutex_);
+							begin = next_;
+							end = next_ = (std::min)(n_, next_ + PARALLEL_CHUNK_SIZE);
+						}
+						if (begin >= end) {
+							return;
+						}
+						for (size_t i = begin; i < end; ++i) {
+							fn_(i);
+						}
+					}
+				}
+
+			private:
+				size_t n_, next_;
+				Fn& fn_;
+				boost::mutex mutex_;
+			};
 
-				Standard_Boolean Reject(const Bnd_Box& b) const {
-					return bounds_.IsOut(b);
+			// Calls fn(i) for every i in [0, n) on up to num_threads threads. Distinct
+			// indices need to be safe to process concurrently.
+			template <typename Fn>
+			static void parallel_for_(size_t n, int num_threads, Fn& fn) {
+				if (num_threads <= 1 || n <= PARALLEL_CHUNK_SIZE) {
+					for (size_t i = 0; i < n; ++i) {
+						fn(i);
+					}
+					return;
 				}
+				parallel_worker<Fn> worker(n, fn);
+				boost::thread_group threads;
+				for (int i = 0; i < num_threads; ++i) {
+					threads.create_thread(boost::ref(worker));
+				}
+				threads.join_all();
+			}
 
-				Standard_Boolean Accept(const T& o) {
-					results_.push_back(o);
-					return Standard_True;
+			// The broad phase results of a batch of queries as a flat list of
+			// (query, element) pairs, with a flag for the narrow phase outcome
+			class candidate_list {
+			public:
+				candidate_list(const std::vector< std::vector<T> >& results)
+					: offsets_(results.size() + 1, 0)
+				{
+					for (size_t i = 0; i < results.size(); ++i) {
+						offsets_[i + 1] = offsets_[i] + results[i].size();
+					}
+					items_.reserve(offsets_.back());
+					queries_.reserve(offsets_.back());
+					for (size_t i = 0; i < results.size(); ++i) {
+						items_.insert(items_.end(), results[i].begin(), results[i].end());
+						queries_.insert(queries_.end(), results[i].size(), i);
+					}
+					hits_.resize(items_.size(), 0);
 				}
 
-				const std::vector<T>& results() const {
-					return results_;
+				size_t size() const { return items_.size(); }
+				const T& item(size_t i) const { return items_[i]; }
+				size_t query(size_t i) const { return queries_[i]; }
+				// Distinct candidates are stored in distinct bytes, so they can be set concurrently
+				void set_hit(size_t i, bool hit) { hits_[i] = hit ? 1 : 0; }
+
+				// The candidates that passed the narrow phase, per query
+				std::vector< std::vector<T> > filter() const {
+					std::vector< std::vector<T> > results(offsets_.size() - 1);
+					for (size_t i = 0; i + 1 < offsets_.size(); ++i) {
+						for (size_t j = offsets_[i]; j < offsets_[i + 1]; ++j) {
+							if (hits_[j]) {
+								results[i].push_back(items_[j]);
+							}
+						}
+					}
+					return results;
 				}
 
 			private:
-				std::vector<T> results_;
-				const Bnd_Box& bounds_;
+				std::vector<size_t> offsets_;
+				std::vector<T> items_;
+				std::vector<size_t> queries_;
+				std::vector<char> hits_;
+			};
+
+			std::map<T, char> has_shells_(const candidate_list& candidates) const {
+				std::map<T, char> result;
+				for (size_t i = 0; i < candidates.size(); ++i) {
+					const T& t = candidates.item(i);
+					if (result.find(t) == result.end()) {
+						typename map_t::const_iterator it = shapes_.find(t);
+						result[t] = it != shapes_.end() && IfcGeom::Kernel::count(it->second, TopAbs_SHELL) > 0;
+					}
+				}
+				return result;
+			}
+
+			struct box_query {
+				const tree& t;
+				const std::vector<Bnd_Box>& bs;
+				bool completely_within;
+				std::vector< std::vector<T> >& results;
+
+				box_query(const tree& t, const std::vector<Bnd_Box>& bs, bool completely_within, std::vector< std::vector<T> >& results)
+					: t(t), bs(bs), completely_within(completely_within), results(results) {}
+
+				void operator()(size_t i) {
+					results[i] = t.select_box(bs[i], completely_within);
+				}
+			};
+
+			// Classifies all points of which the box query returned an element against
+			// the solids of that element, loading every solid only once.
+			struct point_classification {
+				const tree& t;
+				const std::vector<gp_Pnt>& ps;
+				candidate_list& candidates;
+				const std::vector<T>& elements;
+				const std::vector< std::vector<size_t> >& pairs;
+
+				point_classification(const tree& t, const std::vector<gp_Pnt>& ps, candidate_list& candidates,
+					const std::vector<T>& elements, const std::vector< std::vector<size_t> >& pairs)
+					: t(t), ps(ps), candidates(candidates), elements(elements), pairs(pairs) {}
+
+				void operator()(size_t i) {
+					typename map_t::const_iterator it = t.shapes_.find(elements[i]);
+					if (it == t.shapes_.end()) {
+						return;
+					}
+					const std::vector<size_t>& ids = pairs[i];
+					try {
+						TopExp_Explorer exp(it->second, TopAbs_SOLID);
+						for (; exp.More(); exp.Next()) {
+							BRepClass3d_SolidClassifier cls(exp.Current());
+							for (std::vector<size_t>::const_iterator jt = ids.begin(); jt != ids.end(); ++jt) {
+								cls.Perform(ps[candidates.query(*jt)], 1e-5);
+								if (cls.State() != TopAbs_OUT) {
+									candidates.set_hit(*jt, true);
+								}
+							}
+						}
+					} catch (const Standard_Failure&) {
+						Logger::Error("Failed to classify points");
+					}
+				}
+			};
+
+			struct mesh_task {
+				const tree& t;
+				const std::vector<T>& elements;
+				std::vector<mesh_ptr_t>& meshes;
+
+				mesh_task(const tree& t, const std::vector<T>& elements, std::vector<mesh_ptr_t>& meshes)
+					: t(t), elements(elements), meshes(meshes) {}
+
+				void operator()(size_t i) {
+					meshes[i] = t.cached_mesh_(elements[i]);
+				}
+			};
+
+			struct mesh_point_classification {
+				const tree& t;
+				const std::vector<gp_Pnt>& ps;
+				const mesh_map_t& meshes;
+				std::vector< std::vector<T> >& results;
+
+				mesh_point_classification(const tree& t, const std::vector<gp_Pnt>& ps, const mesh_map_t& meshes, std::vector< std::vector<T> >& results)
+					: t(t), ps(ps), meshes(meshes), results(results) {}
+
+				void operator()(size_t i) {
+					const double p[3] = { ps[i].X(), ps[i].Y(), ps[i].Z() };
+					std::vector<T> candidates;
+					t.tree_.select_box(bvh_box(p[0], p[1], p[2], p[0], p[1], p[2]), candidates);
+					for (typename std::vector<T>::const_iterator it = candidates.begin(); it != candidates.end(); ++it) {
+						typename map_t::const_iterator jt = t.shapes_.find(*it);
+						typename mesh_map_t::const_iterator mt = meshes.find(*it);
+						if (jt == t.shapes_.end() || mt == meshes.end()) {
+							continue;
+						}
+						try {
+							if (mt->second ? mt->second->contains(p) : contains_point_(jt->second, ps[i])) {
+								results[i].push_back(*it);
+							}
+						} catch (const Standard_Failure&) {
+							Logger::Error("Failed to classify point");
+						}
+					}
+				}
+			};
+
+			struct shape_intersection {
+				const tree& t;
+				const std::vector<TopoDS_Shape>& ss;
+				const std::vector<mesh_ptr_t>& meshes;
+				candidate_list& candidates;
+				const std::map<T, char>& element_has_shells;
+
+				shape_intersection(const tree& t, const std::vector<TopoDS_Shape>& ss, const std::vector<mesh_ptr_t>& meshes,
+					candidate_list& candidates, const std::map<T, char>& element_has_shells)
+					: t(t), ss(ss), meshes(meshes), candidates(candidates), element_has_shells(element_has_shells) {}
+
+				void operator()(size_t i) {
+					if (!element_has_shells.find(candidates.item(i))->second) {
+						return;
+					}
+					const TopoDS_Shape& B = t.shapes_.find(candidates.item(i))->second;
+					const size_t j = candidates.query(i);
+					try {
+						if (t.shapes_intersect_(ss[j], meshes[j], B, t.element_mesh_(candidates.item(i)))) {
+							candidates.set_hit(i, true);
+						}
+					} catch (const Standard_Failure&) {
+						Logger::Error("Failed to intersect shapes");
+					}
+				}
+			};
+
+			struct element_test {
+				const tree& t;
+				const std::vector< std::pair<T, T> >& tests;
+				const std::map<T, char>& element_has_shells;
+				bool completely_within;
+				std::vector<char>& outcomes;
+
+				element_test(const tree& t, const std::vector< std::pair<T, T> >& tests, const std::map<T, char>& element_has_shells,
+					bool completely_within, std::vector<char>& outcomes)
+					: t(t), tests(tests), element_has_shells(element_has_shells), completely_within(completely_within), outcomes(outcomes) {}
+
+				void operator()(size_t i) {
+					const std::pair<T, T>& p = tests[i];
+					if (!element_has_shells.find(p.first)->second || !element_has_shells.find(p.second)->second) {
+						return;
+					}
+					const TopoDS_Shape& A = t.shapes_.find(p.first)->second;
+					const TopoDS_Shape& B = t.shapes_.find(p.second)->second;
+					try {
+						if (completely_within) {
+							BRepAlgoAPI_Cut cut(B, A);
+							outcomes[i] = cut.IsDone() && IfcGeom::Kernel::count(cut.Shape(), TopAbs_SHELL) == 0;
+						} else {
+							outcomes[i] = t.shapes_intersect_(A, t.element_mesh_(p.first), B, t.element_mesh_(p.second));
+						}
+					} catch (const Standard_Failure&) {
+						Logger::Error("Failed to intersect shapes");
+					}
+				}
+			};
+
+			struct hit_less {
+				bool operator()(const hit_t& a, const hit_t& b) const {
+					return a.distance < b.distance;
+				}
+			};
+
+			// Tests the elements along a ray, lowering the limit of the traversal to the
+			// closest hit unless all hits are requested
+			struct ray_visitor {
+				const tree& t;
+				const gp_Pnt& o;
+				const gp_Dir& d;
+				bool all_hits;
+				std::vector<hit_t>& hits;
+
+				ray_visitor(const tree& t, const gp_Pnt& o, const gp_Dir& d, bool all_hits, std::vector<hit_t>& hits)
+					: t(t), o(o), d(d), all_hits(all_hits), hits(hits) {}
+
+				void operator()(const T& e, double, double& max_t) {
+					hit_t hit;
+					if (!t.ray_hit_(e, o, d, max_t, hit)) {
+						return;
+					}
+					if (all_hits) {
+						hits.push_back(hit);
+					} else {
+						hits.assign(1, hit);
+						max_t = hit.distance;
+					}
+				}
+			};
+
+			// Keeps the k nearest elements as a max heap, lowering the limit of the traversal
+			// to the distance of the k-th once found
+			struct nearest_visitor {
+				const tree& t;
+				const gp_Pnt& p;
+				size_t k;
+				std::vector<hit_t>& hits;
+
+				nearest_visitor(const tree& t, const gp_Pnt& p, size_t k, std::vector<hit_t>& hits)
+					: t(t), p(p), k(k), hits(hits) {}
+
+				void operator()(const T& e, double, double& max_distance) {
+					hit_t hit;
+					if (!t.nearest_point_(e, p, max_distance, hit)) {
+						return;
+					}
+					hits.push_back(hit);
+					if (k == 0) {
+						return;
+					}
+					std::push_heap(hits.begin(), hits.end(), hit_less());
+					if (hits.size() > k) {
+						std::pop_heap(hits.begin(), hits.end(), hit_less());
+						hits.pop_back();
+					}
+					if (hits.size() == k) {
+						max_distance = hits.front().distance;
+					}
+				}
+			};
+
+			struct ray_query {
+				const tree& t;
+				const std::vector<gp_Pnt>& origins;
+				const std::vector<gp_Dir>& directions;
+				double max_distance;
+				bool all_hits;
+				std::vector< std::vector<hit_t> >& results;
+
+				ray_query(const tree& t, const std::vector<gp_Pnt>& origins, const std::vector<gp_Dir>& directions,
+					double max_distance, bool all_hits, std::vector< std::vector<hit_t> >& results)
+					: t(t), origins(origins), directions(directions), max_distance(max_distance), all_hits(all_hits), results(results) {}
+
+				void operator()(size_t i) {
+					results[i] = t.select_ray(origins[i], directions[i], max_distance, all_hits);
+				}
+			};
+
+			struct nearest_query {
+				const tree& t;
+				const std::vector<gp_Pnt>& ps;
+				int k;
+				double max_distance;
+				std::vector< std::vector<hit_t> >& results;
+
+				nearest_query(const tree& t, const std::vector<gp_Pnt>& ps, int k, double max_distance, std::vector< std::vector<hit_t> >& results)
+					: t(t), ps(ps), k(k), max_distance(max_distance), results(results) {}
+
+				void operator()(size_t i) {
+					results[i] = t.select_nearest(ps[i], k, max_distance);
+				}
+			};
+
+			// A candidate contact between two elements, or containment of an element in a space
+			struct graph_edge {
+				size_t a, b;
+				bool containment;
+			};
+
+			struct graph_edge_test {
+				const tree& t;
+				const std::vector<T>& elements;
+				const std::vector<T>& spaces;
+				const std::vector<graph_edge>& edges;
+				double tolerance;
+				std::vector<char>& outcomes;
+
+				graph_edge_test(const tree& t, const std::vector<T>& elements, const std::vector<T>& spaces,
+					const std::vector<graph_edge>& edges, double tolerance, std::vector<char>& outcomes)
+					: t(t), elements(elements), spaces(spaces), edges(edges), tolerance(tolerance), outcomes(outcomes) {}
+
+				void operator()(size_t i) {
+					const graph_edge& e = edges[i];
+					const T& x = elements[e.a];
+					const T& y = e.containment ? spaces[e.b] : elements[e.b];
+					const TopoDS_Shape& A = t.shapes_.find(x)->second;
+					const TopoDS_Shape& B = t.shapes_.find(y)->second;
+					try {
+						const mesh_ptr_t a = t.cached_mesh_(x);
+						const mesh_ptr_t b = t.cached_mesh_(y);
+						if (e.containment) {
+							outcomes[i] = a && b ? a->intersects(*b, tolerance) : t.shapes_intersect_(A, mesh_ptr_t(), B, mesh_ptr_t());
+						} else {
+							outcomes[i] = t.touch_(A, a, B, b, tolerance);
+						}
+					} catch (const Standard_Failure&) {
+						Logger::Error("Failed to relate elements");
+					}
+				}
+			};
+
+			struct clash_test {
+				const tree& t;
+				std::vector<clash_t>& clashes;
+				double tolerance, clearance;
+				std::vector<char>& outcomes;
+
+				clash_test(const tree& t, std::vector<clash_t>& clashes, double tolerance, double clearance, std::vector<char>& outcomes)
+					: t(t), clashes(clashes), tolerance(tolerance), clearance(clearance), outcomes(outcomes) {}
+
+				void operator()(size_t i) {
+					clash_t& c = clashes[i];
+					const TopoDS_Shape& A = t.shapes_.find(c.a)->second;
+					const TopoDS_Shape& B = t.shapes_.find(c.b)->second;
+					try {
+						outcomes[i] = t.collide_(A, t.element_mesh_(c.a), B, t.element_mesh_(c.b), tolerance, c) ||
+							(clearance > 0. && t.within_clearance_(A, B, clearance, c));
+					} catch (const Standard_Failure&) {
+						Logger::Error("Failed to test elements for clashes");
+					}
+				}
 			};
 
 		};
@@ -246,31 +1388,501 @@ namespace IfcGeom {
 	class tree : public impl::tree<IfcSchema::IfcProduct*> {
 	public:
 
-		tree() {};
+		tree() : boxes_only_(false) {};
 
-		tree(IfcParse::IfcFile& f) {
+		tree(IfcParse::IfcFile& f) : boxes_only_(false) {
 			add_file(f, IfcGeom::IteratorSettings());
 		}
 
-		tree(IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings) {
+		tree(IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings) : boxes_only_(false) {
 			add_file(f, settings);
 		}
 
-		void add_file(IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings) {
+		tree(IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings, int num_threads) : boxes_only_(false) {
+			add_file(f, settings, num_threads);
+		}
+
+		/// Converts the products in the file and adds their shapes. With multiple threads,
+		/// each thread converts part of the products using its own copy of the file, as
+		/// the parser does not support concurrent access. Products that share their
+		/// representation are converted by the same thread.
+		void add_file(IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings, int num_threads = 1) {
+			add_products(f, settings, IfcSchema::IfcProduct::list::ptr(), num_threads);
+		}
+
+		/// As add_file(), for a subset of the products in the file only
+		void add_products(IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings, const IfcSchema::IfcProduct::list::ptr& products, int num_threads = 1) {
+			std::vector<converted_shape> shapes;
+			convert_(f, shape_settings_(settings), products, num_threads, shapes);
+
+			for (std::vector<converted_shape>::const_iterator it = shapes.begin(); it != shapes.end(); ++it) {
+				add((IfcSchema::IfcProduct*)f.entityById(it->id), it->shape, it->box);
+			}
+
+			// Build in bulk now, rather than on the first query
+			tree_.build();
+		}
+
+		/// Converts the products again after they have been modified and replaces their
+		/// shapes. Products that no longer result in a shape are removed. The hierarchy is
+		/// refit rather than rebuilt, so that small edits are reflected quickly.
+		void update_products(IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings, const IfcSchema::IfcProduct::list::ptr& products, int num_threads = 1) {
+			if (!products || products->size() == 0) {
+				return;
+			}
+			std::vector<converted_shape> shapes;
+			convert_(f, shape_settings_(settings), products, num_threads, shapes);
+
+			std::set<IfcSchema::IfcProduct*> converted;
+			for (std::vector<converted_shape>::const_iterator it = shapes.begin(); it != shapes.end(); ++it) {
+				IfcSchema::IfcProduct* product = (IfcSchema::IfcProduct*)f.entityById(it->id);
+				update(product, it->shape, it->box);
+				converted.insert(product);
+			}
+			for (IfcSchema::IfcProduct::list::it it = products->begin(); it != products->end(); ++it) {
+				if (converted.find(*it) == converted.end()) {
+					remove(*it);
+				}
+			}
+
+			tree_.build();
+		}
+
+		/// Adds the bounding boxes of the products in the file, but not their shapes, so
+		/// that only select_box() can be used. Products with an IfcBoundingBox as their
+		/// 'Box' representation are placed without any conversion of geometry. All other
+		/// products go through the full BRep conversion of add_file(), except that their
+		/// openings are not subtracted, as openings are rarely relevant to the extents of
+		/// a product and account for most of the conversion time. The tree is then
+		/// written and read as a box-only tree, see file_key().
+		void add_file_boxes(IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings, int num_threads = 1) {
+			boxes_only_ = true;
+
+			IfcGeom::Kernel kernel;
+			const boost::shared_ptr<PlacementMemo> memo = placement_memo_(f, settings, kernel);
+			kernel.set_placement_memo(memo);
+
+			IfcSchema::IfcProduct::list::ptr unboxed(new IfcSchema::IfcProduct::list);
+			IfcSchema::IfcProduct::list::ptr products = f.entitiesByType<IfcSchema::IfcProduct>();
+			for (IfcSchema::IfcProduct::list::it it = products->begin(); it != products->end(); ++it) {
+				IfcSchema::IfcProduct* product = *it;
+				if (!product->hasRepresentation()) {
+					continue;
+				}
+				Bnd_Box b;
+				if (kernel.find_box_representation(product, b)) {
+					add_box(product, b);
+				} else {
+					unboxed->push(product);
+				}
+			}
+
+			if (unboxed->size()) {
+				IfcGeom::IteratorSettings settings_ = settings;
+				settings_.set(IfcGeom::IteratorSettings::DISABLE_TRIANGULATION, true);
+				settings_.set(IfcGeom::IteratorSettings::USE_WORLD_COORDS, true);
+				settings_.set(IfcGeom::IteratorSettings::DISABLE_OPENING_SUBTRACTIONS, true);
+
+				std::vector<converted_shape> shapes;
+				convert_(f, settings_, unboxed, num_threads, memo, shapes);
+
+				for (std::vector<converted_shape>::const_iterator it = shapes.begin(); it != shapes.end(); ++it) {
+					add_box((IfcSchema::IfcProduct*)f.entityById(it->id), it->box);
+				}
+			}
+
+			tree_.build();
+		}
+
+		static const boost::uint32_t FORMAT_VERSION = 2;
+
+		/// A key for the trees built from the file with the given settings, based on the
+		/// instances in the file and the settings that affect the geometry. Trees built
+		/// with add_file_boxes() have a different key, as their boxes are not computed
+		/// with the settings as given.
+		static StructuralHash::value_type file_key(const IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings, bool boxes_only = false) {
+			// Summed, as the order in which the instances are iterated over is unspecified
+			StructuralHash::value_type instances = 0;
+			for (IfcParse::IfcFile::const_iterator it = f.begin(); it != f.end(); ++it) {
+				if (!IfcSchema::Type::IsSimple(it->second->type())) {
+					instances += StructuralHash::hash(it->second->entity->toString(true));
+				}
+			}
+			StructuralHash::value_type h = FORMAT_VERSION;
+			StructuralHash::combine(h, instances);
+			for (int i = 0; i <= IteratorSettings::NUM_SETTINGS; ++i) {
+				StructuralHash::combine(h, settings.get(1 << i));
+			}
+			StructuralHash::combine(h, StructuralHash::hash(settings.deflection_tolerance()));
+			StructuralHash::combine(h, StructuralHash::hash(settings.relative_deflection()));
+			StructuralHash::combine(h, StructuralHash::hash(settings.min_deflection()));
+			StructuralHash::combine(h, StructuralHash::hash(settings.max_deflection()));
+			StructuralHash::combine(h, StructuralHash::hash(settings.angular_deflection()));
+			StructuralHash::combine(h, settings.max_boolean_attempts());
+			StructuralHash::combine(h, StructuralHash::hash(settings.boolean_timeout()));
+			StructuralHash::combine(h, boxes_only);
+			return h;
+		}
+
+		/// Writes the hierarchy and the boxes of the elements to a file, so that read() can
+		/// restore the tree without converting any geometry. The shapes are included when
+		/// requested, otherwise the restored tree only supports select_box(). The key
+		/// identifies the model, see file_key().
+		bool write(const std::string& filename, StructuralHash::value_type key, bool include_shapes = true) const {
+			std::ofstream stream(filename.c_str(), std::ios_base::binary);
+			if (!stream) {
+				Logger::Error("Unable to open '" + filename + "' for writing");
+				return false;
+			}
+
+			const std::string magic = magic_();
+			stream.write(magic.data(), magic.size());
+			write_value_<boost::uint32_t>(stream, FORMAT_VERSION);
+			write_value_(stream, key);
+
+			tree_.write(stream, write_id_());
+
+			// Elements without shapes, or of which the shapes are not written
+			box_map_t boxes = boxes_;
+			if (!include_shapes) {
+				for (map_t::const_iterator it = shapes_.begin(); it != shapes_.end(); ++it) {
+					Bnd_Box b;
+					BRepBndLib::AddClose(it->second, b);
+					boxes[it->first] = b;
+				}
+			}
+			write_value_<boost::uint64_t>(stream, boxes.size());
+			for (box_map_t::const_iterator it = boxes.begin(); it != boxes.end(); ++it) {
+				write_value_<boost::uint32_t>(stream, it->first->entity->id());
+				double xyz[6] = { 0., 0., 0., -1., -1., -1. };
+				if (!it->second.IsVoid()) {
+					it->second.Get(xyz[0], xyz[1], xyz[2], xyz[3], xyz[4], xyz[5]);
+				}
+				stream.write(reinterpret_cast<const char*>(xyz), sizeof(xyz));
+			}
+
+			// The shapes are written as a single compound, so that shared geometry remains shared
+			write_value_<boost::uint8_t>(stream, include_shapes ? 1 : 0);
+			if (include_shapes) {
+				BRep_Builder builder;
+				TopoDS_Compound compound;
+				builder.MakeCompound(compound);
+				write_value_<boost::uint64_t>(stream, shapes_.size());
+				for (map_t::const_iterator it = shapes_.begin(); it != shapes_.end(); ++it) {
+					write_value_<boost::uint32_t>(stream, it->first->entity->id());
+					builder.Add(compound, it->second);
+				}
+				BRepTools::Write(compound, stream);
+			}
+
+			return !!stream;
+		}
+
+		bool write(const IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings, const std::string& filename, bool include_shapes = true) const {
+			return write(filename, file_key(f, settings, boxes_only_), include_shapes);
+		}
+
+		/// Replaces the contents of the tree with those written by write() with the same key.
+		/// Returns false, leaving the tree unchanged, if the file is missing, is invalid or
+		/// has been written for a different key.
+		bool read(IfcParse::IfcFile& f, const std::string& filename, StructuralHash::value_type key) {
+			std::ifstream stream(filename.c_str(), std::ios_base::binary);
+			if (!stream) {
+				return false;
+			}
+
+			tree_t tree;
+			map_t shapes;
+			box_map_t boxes;
+			try {
+				std::string magic(magic_().size(), '\0');
+				if (!stream.read(&magic[0], magic.size()) || magic != magic_()) {
+					throw std::runtime_error("Not a tree file");
+				}
+				if (read_value_<boost::uint32_t>(stream) != FORMAT_VERSION) {
+					throw std::runtime_error("Incompatible tree file version");
+				}
+				if (read_value_<StructuralHash::value_type>(stream) != key) {
+					Logger::Notice("Tree file '" + filename + "' has been written for a different model");
+					return false;
+				}
+
+				if (!tree.read(stream, read_id_(f))) {
+					throw std::runtime_error("Invalid hierarchy");
+				}
+
+				const boost::uint64_t num_boxes = read_value_<boost::uint64_t>(stream);
+				for (boost::uint64_t i = 0; i < num_boxes; ++i) {
+					IfcSchema::IfcProduct* product = product_(f, read_value_<boost::uint32_t>(stream));
+					double xyz[6];
+					if (!stream.read(reinterpret_cast<char*>(xyz), sizeof(xyz))) {
+						throw std::runtime_error("Unexpected end of tree file");
+					}
+					Bnd_Box b;
+					if (xyz[0] <= xyz[3]) {
+						b.Update(xyz[0], xyz[1], xyz[2], xyz[3], xyz[4], xyz[5]);
+					}
+					boxes[product] = b;
+				}
+
+				if (read_value_<boost::uint8_t>(stream)) {
+					const boost::uint64_t num_shapes = read_value_<boost::uint64_t>(stream);
+					std::vector<IfcSchema::IfcProduct*> products;
+					for (boost::uint64_t i = 0; i < num_shapes; ++i) {
+						products.push_back(product_(f, read_value_<boost::uint32_t>(stream)));
+					}
+					TopoDS_Shape compound;
+					BRep_Builder builder;
+					BRepTools::Read(compound, stream, builder);
+					std::vector<IfcSchema::IfcProduct*>::const_iterator jt = products.begin();
+					for (TopoDS_Iterator it(compound); it.More() && jt != products.end(); it.Next(), ++jt) {
+						shapes[*jt] = it.Value();
+					}
+					if (jt != products.end()) {
+						throw std::runtime_error("Missing shapes");
+					}
+				}
+			} catch (const std::exception& e) {
+				Logger::Error("Failed to read tree file '" + filename + "': " + e.what());
+				return false;
+			} catch (const Standard_Failure&) {
+				Logger::Error("Failed to read tree file '" + filename + "'");
+				return false;
+			}
+
+			tree_ = tree;
+			shapes_.swap(shapes);
+			boxes_.swap(boxes);
+			boost::lock_guard<boost::mutex> lock(*meshes_mutex_);
+			meshes_.clear();
+			return true;
+		}
+
+		/// Reads a tree written for the file and settings, which only succeeds for a tree
+		/// built with add_file_boxes() if boxes_only is set, and vice versa.
+		bool read(IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings, const std::string& filename, bool boxes_only = false) {
+			if (!read(f, filename, file_key(f, settings, boxes_only))) {
+				return false;
+			}
+			boxes_only_ = boxes_only;
+			return true;
+		}
+
+	private:
+		static IfcGeom::IteratorSettings shape_settings_(const IfcGeom::IteratorSettings& settings) {
 			IfcGeom::IteratorSettings settings_ = settings;
 			settings_.set(IfcGeom::IteratorSettings::DISABLE_TRIANGULATION, true);
 			settings_.set(IfcGeom::IteratorSettings::USE_WORLD_COORDS, true);
 			settings_.set(IfcGeom::IteratorSettings::SEW_SHELLS, true);
+			return settings_;
+		}
 
-			IfcGeom::Iterator<double> it(settings_, &f);
+		static std::string magic_() {
+			return "IfcOpenShell-tree";
+		}
+
+		// Values are written in native byte order, tree files are not meant to be
+		// shared between machines.
+		template <typename V>
+		static void write_value_(std::ostream& s, const V& v) {
+			s.write(reinterpret_cast<const char*>(&v), sizeof(V));
+		}
+
+		template <typename V>
+		static V read_value_(std::istream& s) {
+			V v;
+			if (!s.read(reinterpret_cast<char*>(&v), sizeof(V))) {
+				throw std::runtime_error("Unexpected end of tree file");
+			}
+			return v;
+		}
+
+		static IfcSchema::IfcProduct* product_(IfcParse::IfcFile& f, boost::uint32_t id) {
+			IfcUtil::IfcBaseClass* e = f.entityById(id);
+			if (!e || !e->is(IfcSchema::Type::IfcProduct)) {
+				throw std::runtime_error("Invalid product reference");
+			}
+			return (IfcSchema::IfcProduct*)e;
+		}
+
+		struct write_id_ {
+			void operator()(std::ostream& s, IfcSchema::IfcProduct* p) const {
+				write_value_<boost::uint32_t>(s, p->entity->id());
+			}
+		};
+
+		struct read_id_ {
+			IfcParse::IfcFile& f;
+			read_id_(IfcParse::IfcFile& f) : f(f) {}
+			bool operator()(std::istream& s, IfcSchema::IfcProduct*& p) const {
+				p = product_(f, read_value_<boost::uint32_t>(s));
+				return true;
+			}
+		};
+
+		struct converted_shape {
+			unsigned int id;
+			TopoDS_Shape shape;
+			Bnd_Box box;
+		};
+
+		// Converts a subset of the products in a copy of the file on a worker thread. As
+		// the copies have the same instance ids, the tasks share their placement memo.
+		struct conversion_task {
+			const std::string* data;
+			IfcGeom::IteratorSettings settings;
+			boost::shared_ptr<PlacementMemo> memo;
+			std::vector<unsigned int> ids;
+			std::vector<converted_shape> shapes;
+
+			conversion_task(const std::string* data, const IfcGeom::IteratorSettings& settings, const boost::shared_ptr<PlacementMemo>& memo)
+				: data(data)
+				, settings(settings)
+				, memo(memo)
+			{}
+
+			void operator()() {
+				try {
+					std::istringstream stream(*data);
+					IfcParse::IfcFile file;
+					if (!file.Init(stream, static_cast<int>(data->size()))) {
+						return;
+					}
+					IfcSchema::IfcProduct::list::ptr products(new IfcSchema::IfcProduct::list);
+					for (std::vector<unsigned int>::const_iterator it = ids.begin(); it != ids.end(); ++it) {
+						products->push((IfcSchema::IfcProduct*)file.entityById(*it));
+					}
+					convert_(file, settings, products, memo, shapes);
+				} catch (const std::exception& e) {
+					Logger::Error(e);
+				}
+			}
+		};
+
+		static void convert_(IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings, const IfcSchema::IfcProduct::list::ptr& products,
+			const boost::shared_ptr<PlacementMemo>& memo, std::vector<converted_shape>& shapes)
+		{
+			IfcGeom::Iterator<double> it(settings, &f);
+			it.set_placement_memo(memo);
+			if (products) {
+				if (products->size() == 0) {
+					return;
+				}
+				it.include_products(products);
+			}
 
 			if (it.initialize()) {
 				do {
 					IfcGeom::BRepElement<double>* elem = (IfcGeom::BRepElement<double>*)it.get();
-					add((IfcSchema::IfcProduct*)f.entityById(elem->id()), elem->geometry().as_compound());
+					converted_shape c;
+					c.id = elem->id();
+					c.shape = elem->geometry().as_compound();
+					BRepBndLib::AddClose(c.shape, c.box);
+					shapes.push_back(c);
 				} while (it.next());
 			}
 		}
+
+		static void convert_(IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings, const IfcSchema::IfcProduct::list::ptr& products, int num_threads, std::vector<converted_shape>& shapes) {
+			IfcGeom::Kernel kernel;
+			convert_(f, settings, products, num_threads, placement_memo_(f, settings, kernel), shapes);
+		}
+
+		static void convert_(IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings, IfcSchema::IfcProduct::list::ptr products, int num_threads,
+			const boost::shared_ptr<PlacementMemo>& memo, std::vector<converted_shape>& shapes)
+		{
+			std::stringstream ss;
+			if (num_threads > 1) {
+				ss << f;
+			}
+			// The parser takes the length of a file as an int
+			if (num_threads <= 1 || ss.tellp() > static_cast<std::streamoff>((std::numeric_limits<int>::max)())) {
+				if (num_threads > 1) {
+					Logger::Notice("File is too large to be copied to other threads, converting on a single thread");
+				}
+				convert_(f, settings, products, memo, shapes);
+				return;
+			}
+
+			if (!products) {
+				products = f.entitiesByType<IfcSchema::IfcProduct>();
+			}
+
+			// Group the products by representation, so that geometry can still be reused
+			std::map<unsigned int, std::vector<unsigned int> > groups;
+			for (IfcSchema::IfcProduct::list::it it = products->begin(); it != products->end(); ++it) {
+				if ((*it)->hasRepresentation()) {
+					groups[representation_key_(*it)].push_back((*it)->entity->id());
+				}
+			}
+
+			const std::string data = ss.str();
+
+			// Static state that is initialized on first use
+			IfcGeom::get_default_style("");
+
+			std::vector<conversion_task> tasks(num_threads, conversion_task(&data, settings, memo));
+			for (std::map<unsigned int, std::vector<unsigned int> >::const_iterator it = groups.begin(); it != groups.end(); ++it) {
+				conversion_task* least_loaded = &tasks.front();
+				for (std::vector<conversion_task>::iterator jt = tasks.begin(); jt != tasks.end(); ++jt) {
+					if (jt->ids.size() < least_loaded->ids.size()) {
+						least_loaded = &*jt;
+					}
+				}
+				least_loaded->ids.insert(least_loaded->ids.end(), it->second.begin(), it->second.end());
+			}
+
+			boost::thread_group threads;
+			for (std::vector<conversion_task>::iterator it = tasks.begin(); it != tasks.end(); ++it) {
+				threads.create_thread(boost::ref(*it));
+			}
+			threads.join_all();
+
+			for (std::vector<conversion_task>::const_iterator it = tasks.begin(); it != tasks.end(); ++it) {
+				shapes.insert(shapes.end(), it->shapes.begin(), it->shapes.end());
+			}
+		}
+
+		// A placement memo for the conversion of the file with the settings, as the kernels
+		// of the iterators would create it. Initializes the units of the kernel.
+		static boost::shared_ptr<PlacementMemo> placement_memo_(IfcParse::IfcFile& f, const IfcGeom::IteratorSettings& settings, IfcGeom::Kernel& kernel) {
+			IfcSchema::IfcProject::list::ptr projects = f.entitiesByType<IfcSchema::IfcProject>();
+			if (projects->size() == 1) {
+				try {
+					kernel.initializeUnits((*projects->begin())->UnitsInContext());
+				} catch (const std::exception& e) {
+					Logger::Error(e);
+				}
+			}
+			IfcSchema::Type::Enum placement_rel_to = IfcSchema::Type::UNDEFINED;
+			if (settings.get(IfcGeom::IteratorSettings::BUILDING_LOCAL_PLACEMENT)) {
+				placement_rel_to = IfcSchema::Type::IfcBuilding;
+			} else if (settings.get(IfcGeom::IteratorSettings::SITE_LOCAL_PLACEMENT)) {
+				placement_rel_to = IfcSchema::Type::IfcSite;
+			}
+			kernel.set_conversion_placement_rel_to(placement_rel_to);
+			return boost::shared_ptr<PlacementMemo>(new PlacementMemo(placement_rel_to, kernel.getValue(IfcGeom::Kernel::GV_LENGTH_UNIT)));
+		}
+
+		// The instance id of the representation that is mapped to, or otherwise of the
+		// first representation of the product
+		static unsigned int representation_key_(IfcSchema::IfcProduct* product) {
+			IfcSchema::IfcRepresentation::list::ptr representations = product->Representation()->Representations();
+			if (representations->size() == 0) {
+				return 0;
+			}
+			IfcSchema::IfcRepresentation* representation = *representations->begin();
+			IfcSchema::IfcRepresentationItem::list::ptr items = representation->Items();
+			if (items->size() == 1 && (*items->begin())->is(IfcSchema::Type::IfcMappedItem)) {
+				IfcSchema::IfcMappedItem* item = (IfcSchema::IfcMappedItem*)*items->begin();
+				return item->MappingSource()->MappedRepresentation()->entity->id();
+			}
+			return representation->entity->id();
+		}
+
+		// Whether add_file_boxes() has been used, so that the boxes of the tree are not
+		// those of the shapes converted with the settings passed to write()
+		bool boxes_only_;
 	};
 
 }
@@ -0,0 +1,678 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#include "../ifcgeom/IfcGeomTriangleMesh.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace {
+	void sub(const double* a, const double* b, double* r) {
+		r[0] = a[0] - b[0]; r[1] = a[1] - b[1]; r[2] = a[2] - b[2];
+	}
+
+	void cross(const double* a, const double* b, double* r) {
+		r[0] = a[1] * b[2] - a[2] * b[1];
+		r[1] = a[2] * b[0] - a[0] * b[2];
+		r[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	double dot(const double* a, const double* b) {
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	// Unit normal of the triangle, false for degenerate triangles
+	bool plane(const double* v0, const double* v1, const double* v2, double* n) {
+		double e1[3], e2[3];
+		sub(v1, v0, e1);
+		sub(v2, v0, e2);
+		cross(e1, e2, n);
+		const double l = std::sqrt(dot(n, n));
+		if (l == 0.) {
+			return false;
+		}
+		n[0] /= l; n[1] /= l; n[2] /= l;
+		return true;
+	}
+
+	// The interval of the line through p along d in which the triangle with signed plane
+	// distances ds intersects the plane of the other triangle, with the end points of the
+	// interval in q0 and q1. At least one vertex lies strictly on the other side of the
+	// plane than the remaining ones.
+	void interval(const double* const* vs, const double* ds, const double* p, const double* d, double& t0, double& t1, double* q0, double* q1) {
+		// Find the vertex that is alone on its side of the plane
+		int lone = 0;
+		for (int i = 0; i < 3; ++i) {
+			const double a = ds[(i + 1) % 3], b = ds[(i + 2) % 3];
+			if ((ds[i] > 0. && a <= 0. && b <= 0.) || (ds[i] < 0. && a >= 0. && b >= 0.)) {
+				lone = i;
+				break;
+			}
+		}
+		double ts[2], qs[2][3];
+		for (int k = 0; k < 2; ++k) {
+			const int other = (lone + 1 + k) % 3;
+			// The point on the edge between the lone vertex and the other vertex on the plane
+			const double s = ds[lone] / (ds[lone] - ds[other]);
+			double diff[3];
+			for (int j = 0; j < 3; ++j) {
+				qs[k][j] = vs[lone][j] + s * (vs[other][j] - vs[lone][j]);
+			}
+			sub(qs[k], p, diff);
+			ts[k] = dot(diff, d);
+		}
+		const int first = ts[0] <= ts[1] ? 0 : 1;
+		t0 = ts[first];
+		t1 = ts[1 - first];
+		for (int j = 0; j < 3; ++j) {
+			q0[j] = qs[first][j];
+			q1[j] = qs[1 - first][j];
+		}
+	}
+
+	// Signed distances of the vertices to the plane, with those within the tolerance
+	// snapped to zero. Returns false if the triangle does not cross the plane.
+	bool crosses_plane(const double* const* vs, const double* n, const double* o, double tolerance, double* ds) {
+		bool above = false, below = false;
+		for (int i = 0; i < 3; ++i) {
+			double diff[3];
+			sub(vs[i], o, diff);
+			ds[i] = dot(diff, n);
+			if (std::fabs(ds[i]) <= tolerance) {
+				ds[i] = 0.;
+			}
+			above = above || ds[i] > 0.;
+			below = below || ds[i] < 0.;
+		}
+		return above && below;
+	}
+
+	void expand(double* lo, double* hi, const double* p) {
+		for (int j = 0; j < 3; ++j) {
+			lo[j] = (std::min)(lo[j], p[j]);
+			hi[j] = (std::max)(hi[j], p[j]);
+		}
+	}
+
+	// The point on the triangle closest to p, following Ericson, Real-Time Collision Detection
+	void closest_point(const double* p, const double* a, const double* b, const double* c, double* r) {
+		double ab[3], ac[3], ap[3], bp[3], cp[3];
+		sub(b, a, ab); sub(c, a, ac); sub(p, a, ap);
+		const double d1 = dot(ab, ap), d2 = dot(ac, ap);
+		if (d1 <= 0. && d2 <= 0.) {
+			r[0] = a[0]; r[1] = a[1]; r[2] = a[2];
+			return;
+		}
+		sub(p, b, bp);
+		const double d3 = dot(ab, bp), d4 = dot(ac, bp);
+		if (d3 >= 0. && d4 <= d3) {
+			r[0] = b[0]; r[1] = b[1]; r[2] = b[2];
+			return;
+		}
+		const double vc = d1 * d4 - d3 * d2;
+		if (vc <= 0. && d1 >= 0. && d3 <= 0.) {
+			const double v = d1 / (d1 - d3);
+			for (int j = 0; j < 3; ++j) r[j] = a[j] + v * ab[j];
+			return;
+		}
+		sub(p, c, cp);
+		const double d5 = dot(ab, cp), d6 = dot(ac, cp);
+		if (d6 >= 0. && d5 <= d6) {
+			r[0] = c[0]; r[1] = c[1]; r[2] = c[2];
+			return;
+		}
+		const double vb = d5 * d2 - d1 * d6;
+		if (vb <= 0. && d2 >= 0. && d6 <= 0.) {
+			const double w = d2 / (d2 - d6);
+			for (int j = 0; j < 3; ++j) r[j] = a[j] + w * ac[j];
+			return;
+		}
+		const double va = d3 * d6 - d5 * d4;
+		if (va <= 0. && (d4 - d3) >= 0. && (d5 - d6) >= 0.) {
+			const double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+			for (int j = 0; j < 3; ++j) r[j] = b[j] + w * (c[j] - b[j]);
+			return;
+		}
+		const double denom = 1. / (va + vb + vc);
+		const double v = vb * denom, w = vc * denom;
+		for (int j = 0; j < 3; ++j) r[j] = a[j] + ab[j] * v + ac[j] * w;
+	}
+
+	// The ray triangle test by Moller and Trumbore, edges and vertices are considered hit
+	bool ray_triangle(const double* o, const double* d, const double* v0, const double* v1, const double* v2, double& t) {
+		double e1[3], e2[3], pv[3], tv[3], qv[3];
+		sub(v1, v0, e1);
+		sub(v2, v0, e2);
+		cross(d, e2, pv);
+		const double det = dot(e1, pv);
+		if (det == 0.) {
+			return false;
+		}
+		sub(o, v0, tv);
+		const double u = dot(tv, pv) / det;
+		if (u < 0. || u > 1.) {
+			return false;
+		}
+		cross(tv, e1, qv);
+		const double v = dot(d, qv) / det;
+		if (v < 0. || u + v > 1.) {
+			return false;
+		}
+		t = dot(e2, qv) / det;
+		return true;
+	}
+
+	double distance_sq(const double* a, const double* b) {
+		double d[3];
+		sub(a, b, d);
+		return dot(d, d);
+	}
+
+	double clamp01(double v) {
+		return v < 0. ? 0. : (v > 1. ? 1. : v);
+	}
+
+	// The squared distance between the segments p1 q1 and p2 q2, following Ericson
+	double segment_distance_sq(const double* p1, const double* q1, const double* p2, const double* q2) {
+		double d1[3], d2[3], r[3];
+		sub(q1, p1, d1);
+		sub(q2, p2, d2);
+		sub(p1, p2, r);
+		const double a = dot(d1, d1), e = dot(d2, d2), f = dot(d2, r);
+		double s = 0., t = 0.;
+		if (a == 0. && e == 0.) {
+			// Both segments degenerate to points
+		} else if (a == 0.) {
+			t = clamp01(f / e);
+		} else {
+			const double c = dot(d1, r);
+			if (e == 0.) {
+				s = clamp01(-c / a);
+			} else {
+				const double b = dot(d1, d2), denom = a * e - b * b;
+				s = denom != 0. ? clamp01((b * f - c * e) / denom) : 0.;
+				t = (b * s + f) / e;
+				if (t < 0.) {
+					t = 0.;
+					s = clamp01(-c / a);
+				} else if (t > 1.) {
+					t = 1.;
+					s = clamp01((b - c) / a);
+				}
+			}
+		}
+		double c1[3], c2[3];
+		for (int j = 0; j < 3; ++j) {
+			c1[j] = p1[j] + d1[j] * s;
+			c2[j] = p2[j] + d2[j] * t;
+		}
+		return distance_sq(c1, c2);
+	}
+
+	// Visitors of the triangle hierarchy, lowering the limit of the traversal to the
+	// closest hit found so far
+
+	struct closest_ray_hit {
+		const std::vector<double>& verts;
+		const std::vector<int>& tris;
+		const double *o, *d;
+		bool hit;
+		double t;
+
+		closest_ray_hit(const std::vector<double>& verts, const std::vector<int>& tris, const double* o, const double* d)
+			: verts(verts), tris(tris), o(o), d(d), hit(false), t(0.) {}
+
+		void operator()(boost::uint32_t i, double, double& max_t) {
+			double s;
+			if (ray_triangle(o, d, &verts[3 * tris[3 * i]], &verts[3 * tris[3 * i + 1]], &verts[3 * tris[3 * i + 2]], s) && s >= 0. && s <= max_t) {
+				hit = true;
+				t = max_t = s;
+			}
+		}
+	};
+
+	struct closest_surface_point {
+		const std::vector<double>& verts;
+		const std::vector<int>& tris;
+		const double* p;
+		bool found;
+		double distance, q[3];
+
+		closest_surface_point(const std::vector<double>& verts, const std::vector<int>& tris, const double* p)
+			: verts(verts), tris(tris), p(p), found(false), distance(0.) {
+			q[0] = q[1] = q[2] = 0.;
+		}
+
+		void operator()(boost::uint32_t i, double, double& max_distance) {
+			double r[3], diff[3];
+			closest_point(p, &verts[3 * tris[3 * i]], &verts[3 * tris[3 * i + 1]], &verts[3 * tris[3 * i + 2]], r);
+			sub(p, r, diff);
+			const double l = std::sqrt(dot(diff, diff));
+			if (l <= max_distance) {
+				found = true;
+				distance = max_distance = l;
+				q[0] = r[0]; q[1] = r[1]; q[2] = r[2];
+			}
+		}
+	};
+}
+
+int IfcGeom::TriangleMesh::add_vertex(double x, double y, double z) {
+	verts_.push_back(x);
+	verts_.push_back(y);
+	verts_.push_back(z);
+	return static_cast<int>(verts_.size() / 3 - 1);
+}
+
+void IfcGeom::TriangleMesh::add_triangle(int a, int b, int c) {
+	tris_.push_back(a);
+	tris_.push_back(b);
+	tris_.push_back(c);
+}
+
+IfcGeom::impl::bvh_box IfcGeom::TriangleMesh::triangle_box(size_t i, double margin) const {
+	double lo[3], hi[3];
+	for (int j = 0; j < 3; ++j) {
+		lo[j] = +std::numeric_limits<double>::infinity();
+		hi[j] = -std::numeric_limits<double>::infinity();
+	}
+	for (int k = 0; k < 3; ++k) {
+		const double* v = vertex(tris_[3 * i + k]);
+		for (int j = 0; j < 3; ++j) {
+			lo[j] = (std::min)(lo[j], v[j]);
+			hi[j] = (std::max)(hi[j], v[j]);
+		}
+	}
+	return impl::bvh_box(
+		lo[0] - margin, lo[1] - margin, lo[2] - margin,
+		hi[0] + margin, hi[1] + margin, hi[2] + margin);
+}
+
+void IfcGeom::TriangleMesh::build() {
+	for (int j = 0; j < 3; ++j) {
+		bounds_min_[j] = +std::numeric_limits<double>::infinity();
+		bounds_max_[j] = -std::numeric_limits<double>::infinity();
+	}
+	for (size_t i = 0; i < tris_.size(); ++i) {
+		const double* v = vertex(tris_[i]);
+		for (int j = 0; j < 3; ++j) {
+			bounds_min_[j] = (std::min)(bounds_min_[j], v[j]);
+			bounds_max_[j] = (std::max)(bounds_max_[j], v[j]);
+		}
+	}
+	double diagonal = 0.;
+	if (!empty()) {
+		double d[3];
+		sub(bounds_max_, bounds_min_, d);
+		diagonal = std::sqrt(dot(d, d));
+	}
+	epsilon_ = diagonal * 1.e-6;
+
+	bvh_ = impl::bvh<boost::uint32_t>();
+	for (size_t i = 0; i < num_triangles(); ++i) {
+		bvh_.add(static_cast<boost::uint32_t>(i), triangle_box(i));
+	}
+	bvh_.build();
+}
+
+bool IfcGeom::TriangleMesh::near_surface(const double* p, double distance) const {
+	std::vector<boost::uint32_t> candidates;
+	bvh_.select_box(impl::bvh_box(
+		p[0] - distance, p[1] - distance, p[2] - distance,
+		p[0] + distance, p[1] + distance, p[2] + distance), candidates);
+	for (std::vector<boost::uint32_t>::const_iterator it = candidates.begin(); it != candidates.end(); ++it) {
+		double q[3], diff[3];
+		closest_point(p, vertex(tris_[3 * *it]), vertex(tris_[3 * *it + 1]), vertex(tris_[3 * *it + 2]), q);
+		sub(p, q, diff);
+		if (dot(diff, diff) <= distance * distance) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool IfcGeom::TriangleMesh::contains_strictly(const double* p, double distance) const {
+	for (int j = 0; j < 3; ++j) {
+		if (p[j] <= bounds_min_[j] || p[j] >= bounds_max_[j]) {
+			return false;
+		}
+	}
+	return !near_surface(p, distance) && contains(p);
+}
+
+bool IfcGeom::TriangleMesh::samples_within(const TriangleMesh& other, double depth, double distance) const {
+	for (size_t i = 0; i < num_triangles(); ++i) {
+		const double* v0 = vertex(tris_[3 * i]);
+		const double* v1 = vertex(tris_[3 * i + 1]);
+		const double* v2 = vertex(tris_[3 * i + 2]);
+		double n[3];
+		if (!plane(v0, v1, v2, n)) {
+			continue;
+		}
+		double q[3];
+		for (int j = 0; j < 3; ++j) {
+			q[j] = (v0[j] + v1[j] + v2[j]) / 3. - depth * n[j];
+		}
+		if (other.contains_strictly(q, distance) && contains_strictly(q, distance)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool IfcGeom::TriangleMesh::triangles_cross(const double* a0, const double* a1, const double* a2,
+	const double* b0, const double* b1, const double* b2, double tolerance)
+{
+	double p[3], q[3];
+	return triangles_cross(a0, a1, a2, b0, b1, b2, tolerance, p, q);
+}
+
+bool IfcGeom::TriangleMesh::triangles_cross(const double* a0, const double* a1, const double* a2,
+	const double* b0, const double* b1, const double* b2, double tolerance, double* p, double* q)
+{
+	// The interval overlap test by Moller: both triangles need to cross the plane of
+	// the other, after which the segments in which they do are compared on the line
+	// in which the planes intersect.
+	const double* as[3] = { a0, a1, a2 };
+	const double* bs[3] = { b0, b1, b2 };
+
+	double na[3], nb[3], da[3], db[3];
+	if (!plane(a0, a1, a2, na) || !plane(b0, b1, b2, nb)) {
+		return false;
+	}
+	if (!crosses_plane(bs, na, a0, tolerance, db) || !crosses_plane(as, nb, b0, tolerance, da)) {
+		return false;
+	}
+
+	double d[3];
+	cross(na, nb, d);
+	const double l = std::sqrt(dot(d, d));
+	if (l == 0.) {
+		return false;
+	}
+	d[0] /= l; d[1] /= l; d[2] /= l;
+
+	double a_t0, a_t1, b_t0, b_t1, a_q0[3], a_q1[3], b_q0[3], b_q1[3];
+	interval(as, da, a0, d, a_t0, a_t1, a_q0, a_q1);
+	interval(bs, db, a0, d, b_t0, b_t1, b_q0, b_q1);
+
+	if ((std::min)(a_t1, b_t1) - (std::max)(a_t0, b_t0) <= tolerance) {
+		return false;
+	}
+
+	// The segment in which the triangles cross is the overlap of the intervals
+	const double* from = a_t0 >= b_t0 ? a_q0 : b_q0;
+	const double* to = a_t1 <= b_t1 ? a_q1 : b_q1;
+	for (int j = 0; j < 3; ++j) {
+		p[j] = from[j];
+		q[j] = to[j];
+	}
+	return true;
+}
+
+double IfcGeom::TriangleMesh::triangle_distance(const double* a0, const double* a1, const double* a2,
+	const double* b0, const double* b1, const double* b2)
+{
+	const double* as[3] = { a0, a1, a2 };
+	const double* bs[3] = { b0, b1, b2 };
+
+	// Triangles that intersect have an edge of one passing through the other
+	for (int i = 0; i < 3; ++i) {
+		double d[3], t;
+		sub(as[(i + 1) % 3], as[i], d);
+		if (ray_triangle(as[i], d, b0, b1, b2, t) && t >= 0. && t <= 1.) {
+			return 0.;
+		}
+		sub(bs[(i + 1) % 3], bs[i], d);
+		if (ray_triangle(bs[i], d, a0, a1, a2, t) && t >= 0. && t <= 1.) {
+			return 0.;
+		}
+	}
+
+	// Otherwise the closest points are on a pair of edges, or a vertex and the other triangle
+	double best = std::numeric_limits<double>::infinity();
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			best = (std::min)(best, segment_distance_sq(as[i], as[(i + 1) % 3], bs[j], bs[(j + 1) % 3]));
+		}
+		double q[3];
+		closest_point(as[i], b0, b1, b2, q);
+		best = (std::min)(best, distance_sq(as[i], q));
+		closest_point(bs[i], a0, a1, a2, q);
+		best = (std::min)(best, distance_sq(bs[i], q));
+	}
+	return std::sqrt(best);
+}
+
+int IfcGeom::TriangleMesh::count_crossings(const double* p, int axis) const {
+	const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+
+	double lo[3] = { p[0], p[1], p[2] }, hi[3] = { p[0], p[1], p[2] };
+	hi[axis] = std::numeric_limits<double>::infinity();
+	std::vector<boost::uint32_t> candidates;
+	bvh_.select_box(impl::bvh_box(lo[0], lo[1], lo[2], hi[0], hi[1], hi[2]), candidates);
+
+	int crossings = 0;
+	for (std::vector<boost::uint32_t>::const_iterator it = candidates.begin(); it != candidates.end(); ++it) {
+		const double* t[3] = { vertex(tris_[3 * *it]), vertex(tris_[3 * *it + 1]), vertex(tris_[3 * *it + 2]) };
+
+		// Orientation of the projected point relative to the projected edges
+		double w[3];
+		bool positive = false, negative = false, zero = false;
+		for (int i = 0; i < 3; ++i) {
+			const double* a = t[i];
+			const double* b = t[(i + 1) % 3];
+			w[i] = (b[u] - a[u]) * (p[v] - a[v]) - (b[v] - a[v]) * (p[u] - a[u]);
+			positive = positive || w[i] > 0.;
+			negative = negative || w[i] < 0.;
+			zero = zero || w[i] == 0.;
+		}
+		if (positive && negative) {
+			continue;
+		}
+		if (zero) {
+			// Either the triangle is seen edge-on or the ray passes through an edge
+			if (positive || negative) {
+				return -1;
+			}
+			continue;
+		}
+
+		// Barycentric interpolation of the coordinate along the ray
+		const double sum = w[0] + w[1] + w[2];
+		const double c = (w[1] * t[0][axis] + w[2] * t[1][axis] + w[0] * t[2][axis]) / sum;
+		if (c > p[axis]) {
+			++crossings;
+		}
+	}
+	return crossings;
+}
+
+bool IfcGeom::TriangleMesh::contains(const double* p) const {
+	if (empty()) {
+		return false;
+	}
+	for (int j = 0; j < 3; ++j) {
+		if (p[j] < bounds_min_[j] || p[j] > bounds_max_[j]) {
+			return false;
+		}
+	}
+	// Rays through edges or vertices are retried along another axis, from a point
+	// moved by a fraction of the precision in an arbitrary direction.
+	static const double jitter[3] = { 0.5772156649, 0.3183098862, 0.7071067812 };
+	for (int attempt = 0; attempt < 12; ++attempt) {
+		double q[3];
+		for (int j = 0; j < 3; ++j) {
+			q[j] = p[j] + attempt * epsilon_ * 1.e-2 * jitter[(j + attempt) % 3];
+		}
+		const int crossings = count_crossings(q, attempt % 3);
+		if (crossings >= 0) {
+			return crossings % 2 == 1;
+		}
+	}
+	return false;
+}
+
+bool IfcGeom::TriangleMesh::intersect_ray(const double* o, const double* d, double max_t, double& t) const {
+	closest_ray_hit visitor(verts_, tris_, o, d);
+	bvh_.traverse_ray(o, d, max_t, visitor);
+	t = visitor.t;
+	return visitor.hit;
+}
+
+bool IfcGeom::TriangleMesh::nearest_point(const double* p, double max_distance, double& distance, double* q) const {
+	closest_surface_point visitor(verts_, tris_, p);
+	bvh_.traverse_nearest(p, max_distance, visitor);
+	if (!visitor.found) {
+		return false;
+	}
+	distance = visitor.distance;
+	for (int j = 0; j < 3; ++j) {
+		q[j] = visitor.q[j];
+	}
+	return true;
+}
+
+bool IfcGeom::TriangleMesh::intersects(const TriangleMesh& other, double tolerance) const {
+	if (empty() || other.empty()) {
+		return false;
+	}
+
+	// Query the hierarchy of the larger mesh with the triangles of the smaller one
+	const TriangleMesh& a = num_triangles() <= other.num_triangles() ? *this : other;
+	const TriangleMesh& b = num_triangles() <= other.num_triangles() ? other : *this;
+
+	std::vector<boost::uint32_t> candidates;
+	for (size_t i = 0; i < a.num_triangles(); ++i) {
+		candidates.clear();
+		b.bvh_.select_box(a.triangle_box(i), candidates);
+		const double* a0 = a.vertex(a.tris_[3 * i]);
+		const double* a1 = a.vertex(a.tris_[3 * i + 1]);
+		const double* a2 = a.vertex(a.tris_[3 * i + 2]);
+		for (std::vector<boost::uint32_t>::const_iterator it = candidates.begin(); it != candidates.end(); ++it) {
+			const size_t j = *it;
+			if (triangles_cross(a0, a1, a2,
+				b.vertex(b.tris_[3 * j]), b.vertex(b.tris_[3 * j + 1]), b.vertex(b.tris_[3 * j + 2]), tolerance))
+			{
+				return true;
+			}
+		}
+	}
+
+	// The surfaces do not cross, but one mesh can still enclose the other, or their
+	// surfaces can coincide. Points on the surface are classified arbitrarily, hence
+	// points slightly below the surface are tested, away from the surface of the other.
+	const double eps = (std::max)(epsilon_, other.epsilon_);
+	return a.samples_within(b, tolerance + eps, eps / 2.) || b.samples_within(a, tolerance + eps, eps / 2.);
+}
+
+bool IfcGeom::TriangleMesh::within_distance(const TriangleMesh& other, double distance) const {
+	if (empty() || other.empty()) {
+		return false;
+	}
+
+	const TriangleMesh& a = num_triangles() <= other.num_triangles() ? *this : other;
+	const TriangleMesh& b = num_triangles() <= other.num_triangles() ? other : *this;
+
+	std::vector<boost::uint32_t> candidates;
+	for (size_t i = 0; i < a.num_triangles(); ++i) {
+		candidates.clear();
+		b.bvh_.select_box(a.triangle_box(i, distance), candidates);
+		const double* a0 = a.vertex(a.tris_[3 * i]);
+		const double* a1 = a.vertex(a.tris_[3 * i + 1]);
+		const double* a2 = a.vertex(a.tris_[3 * i + 2]);
+		for (std::vector<boost::uint32_t>::const_iterator it = candidates.begin(); it != candidates.end(); ++it) {
+			const size_t j = *it;
+			if (triangle_distance(a0, a1, a2,
+				b.vertex(b.tris_[3 * j]), b.vertex(b.tris_[3 * j + 1]), b.vertex(b.tris_[3 * j + 2])) <= distance)
+			{
+				return true;
+			}
+		}
+	}
+
+	// The surfaces are apart, but one mesh can still enclose the other
+	return b.contains(a.vertex(a.tris_[0])) || a.contains(b.vertex(b.tris_[0]));
+}
+
+bool IfcGeom::TriangleMesh::intersection_bounds(const TriangleMesh& other, double tolerance, double* lo, double* hi) const {
+	if (empty() || other.empty()) {
+		return false;
+	}
+
+	for (int j = 0; j < 3; ++j) {
+		lo[j] = +std::numeric_limits<double>::infinity();
+		hi[j] = -std::numeric_limits<double>::infinity();
+	}
+	bool found = false;
+
+	std::vector<boost::uint32_t> candidates;
+	for (size_t i = 0; i < num_triangles(); ++i) {
+		candidates.clear();
+		other.bvh_.select_box(triangle_box(i), candidates);
+		const double* a0 = vertex(tris_[3 * i]);
+		const double* a1 = vertex(tris_[3 * i + 1]);
+		const double* a2 = vertex(tris_[3 * i + 2]);
+		for (std::vector<boost::uint32_t>::const_iterator it = candidates.begin(); it != candidates.end(); ++it) {
+			const size_t k = *it;
+			double p[3], q[3];
+			if (triangles_cross(a0, a1, a2,
+				other.vertex(other.tris_[3 * k]), other.vertex(other.tris_[3 * k + 1]), other.vertex(other.tris_[3 * k + 2]), tolerance, p, q))
+			{
+				expand(lo, hi, p);
+				expand(lo, hi, q);
+				found = true;
+			}
+		}
+	}
+
+	const double eps = (std::max)(epsilon_, other.epsilon_);
+	if (!found && !samples_within(other, tolerance + eps, eps / 2.) && !other.samples_within(*this, tolerance + eps, eps / 2.)) {
+		return false;
+	}
+
+	// Vertices that are used by triangles and lie inside the other mesh
+	const TriangleMesh* meshes[2] = { this, &other };
+	for (int m = 0; m < 2; ++m) {
+		const TriangleMesh& a = *meshes[m];
+		const TriangleMesh& b = *meshes[1 - m];
+		std::vector<char> visited(a.num_vertices(), 0);
+		for (size_t i = 0; i < a.tris_.size(); ++i) {
+			const int v = a.tris_[i];
+			if (visited[v]) {
+				continue;
+			}
+			visited[v] = 1;
+			if (b.contains_strictly(a.vertex(v), eps / 2.)) {
+				expand(lo, hi, a.vertex(v));
+				found = true;
+			}
+		}
+	}
+
+	if (!found) {
+		// The surfaces coincide
+		for (int j = 0; j < 3; ++j) {
+			lo[j] = (std::max)(bounds_min_[j], other.bounds_min_[j]);
+			hi[j] = (std::min)(bounds_max_[j], other.bounds_max_[j]);
+		}
+	}
+	return true;
+}
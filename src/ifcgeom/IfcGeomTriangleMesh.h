@@ -0,0 +1,125 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+/********************************************************************************
+ *                                                                              *
+ * A triangle mesh with a bounding volume hierarchy over its triangles, used to *
+ * approximate the solid operations of the IfcGeom::tree narrow phase. The      *
+ * meshes are assumed to be closed and consistently oriented, as obtained from  *
+ * meshing valid solids.                                                        *
+ *                                                                              *
+ ********************************************************************************/
+
+#ifndef IFCGEOMTRIANGLEMESH_H
+#define IFCGEOMTRIANGLEMESH_H
+
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include "../ifcgeom/ifc_geom_api.h"
+#include "../ifcgeom/IfcGeomBvh.h"
+
+namespace IfcGeom {
+
+	class IFC_GEOM_API TriangleMesh {
+	public:
+		TriangleMesh() : epsilon_(0.) {}
+
+		/// Returns the index of the vertex
+		int add_vertex(double x, double y, double z);
+		void add_triangle(int a, int b, int c);
+
+		/// Builds the hierarchy over the triangles. Needs to be called after the
+		/// last triangle is added, before the mesh is queried from multiple threads.
+		void build();
+
+		size_t num_vertices() const { return verts_.size() / 3; }
+		size_t num_triangles() const { return tris_.size() / 3; }
+		bool empty() const { return tris_.empty(); }
+
+		/// Whether the interiors of the meshes overlap. This is the case when the
+		/// surfaces cross each other by more than the tolerance, or when a point just
+		/// more than the tolerance below the surface of one mesh is in the interior of
+		/// both, which covers enclosed and coincident meshes. Surfaces that touch, or
+		/// penetrate by less than the tolerance, are not considered to overlap.
+		bool intersects(const TriangleMesh& other, double tolerance = 0.) const;
+
+		/// Whether the surfaces are within the distance of each other, or one mesh lies
+		/// inside the other. Unlike intersects(), meshes that touch are within distance zero.
+		bool within_distance(const TriangleMesh& other, double distance) const;
+
+		/// Whether the meshes intersect as in intersects(), in which case the bounds of
+		/// the region in which they overlap are returned. The region is bounded by the
+		/// segments in which the surfaces cross and the vertices of either mesh that lie
+		/// inside the other, or by the common bounds of meshes that coincide.
+		bool intersection_bounds(const TriangleMesh& other, double tolerance, double* lo, double* hi) const;
+
+		/// Whether the point lies in the interior, based on the number of crossings of
+		/// an axis aligned ray. Points on the surface are classified arbitrarily.
+		bool contains(const double* p) const;
+
+		/// Whether the ray o + t * d hits a triangle for some t in [0, max_t], in which case
+		/// the smallest such t is returned. The direction does not need to be normalized.
+		bool intersect_ray(const double* o, const double* d, double max_t, double& t) const;
+
+		/// Whether any triangle lies within max_distance of p, in which case the distance
+		/// to the closest point on the surface and that point q are returned.
+		bool nearest_point(const double* p, double max_distance, double& distance, double* q) const;
+
+		/// Whether the triangles (a0, a1, a2) and (b0, b1, b2) cross by more than the tolerance.
+		/// Coplanar triangles, and triangles that merely touch, do not cross.
+		static bool triangles_cross(const double* a0, const double* a1, const double* a2,
+			const double* b0, const double* b1, const double* b2, double tolerance);
+
+		/// The smallest distance between the points of the triangles (a0, a1, a2) and (b0, b1, b2)
+		static double triangle_distance(const double* a0, const double* a1, const double* a2,
+			const double* b0, const double* b1, const double* b2);
+
+		/// As triangles_cross(), returning the end points of the segment in which they cross
+		static bool triangles_cross(const double* a0, const double* a1, const double* a2,
+			const double* b0, const double* b1, const double* b2, double tolerance, double* p, double* q);
+
+	private:
+		const double* vertex(int i) const { return &verts_[3 * i]; }
+		impl::bvh_box triangle_box(size_t i, double margin = 0.) const;
+
+		// Whether the point is within the distance of any of the triangles
+		bool near_surface(const double* p, double distance) const;
+
+		// Whether the point is in the interior, further than the distance from the surface
+		bool contains_strictly(const double* p, double distance) const;
+
+		// Whether any of the triangle centroids, moved inwards by the depth, is
+		// strictly within both this and the other mesh.
+		bool samples_within(const TriangleMesh& other, double depth, double distance) const;
+
+		// Returns the number of crossings of the ray from p along the positive
+		// direction of the axis, or -1 when it passes through an edge or vertex.
+		int count_crossings(const double* p, int axis) const;
+
+		std::vector<double> verts_;
+		std::vector<int> tris_;
+		double bounds_min_[3], bounds_max_[3], epsilon_;
+		impl::bvh<boost::uint32_t> bvh_;
+	};
+
+}
+
+#endif
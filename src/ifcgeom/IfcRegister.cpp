@@ -50,8 +50,7 @@ bool IfcGeom::Kernel::convert_shape(const IfcBaseClass* l, TopoDS_Shape& r) {
 	bool ignored = false;
 
 #ifndef NO_CACHE
-	std::map<int,TopoDS_Shape>::const_iterator it = cache.Shape.find(id);
-	if ( it != cache.Shape.end() ) { r = it->second; return true; }
+	if ( cache.Shape.find(id, r) ) { return true; }
 #endif
 	const bool include_curves = getValue(GV_DIMENSIONALITY) != +1;
 	const bool include_solids_and_surfaces = getValue(GV_DIMENSIONALITY) != -1;
@@ -88,7 +87,11 @@ bool IfcGeom::Kernel::convert_shape(const IfcBaseClass* l, TopoDS_Shape& r) {
 		const double precision = getValue(GV_PRECISION);
 		apply_tolerance(r, precision);
 #ifndef NO_CACHE
-		cache.Shape[id] = r;
+		// Booleans of a product with an exhausted budget yield un-cut or incomplete
+		// shapes, which should not be reused by products with a budget of their own
+		if (!is_boolean_budget_exceeded()) {
+			cache.Shape.insert(id, r);
+		}
 #endif
 	} else if (!ignored) {
 		const char* const msg = processed
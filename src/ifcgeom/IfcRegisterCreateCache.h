@@ -1,6 +1,6 @@
 ﻿#include "IfcRegisterUndef.h"
 #define CLASS(T,V) \
-	std::map<int,V> T;
+	CacheMap<V> T;
 #include "IfcRegisterDef.h"
 
 #include "IfcRegister.h"
\ No newline at end of file
@@ -0,0 +1,6 @@
+﻿#include "IfcRegisterUndef.h"
+#define CLASS(T,V) \
+	T.set_recency(&recency_);
+#include "IfcRegisterDef.h"
+
+#include "IfcRegister.h"
\ No newline at end of file
@@ -103,6 +103,14 @@ void swrite(std::ostream& s, std::string t) {
 	while (len++ % 4) s.put(0);
 }
 
+// Writes a block of memory in the same format as a string, without copying it first
+void swrite_block(std::ostream& s, const void* data, size_t size) {
+	int32_t len = (int32_t)size;
+	swrite(s, len);
+	s.write((const char*)data, len);
+	while (len++ % 4) s.put(0);
+}
+
 class Command {
 protected:
 	virtual void read_content(std::istream& s) = 0;
@@ -246,25 +254,26 @@ protected:
 		const int integer_representation_id = atoi(representation_id.c_str());
 		swrite<int32_t>(s, (int32_t)integer_representation_id);
 
-		swrite(s, std::string((char*)geom->geometry().verts().data(), geom->geometry().verts().size() * sizeof(float)));
-		swrite(s, std::string((char*)geom->geometry().normals().data(), geom->geometry().normals().size() * sizeof(float)));
+		// The mesh data is written directly from the buffer of the triangulation, which
+		// is built once for all elements that share the triangulation. The protocol
+		// expects 32 bit indices, regardless of the number of vertices.
+		const boost::shared_ptr<const IfcGeom::MeshBuffer> buffer = geom->geometry().buffer(
+			IfcGeom::MeshBuffer::NORMALS_FLOAT32, IfcGeom::MeshBuffer::INDICES_UINT32);
+		swrite_block(s, buffer->positions(), buffer->num_vertices() * 3 * sizeof(float));
+		swrite_block(s, buffer->normals(), buffer->normals() ? buffer->num_vertices() * 3 * sizeof(float) : 0);
 		{
-			std::vector<int32_t> indices;
-			const std::vector<int>& faces = geom->geometry().faces();
-			indices.reserve(faces.size());
-			for (std::vector<int>::const_iterator it = faces.begin(); it != faces.end(); ++it) {
-				indices.push_back(*it);
-			} 
-			swrite(s, std::string((char*) indices.data(), indices.size() * sizeof(int32_t)));
+			swrite_block(s, buffer->faces(), buffer->num_triangles() * 3 * sizeof(int32_t));
 
 			if (append_line_data) {
 				std::vector<int32_t> lines;
-				std::set<int32_t> faces_set (indices.begin(), indices.end());
+				std::set<int32_t> faces_set;
+				for (size_t i = 0; i < buffer->num_triangles() * 3; ++i) {
+					faces_set.insert(static_cast<int32_t>(buffer->face_index(i)));
+				}
 				
-				const std::vector<int>& edges = geom->geometry().edges();
-				for ( std::vector<int>::const_iterator it = edges.begin(); it != edges.end(); ) {
-					const int32_t i1 = *(it++);
-					const int32_t i2 = *(it++);
+				for (size_t i = 0; i < buffer->num_edges(); ++i) {
+					const int32_t i1 = static_cast<int32_t>(buffer->edge_index(2 * i));
+					const int32_t i2 = static_cast<int32_t>(buffer->edge_index(2 * i + 1));
 
 					if (faces_set.find(i1) != faces_set.end() || faces_set.find(i2) != faces_set.end()) {
 						continue;
@@ -274,7 +283,7 @@ protected:
 					lines.push_back(i2);
 				}
 
-				swrite(s, std::string((char*) lines.data(), lines.size() * sizeof(int32_t)));
+				swrite_block(s, lines.data(), lines.size() * sizeof(int32_t));
 			}
 		}
 		{ std::vector<float> diffuse_color_array;
@@ -296,12 +305,8 @@ protected:
 				diffuse_color_array.push_back(1.f);
 			}
 		}
-		swrite(s, std::string((char*) diffuse_color_array.data(), diffuse_color_array.size() * sizeof(float))); }
-		{ std::vector<int32_t> material_indices;
-		for (std::vector<int>::const_iterator it = geom->geometry().material_ids().begin(); it != geom->geometry().material_ids().end(); ++it) {
-			material_indices.push_back(*it);
-		} 
-		swrite(s, std::string((char*) material_indices.data(), material_indices.size() * sizeof(int32_t))); }
+		swrite_block(s, diffuse_color_array.data(), diffuse_color_array.size() * sizeof(float)); }
+		swrite_block(s, buffer->material_ids(), buffer->num_material_ids() * sizeof(int32_t));
 		if (eext_) {
 			eext_->write_contents(s);
 		}
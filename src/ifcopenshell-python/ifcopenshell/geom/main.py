@@ -103,8 +103,11 @@ class tree(ifcopenshell_wrapper.tree):
                 args.append(settings)
         ifcopenshell_wrapper.tree.__init__(*args)
 
-    def add_file(self, file, settings):
-        ifcopenshell_wrapper.tree.add_file(self, file.wrapped_data, settings)
+    def add_file(self, file, settings, num_threads=1):
+        ifcopenshell_wrapper.tree.add_file(self, file.wrapped_data, settings, num_threads)
+
+    def add_file_boxes(self, file, settings, num_threads=1):
+        ifcopenshell_wrapper.tree.add_file_boxes(self, file.wrapped_data, settings, num_threads)
 
     def select(self, value, **kwargs):
         def unwrap(value):
@@ -138,6 +141,80 @@ class tree(ifcopenshell_wrapper.tree):
             args.append(kwargs.get("extend", -1.e-5))
         return [entity_instance(e) for e in ifcopenshell_wrapper.tree.select_box(*args)]
 
+    def select_box_batch(self, boxes, completely_within=False, num_threads=1):
+        def unwrap(value):
+            if hasattr(value, "Get"):
+                return value.Get()
+            return tuple(value[0]) + tuple(value[1])
+
+        results = ifcopenshell_wrapper.tree.select_box_batch(self, [unwrap(b) for b in boxes], completely_within, num_threads)
+        return [[entity_instance(e) for e in es] for es in results]
+
+    def select_batch(self, values, completely_within=False, num_threads=1):
+        values = list(values)
+        if all(isinstance(v, entity_instance) for v in values):
+            results = ifcopenshell_wrapper.tree.select_batch(self, [v.wrapped_data for v in values], completely_within, num_threads)
+        else:
+            if has_occ:
+                import OCC.TopoDS
+                values = [utils.serialize_shape(v) if isinstance(v, OCC.TopoDS.TopoDS_Shape) else v for v in values]
+            results = ifcopenshell_wrapper.tree.select_shape_batch(self, values, num_threads)
+        return [[entity_instance(e) for e in es] for es in results]
+
+    def select_points(self, points, elements=None, num_threads=1):
+        points = [tuple(p) for p in points]
+        if elements is None:
+            results = ifcopenshell_wrapper.tree.select_points(self, points, num_threads)
+        else:
+            elements = [e.wrapped_data for e in elements]
+            results = ifcopenshell_wrapper.tree.select_points_among(self, points, elements, num_threads)
+        return [[entity_instance(e) for e in es] for es in results]
+
+    def select_ray(self, origin, direction, max_distance=float("inf"), all_hits=False):
+        hits = ifcopenshell_wrapper.tree.select_ray(self, tuple(origin), tuple(direction), max_distance, all_hits)
+        return [(entity_instance(e), d, p) for e, d, p in hits]
+
+    def select_nearest(self, point, k=1, max_distance=float("inf")):
+        hits = ifcopenshell_wrapper.tree.select_nearest(self, tuple(point), k, max_distance)
+        return [(entity_instance(e), d, p) for e, d, p in hits]
+
+    def select_ray_batch(self, origins, directions, max_distance=float("inf"), all_hits=False, num_threads=1):
+        hits = ifcopenshell_wrapper.tree.select_ray_batch(self, [tuple(o) for o in origins], [tuple(d) for d in directions], max_distance, all_hits, num_threads)
+        return [[(entity_instance(e), d, p) for e, d, p in hs] for hs in hits]
+
+    def select_nearest_batch(self, points, k=1, max_distance=float("inf"), num_threads=1):
+        hits = ifcopenshell_wrapper.tree.select_nearest_batch(self, [tuple(p) for p in points], k, max_distance, num_threads)
+        return [[(entity_instance(e), d, p) for e, d, p in hs] for hs in hits]
+
+    def clashes(self, a, b, tolerance=0., clearance=0., num_threads=1):
+        def unwrap(values):
+            return [v.wrapped_data for v in values]
+
+        clashes = ifcopenshell_wrapper.tree.clashes(self, unwrap(a), unwrap(b), tolerance, clearance, num_threads)
+        return [(entity_instance(x), entity_instance(y), ty, d, p) for x, y, ty, d, p in clashes]
+
+    def adjacency(self, elements, spaces, tolerance, num_threads=1):
+        def unwrap(values):
+            return [v.wrapped_data for v in values]
+
+        return ifcopenshell_wrapper.tree.adjacency(self, unwrap(elements), unwrap(spaces), tolerance, num_threads)
+
+    def remove(self, element):
+        return ifcopenshell_wrapper.tree.remove(self, element.wrapped_data)
+
+    def update(self, element, shape):
+        if has_occ:
+            import OCC.TopoDS
+            if isinstance(shape, OCC.TopoDS.TopoDS_Shape):
+                shape = utils.serialize_shape(shape)
+        ifcopenshell_wrapper.tree.update(self, element.wrapped_data, shape)
+
+    def write(self, file, settings, filename, include_shapes=True):
+        return ifcopenshell_wrapper.tree.write(self, file.wrapped_data, settings, filename, include_shapes)
+
+    def read(self, file, settings, filename, boxes_only=False):
+        return ifcopenshell_wrapper.tree.read(self, file.wrapped_data, settings, filename, boxes_only)
+
 
 def create_shape(settings, inst, repr=None):
     """
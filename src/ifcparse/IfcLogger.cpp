@@ -26,6 +26,9 @@
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/version.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/tss.hpp>
 
 #include <iostream>
 #include <algorithm>
@@ -35,6 +38,18 @@ using boost::property_tree::ptree;
 namespace {
 	static const char* severity_strings[] = {"Notice", "Warning", "Error"};
 
+	// Guards the output streams
+	boost::mutex log_mutex;
+
+	boost::thread_specific_ptr< boost::optional<IfcSchema::IfcProduct*> > current_product;
+
+	boost::optional<IfcSchema::IfcProduct*> product_of_current_thread() {
+		if (current_product.get()) {
+			return *current_product;
+		}
+		return boost::none;
+	}
+
 	void plain_text_message(std::ostream& os, const boost::optional<IfcSchema::IfcProduct*>& current_product, Logger::Severity type, const std::string& message, IfcEntityInstanceData* entity) {
 		os << "[" << severity_strings[type] << "] ";
 		if (current_product) {
@@ -61,7 +76,11 @@ namespace {
 }
 
 void Logger::SetProduct(boost::optional<IfcSchema::IfcProduct*> product) {
-	current_product = product;
+	if (current_product.get()) {
+		*current_product = product;
+	} else {
+		current_product.reset(new boost::optional<IfcSchema::IfcProduct*>(product));
+	}
 }
 
 void Logger::SetOutput(std::ostream* l1, std::ostream* l2) { 
@@ -74,11 +93,17 @@ void Logger::SetOutput(std::ostream* l1, std::ostream* l2) {
 
 void Logger::Message(Logger::Severity type, const std::string& message, IfcEntityInstanceData* entity) {
 	if (log2 && type >= verbosity) {
+		// The message is formatted by the calling thread, as the product and entity
+		// may be read lazily from a file that is not shared with other threads.
+		std::stringstream ss;
+		const boost::optional<IfcSchema::IfcProduct*> product = product_of_current_thread();
 		if (format == FMT_PLAIN) {
-			plain_text_message(*log2, current_product, type, message, entity);
+			plain_text_message(ss, product, type, message, entity);
 		} else if (format == FMT_JSON) {
-			json_message(*log2, current_product, type, message, entity);
+			json_message(ss, product, type, message, entity);
 		}
+		boost::lock_guard<boost::mutex> lock(log_mutex);
+		(*log2) << ss.str() << std::flush;
 	}
 }
 
@@ -88,6 +113,7 @@ void Logger::Message(Logger::Severity type, const std::exception& exception, Ifc
 
 void Logger::Status(const std::string& message, bool new_line) {
 	if (log1) {
+		boost::lock_guard<boost::mutex> lock(log_mutex);
 		(*log1) << message;
 		if ( new_line ) (*log1) << std::endl;
 		else (*log1) << std::flush;
@@ -101,6 +127,7 @@ void Logger::ProgressBar(int progress) {
 }
 
 std::string Logger::GetLog() {
+	boost::lock_guard<boost::mutex> lock(log_mutex);
 	return log_stream.str();
 }
 
@@ -114,5 +141,4 @@ std::ostream* Logger::log1 = 0;
 std::ostream* Logger::log2 = 0;
 std::stringstream Logger::log_stream;
 Logger::Severity Logger::verbosity = Logger::LOG_NOTICE;
-Logger::Format Logger::format = Logger::FMT_PLAIN;
-boost::optional<IfcSchema::IfcProduct*> Logger::current_product;
\ No newline at end of file
+Logger::Format Logger::format = Logger::FMT_PLAIN;
\ No newline at end of file
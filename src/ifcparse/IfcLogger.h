@@ -47,8 +47,10 @@ private:
 	static std::stringstream log_stream;
 	static Severity verbosity;
 	static Format format;
-	static boost::optional<IfcSchema::IfcProduct*> current_product;
 public:
+	/// Sets the product that subsequent messages of the calling thread relate to.
+	/// Messages can be logged from multiple threads, e.g. by iterators that each
+	/// process their own copy of a file.
 	static void SetProduct(boost::optional<IfcSchema::IfcProduct*> product);
 	/// Determines to what stream respectively progress and errors are logged
 	static void SetOutput(std::ostream* l1, std::ostream* l2);
@@ -36,7 +36,13 @@
 	$result = PyBool_FromLong(static_cast<long>(*$1));
 }
 
-%ignore IfcGeom::impl::tree::selector;
+%ignore IfcGeom::impl::bvh;
+%ignore IfcGeom::impl::bvh_box;
+%ignore IfcGeom::impl::adjacency_graph;
+
+// Mesh buffers are exposed as dictionaries of memoryviews, see Triangulation.buffer()
+%ignore IfcGeom::Representation::Triangulation<float>::buffer;
+%ignore IfcGeom::Representation::Triangulation<double>::buffer;
 
 %include "../ifcgeom/ifc_geom_api.h"
 %include "../ifcgeom/IfcGeomIteratorSettings.h"
@@ -59,6 +65,54 @@
 		return r;
 	}
 
+	static std::vector<IfcSchema::IfcProduct*> list_to_vector(IfcEntityList::ptr es) {
+		std::vector<IfcSchema::IfcProduct*> ps;
+		for (IfcEntityList::it it = es->begin(); it != es->end(); ++it) {
+			if (!(*it)->is(IfcSchema::Type::IfcProduct)) {
+				throw IfcParse::IfcException("Instance should be an IfcProduct");
+			}
+			ps.push_back((IfcSchema::IfcProduct*)*it);
+		}
+		return ps;
+	}
+
+	static gp_Pnt vector_to_point(const std::vector<double>& v) {
+		if (v.size() != 3) {
+			throw IfcParse::IfcException("Point should have three coordinates");
+		}
+		return gp_Pnt(v[0], v[1], v[2]);
+	}
+
+	static gp_Dir vector_to_direction(const std::vector<double>& v) {
+		if (v.size() != 3) {
+			throw IfcParse::IfcException("Direction should have three components");
+		}
+		if (v[0] == 0. && v[1] == 0. && v[2] == 0.) {
+			throw IfcParse::IfcException("Direction should not be zero");
+		}
+		return gp_Dir(v[0], v[1], v[2]);
+	}
+
+	static std::vector<gp_Pnt> vectors_to_points(const std::vector< std::vector<double> >& ps) {
+		std::vector<gp_Pnt> qs;
+		for (size_t i = 0; i < ps.size(); ++i) {
+			qs.push_back(IfcGeom_tree_vector_to_point(ps[i]));
+		}
+		return qs;
+	}
+
+	static PyObject* vectors_to_lists(const std::vector< std::vector<IfcSchema::IfcProduct*> >& es) {
+		PyObject* result = PyList_New(es.size());
+		for (size_t i = 0; i < es.size(); ++i) {
+			PyObject* item = PyList_New(es[i].size());
+			for (size_t j = 0; j < es[i].size(); ++j) {
+				PyList_SetItem(item, j, pythonize(es[i][j]));
+			}
+			PyList_SetItem(result, i, item);
+		}
+		return result;
+	}
+
 	IfcEntityList::ptr select_box(IfcUtil::IfcBaseClass* e, bool completely_within = false, double extend=-1.e-5) const {
 		if (!e->is(IfcSchema::Type::IfcProduct)) {
 			throw IfcParse::IfcException("Instance should be an IfcProduct");
@@ -100,6 +154,184 @@
 		return IfcGeom_tree_vector_to_list(ps);
 	}
 
+	// Returns for every box, given as (xmin, ymin, zmin, xmax, ymax, zmax), a list of the
+	// elements of which the box intersects it, or is completely within it
+	PyObject* select_box_batch(const std::vector< std::vector<double> >& bs, bool completely_within = false, int num_threads = 1) const {
+		std::vector<Bnd_Box> boxes(bs.size());
+		for (size_t i = 0; i < bs.size(); ++i) {
+			if (bs[i].size() != 6) {
+				throw IfcParse::IfcException("Box should have six coordinates");
+			}
+			boxes[i].Update(bs[i][0], bs[i][1], bs[i][2], bs[i][3], bs[i][4], bs[i][5]);
+		}
+		return IfcGeom_tree_vectors_to_lists($self->select_box(boxes, completely_within, num_threads));
+	}
+
+	// Returns for every element a list of the elements that intersect it, or that it is
+	// completely within, as select() does for a single element
+	PyObject* select_batch(IfcEntityList::ptr elements, bool completely_within = false, int num_threads = 1) const {
+		return IfcGeom_tree_vectors_to_lists($self->select(IfcGeom_tree_list_to_vector(elements), completely_within, num_threads));
+	}
+
+	// Returns for every serialized shape a list of the elements that intersect it
+	PyObject* select_shape_batch(const std::vector<std::string>& shape_serializations, int num_threads = 1) const {
+		std::vector<TopoDS_Shape> shps;
+		for (std::vector<std::string>::const_iterator it = shape_serializations.begin(); it != shape_serializations.end(); ++it) {
+			std::stringstream stream(*it);
+			BRepTools_ShapeSet shapes;
+			shapes.Read(stream);
+			shps.push_back(shapes.Shape(shapes.NbShapes()));
+		}
+		return IfcGeom_tree_vectors_to_lists($self->select(shps, num_threads));
+	}
+
+	// Returns for every point a list of the elements that contain it, classified in bulk
+	// and, with the mesh narrow phase enabled, on the meshes of the elements
+	PyObject* select_points(const std::vector< std::vector<double> >& ps, int num_threads = 1) const {
+		return IfcGeom_tree_vectors_to_lists($self->select(IfcGeom_tree_vectors_to_points(ps), num_threads));
+	}
+
+	// As select_points(), but only classifies the points against the given elements
+	PyObject* select_points_among(const std::vector< std::vector<double> >& ps, IfcEntityList::ptr elements, int num_threads = 1) const {
+		return IfcGeom_tree_vectors_to_lists($self->select(IfcGeom_tree_vectors_to_points(ps), IfcGeom_tree_list_to_vector(elements), num_threads));
+	}
+
+	bool remove(IfcUtil::IfcBaseClass* e) {
+		if (!e->is(IfcSchema::Type::IfcProduct)) {
+			throw IfcParse::IfcException("Instance should be an IfcProduct");
+		}
+		return $self->remove((IfcSchema::IfcProduct*)e);
+	}
+
+	void update(IfcUtil::IfcBaseClass* e, const std::string& shape_serialization) {
+		if (!e->is(IfcSchema::Type::IfcProduct)) {
+			throw IfcParse::IfcException("Instance should be an IfcProduct");
+		}
+		std::stringstream stream(shape_serialization);
+		BRepTools_ShapeSet shapes;
+		shapes.Read(stream);
+		const TopoDS_Shape& shp = shapes.Shape(shapes.NbShapes());
+
+		$self->update((IfcSchema::IfcProduct*)e, shp);
+	}
+
+	// Defined on the base class template, which is not wrapped itself
+	void set_mesh_narrow_phase(bool enabled, double tolerance = 0., double deflection = 1.e-3) {
+		$self->set_mesh_narrow_phase(enabled, tolerance, deflection);
+	}
+
+	// Returns a list of (a, b, type, distance, (x, y, z)) tuples, with type either
+	// 'collision' or 'clearance'
+	PyObject* clashes(IfcEntityList::ptr a, IfcEntityList::ptr b, double tolerance = 0., double clearance = 0., int num_threads = 1) const {
+		std::vector<IfcGeom::tree::clash_t> cs = $self->clashes(IfcGeom_tree_list_to_vector(a), IfcGeom_tree_list_to_vector(b), tolerance, clearance, num_threads);
+		PyObject* result = PyList_New(cs.size());
+		for (size_t i = 0; i < cs.size(); ++i) {
+			const IfcGeom::tree::clash_t& c = cs[i];
+			PyObject* point = PyTuple_New(3);
+			PyTuple_SetItem(point, 0, PyFloat_FromDouble(c.point.X()));
+			PyTuple_SetItem(point, 1, PyFloat_FromDouble(c.point.Y()));
+			PyTuple_SetItem(point, 2, PyFloat_FromDouble(c.point.Z()));
+			PyObject* item = PyTuple_New(5);
+			PyTuple_SetItem(item, 0, pythonize(c.a));
+			PyTuple_SetItem(item, 1, pythonize(c.b));
+			PyTuple_SetItem(item, 2, pythonize(std::string(c.type == IfcGeom::tree::clash_t::COLLISION ? "collision" : "clearance")));
+			PyTuple_SetItem(item, 3, PyFloat_FromDouble(c.distance));
+			PyTuple_SetItem(item, 4, point);
+			PyList_SetItem(result, i, item);
+		}
+		return result;
+	}
+
+	static PyObject* edges_to_list(const std::vector< std::pair<size_t, size_t> >& es) {
+		PyObject* result = PyList_New(es.size());
+		for (size_t i = 0; i < es.size(); ++i) {
+			PyObject* edge = PyTuple_New(2);
+			PyTuple_SetItem(edge, 0, pythonize(static_cast<int>(es[i].first)));
+			PyTuple_SetItem(edge, 1, pythonize(static_cast<int>(es[i].second)));
+			PyList_SetItem(result, i, edge);
+		}
+		return result;
+	}
+
+	// Returns a (contacts, containment) tuple of lists of (i, j) index pairs, into the
+	// elements for contacts and into the elements and spaces respectively for containment
+	PyObject* adjacency(IfcEntityList::ptr elements, IfcEntityList::ptr spaces, double tolerance, int num_threads = 1) const {
+		IfcGeom::impl::adjacency_graph g = $self->adjacency(IfcGeom_tree_list_to_vector(elements), IfcGeom_tree_list_to_vector(spaces), tolerance, num_threads);
+		PyObject* result = PyTuple_New(2);
+		PyTuple_SetItem(result, 0, IfcGeom_tree_edges_to_list(g.contacts));
+		PyTuple_SetItem(result, 1, IfcGeom_tree_edges_to_list(g.containment));
+		return result;
+	}
+
+	// Returns a list of (element, distance, (x, y, z)) tuples
+	static PyObject* hits_to_list(const std::vector<IfcGeom::tree::hit_t>& hs) {
+		PyObject* result = PyList_New(hs.size());
+		for (size_t i = 0; i < hs.size(); ++i) {
+			const IfcGeom::tree::hit_t& h = hs[i];
+			PyObject* point = PyTuple_New(3);
+			PyTuple_SetItem(point, 0, PyFloat_FromDouble(h.point.X()));
+			PyTuple_SetItem(point, 1, PyFloat_FromDouble(h.point.Y()));
+			PyTuple_SetItem(point, 2, PyFloat_FromDouble(h.point.Z()));
+			PyObject* item = PyTuple_New(3);
+			PyTuple_SetItem(item, 0, pythonize(h.element));
+			PyTuple_SetItem(item, 1, PyFloat_FromDouble(h.distance));
+			PyTuple_SetItem(item, 2, point);
+			PyList_SetItem(result, i, item);
+		}
+		return result;
+	}
+
+	// Returns a list of (element, distance, (x, y, z)) tuples, closest first
+	PyObject* select_ray(const std::vector<double>& origin, const std::vector<double>& direction,
+		double max_distance = std::numeric_limits<double>::infinity(), bool all_hits = false) const
+	{
+		return IfcGeom_tree_hits_to_list($self->select_ray(IfcGeom_tree_vector_to_point(origin), IfcGeom_tree_vector_to_direction(direction), max_distance, all_hits));
+	}
+
+	// Returns a list of (element, distance, (x, y, z)) tuples, nearest first
+	PyObject* select_nearest(const std::vector<double>& p, int k = 1, double max_distance = std::numeric_limits<double>::infinity()) const {
+		return IfcGeom_tree_hits_to_list($self->select_nearest(IfcGeom_tree_vector_to_point(p), k, max_distance));
+	}
+
+	// Returns a list with the result of select_ray() for every ray
+	PyObject* select_ray_batch(const std::vector< std::vector<double> >& origins, const std::vector< std::vector<double> >& directions,
+		double max_distance = std::numeric_limits<double>::infinity(), bool all_hits = false, int num_threads = 1) const
+	{
+		std::vector<gp_Pnt> os;
+		std::vector<gp_Dir> ds;
+		for (size_t i = 0; i < origins.size(); ++i) {
+			os.push_back(IfcGeom_tree_vector_to_point(origins[i]));
+		}
+		for (size_t i = 0; i < directions.size(); ++i) {
+			ds.push_back(IfcGeom_tree_vector_to_direction(directions[i]));
+		}
+		if (os.size() != ds.size()) {
+			throw IfcParse::IfcException("Number of origins and directions differ");
+		}
+		std::vector< std::vector<IfcGeom::tree::hit_t> > hs = $self->select_ray(os, ds, max_distance, all_hits, num_threads);
+		PyObject* result = PyList_New(hs.size());
+		for (size_t i = 0; i < hs.size(); ++i) {
+			PyList_SetItem(result, i, IfcGeom_tree_hits_to_list(hs[i]));
+		}
+		return result;
+	}
+
+	// Returns a list with the result of select_nearest() for every point
+	PyObject* select_nearest_batch(const std::vector< std::vector<double> >& ps, int k = 1,
+		double max_distance = std::numeric_limits<double>::infinity(), int num_threads = 1) const
+	{
+		std::vector<gp_Pnt> qs;
+		for (size_t i = 0; i < ps.size(); ++i) {
+			qs.push_back(IfcGeom_tree_vector_to_point(ps[i]));
+		}
+		std::vector< std::vector<IfcGeom::tree::hit_t> > hs = $self->select_nearest(qs, k, max_distance, num_threads);
+		PyObject* result = PyList_New(hs.size());
+		for (size_t i = 0; i < hs.size(); ++i) {
+			PyList_SetItem(result, i, IfcGeom_tree_hits_to_list(hs[i]));
+		}
+		return result;
+	}
+
 }
 
 // Using RTTI return a more specialized type of Element
@@ -196,6 +428,13 @@ struct ShapeRTTI : public boost::static_visitor<PyObject*>
 };
 
 %extend IfcGeom::Representation::Triangulation {
+	boost::shared_ptr<const IfcGeom::MeshBuffer> buffer_views(int normal_encoding) const {
+		if (normal_encoding < IfcGeom::MeshBuffer::NORMALS_NONE || normal_encoding > IfcGeom::MeshBuffer::NORMALS_PACKED_10_10_10) {
+			throw std::runtime_error("Unsupported normal encoding");
+		}
+		return $self->buffer(static_cast<IfcGeom::MeshBuffer::NormalEncoding>(normal_encoding));
+	}
+
 	%pythoncode %{
 		if _newclass:
 			# Hide the getters with read-only property implementations
@@ -204,6 +443,14 @@ struct ShapeRTTI : public boost::static_visitor<PyObject*>
 			edges = property(edges)
 			material_ids = property(material_ids)
 			materials = property(materials)
+
+		def buffer(self, normal_encoding="float32"):
+			"""Returns the mesh as a dictionary of read-only memoryviews onto a single compact
+			buffer, which stays alive for as long as any of the views does. Positions and uvs
+			are single precision and indices are 16 bit wide when the number of vertices
+			allows. Normals are encoded as "float32", "octahedral16", "packed_10_10_10" or
+			omitted with "none"."""
+			return self.buffer_views(("none", "float32", "octahedral16", "packed_10_10_10").index(normal_encoding))
 	%}
 };
 
@@ -159,3 +159,137 @@
 		return pyobj;
 	}
 %}
+
+// Conversion of mesh buffers into Python memoryviews that borrow the arrays of the buffer.
+// Every view keeps a reference to a small exporter object, which in turn shares ownership
+// of the buffer, so that the arrays outlive the triangulation they were obtained from.
+%{
+	struct mesh_buffer_exporter {
+		PyObject_HEAD
+		boost::shared_ptr<const IfcGeom::MeshBuffer>* buffer;
+		const void* data;
+		Py_ssize_t count;
+		Py_ssize_t itemsize;
+		const char* format;
+	};
+
+	void mesh_buffer_exporter_dealloc(PyObject* self) {
+		delete reinterpret_cast<mesh_buffer_exporter*>(self)->buffer;
+		PyObject_Del(self);
+	}
+
+	int mesh_buffer_exporter_getbuffer(PyObject* self, Py_buffer* view, int flags) {
+		mesh_buffer_exporter* exporter = reinterpret_cast<mesh_buffer_exporter*>(self);
+		if (PyBuffer_FillInfo(view, self, const_cast<void*>(exporter->data), exporter->count * exporter->itemsize, 1, flags) != 0) {
+			return -1;
+		}
+		// Without a format the consumer expects unsigned bytes
+		if ((flags & PyBUF_FORMAT) == PyBUF_FORMAT) {
+			view->format = const_cast<char*>(exporter->format);
+			view->itemsize = exporter->itemsize;
+			if ((flags & PyBUF_ND) == PyBUF_ND) {
+				view->shape = &exporter->count;
+			}
+		}
+		return 0;
+	}
+
+	PyTypeObject* mesh_buffer_exporter_type() {
+		static PyBufferProcs buffer_procs;
+		static PyTypeObject type = { PyVarObject_HEAD_INIT(NULL, 0) };
+		if (type.tp_name == 0) {
+			buffer_procs.bf_getbuffer = mesh_buffer_exporter_getbuffer;
+			type.tp_name = "ifcopenshell_wrapper.mesh_buffer_exporter";
+			type.tp_basicsize = sizeof(mesh_buffer_exporter);
+			type.tp_dealloc = mesh_buffer_exporter_dealloc;
+			type.tp_as_buffer = &buffer_procs;
+			type.tp_flags = Py_TPFLAGS_DEFAULT;
+			#if PY_VERSION_HEX < 0x03000000
+			type.tp_flags |= Py_TPFLAGS_HAVE_NEWBUFFER;
+			#endif
+			if (PyType_Ready(&type) != 0) {
+				type.tp_name = 0;
+				return 0;
+			}
+		}
+		return &type;
+	}
+
+	// Returns a new reference to a memoryview, or None if there is no data
+	PyObject* pythonize_mesh_buffer_array(const boost::shared_ptr<const IfcGeom::MeshBuffer>& buffer, const void* data, size_t count, size_t itemsize, const char* format) {
+		if (data == 0) {
+			Py_INCREF(Py_None);
+			return Py_None;
+		}
+		PyTypeObject* type = mesh_buffer_exporter_type();
+		if (type == 0) {
+			return 0;
+		}
+		mesh_buffer_exporter* exporter = PyObject_New(mesh_buffer_exporter, type);
+		if (exporter == 0) {
+			return 0;
+		}
+		exporter->buffer = new boost::shared_ptr<const IfcGeom::MeshBuffer>(buffer);
+		exporter->data = data;
+		exporter->count = static_cast<Py_ssize_t>(count);
+		exporter->itemsize = static_cast<Py_ssize_t>(itemsize);
+		exporter->format = format;
+		PyObject* view = PyMemoryView_FromObject(reinterpret_cast<PyObject*>(exporter));
+		Py_DECREF(exporter);
+		return view;
+	}
+
+	PyObject* pythonize(const boost::shared_ptr<const IfcGeom::MeshBuffer>& buffer) {
+		const IfcGeom::MeshBuffer& b = *buffer;
+		const bool wide_indices = b.index_size() == sizeof(boost::uint32_t);
+		const char* index_format = wide_indices ? "I" : "H";
+
+		const char* normal_encoding = "none";
+		const char* normal_format = "f";
+		size_t normal_count = 3 * b.num_vertices(), normal_itemsize = sizeof(float);
+		if (b.normal_encoding() == IfcGeom::MeshBuffer::NORMALS_FLOAT32) {
+			normal_encoding = "float32";
+		} else if (b.normal_encoding() == IfcGeom::MeshBuffer::NORMALS_OCTAHEDRAL16) {
+			normal_encoding = "octahedral16";
+			normal_format = "h";
+			normal_count = 2 * b.num_vertices();
+			normal_itemsize = sizeof(boost::int16_t);
+		} else if (b.normal_encoding() == IfcGeom::MeshBuffer::NORMALS_PACKED_10_10_10) {
+			normal_encoding = "packed_10_10_10";
+			normal_format = "I";
+			normal_count = b.num_vertices();
+			normal_itemsize = sizeof(boost::uint32_t);
+		}
+
+		PyObject* arrays[6] = {
+			pythonize_mesh_buffer_array(buffer, b.positions(), 3 * b.num_vertices(), sizeof(float), "f"),
+			pythonize_mesh_buffer_array(buffer, b.normals(), normal_count, normal_itemsize, normal_format),
+			pythonize_mesh_buffer_array(buffer, b.uvs(), 2 * b.num_vertices(), sizeof(float), "f"),
+			pythonize_mesh_buffer_array(buffer, b.faces(), 3 * b.num_triangles(), b.index_size(), index_format),
+			pythonize_mesh_buffer_array(buffer, b.edges(), 2 * b.num_edges(), b.index_size(), index_format),
+			pythonize_mesh_buffer_array(buffer, b.material_ids(), b.num_material_ids(), sizeof(boost::int32_t), "i")
+		};
+		const char* keys[6] = { "positions", "normals", "uvs", "faces", "edges", "material_ids" };
+
+		PyObject* dict = PyDict_New();
+		bool failed = dict == 0;
+		for (int i = 0; i < 6; ++i) {
+			if (arrays[i] == 0) {
+				failed = true;
+			} else {
+				if (!failed) {
+					PyDict_SetItemString(dict, keys[i], arrays[i]);
+				}
+				Py_DECREF(arrays[i]);
+			}
+		}
+		if (failed) {
+			Py_XDECREF(dict);
+			return 0;
+		}
+		PyObject* encoding = pythonize(std::string(normal_encoding));
+		PyDict_SetItemString(dict, "normal_encoding", encoding);
+		Py_DECREF(encoding);
+		return dict;
+	}
+%}
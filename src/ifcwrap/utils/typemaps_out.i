@@ -92,6 +92,14 @@
 	}
 }
 
+// The arrays of mesh buffers are returned as memoryviews, without copying them
+%typemap(out) boost::shared_ptr<const IfcGeom::MeshBuffer> {
+	$result = pythonize($1);
+	if ($result == 0) {
+		SWIG_fail;
+	}
+}
+
 %define CREATE_VECTOR_TYPEMAP_OUT(template_type)
 	%typemap(out) std::vector<template_type> {
 		$result = pythonize_vector<template_type>($1);
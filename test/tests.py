@@ -99,6 +99,144 @@ t = ifcopenshell.geom.tree(f, tree_settings)
 # This wall is connected to two other walls
 assert len(t.select_box(f[48], extend=0.1)) == 3
 
+# Trees converted on multiple threads, or of boxes only, select the same walls
+t_threaded = ifcopenshell.geom.tree()
+t_threaded.add_file(f, tree_settings, num_threads=2)
+t_boxes = ifcopenshell.geom.tree()
+t_boxes.add_file_boxes(f, tree_settings, num_threads=2)
+for tx in (t_threaded, t_boxes):
+    assert sorted(e.id() for e in tx.select_box(f[48], extend=0.1)) == \
+        sorted(e.id() for e in t.select_box(f[48], extend=0.1))
+
+# A tree of boxes only is only read back as such
+assert t_boxes.write(f, tree_settings, "output.tree")
+assert not ifcopenshell.geom.tree().read(f, tree_settings, "output.tree")
+assert ifcopenshell.geom.tree().read(f, tree_settings, "output.tree", boxes_only=True)
+os.unlink("output.tree")
+
+# A point on the surface of the wall, at the center of its first triangle
+shape_settings = ifcopenshell.geom.settings()
+shape_settings.set(shape_settings.DISABLE_OPENING_SUBTRACTIONS, True)
+shape_settings.set(shape_settings.USE_WORLD_COORDS, True)
+mesh = ifcopenshell.geom.create_shape(shape_settings, f[48]).geometry
+a, b, c = [mesh.verts[3 * i:3 * i + 3] for i in mesh.faces[0:3]]
+p = [(a[i] + b[i] + c[i]) / 3. for i in range(3)]
+u = [b[i] - a[i] for i in range(3)]
+v = [c[i] - a[i] for i in range(3)]
+n = [u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0]]
+n = [x / sum(y * y for y in n) ** 0.5 for x in n]
+
+# The compact mesh buffer holds the same mesh, with single precision positions
+mesh_buffer = mesh.buffer()
+assert len(mesh_buffer["positions"]) == len(mesh.verts)
+assert all(abs(x - y) < 1.e-4 * max(1., abs(y)) for x, y in zip(mesh_buffer["positions"].tolist(), mesh.verts))
+assert mesh_buffer["faces"].format == "H" and mesh_buffer["faces"].tolist() == list(mesh.faces)
+assert mesh_buffer["edges"].tolist() == list(mesh.edges)
+assert mesh_buffer["material_ids"].tolist() == list(mesh.material_ids)
+
+# Normals are quantized on request, the views outlive the shape they were obtained from
+buffer_settings = ifcopenshell.geom.settings()
+buffer_settings.set(buffer_settings.WELD_VERTICES, False)
+normals = ifcopenshell.geom.create_shape(buffer_settings, f[48]).geometry.normals
+def buffer_normals(normal_encoding):
+    return ifcopenshell.geom.create_shape(buffer_settings, f[48]).geometry.buffer(normal_encoding)["normals"]
+def unpack_10_10_10(v):
+    return [max(((v >> (10 * i) & 0x3ff) ^ 0x200) - 0x200, -511) / 511. for i in range(3)]
+assert all(abs(x - y) < 1.e-6 for x, y in zip(buffer_normals("float32").tolist(), normals))
+packed = [c for v in buffer_normals("packed_10_10_10").tolist() for c in unpack_10_10_10(v)]
+assert len(packed) == len(normals) and all(abs(x - y) < 2.e-3 for x, y in zip(packed, normals))
+assert len(buffer_normals("octahedral16")) == len(normals) // 3 * 2
+assert buffer_normals("none") is None
+
+# Points just in front of and behind the face, of which one is inside the wall, are
+# classified the same on meshes as by the solid classifier
+points = [[p[i] + d * n[i] for i in range(3)] for d in (-0.01, 0.01)]
+inside = [f[48] in t.select(q) for q in points]
+assert sorted(inside) == [False, True]
+t.set_mesh_narrow_phase(True)
+assert [f[48] in t.select(q) for q in points] == inside
+t.set_mesh_narrow_phase(False)
+
+# Points classified in bulk, also against a subset of the elements only
+for mesh_narrow_phase in (False, True):
+    t.set_mesh_narrow_phase(mesh_narrow_phase)
+    assert [f[48] in es for es in t.select_points(points, num_threads=2)] == inside
+    assert t.select_points(points, [f[48]]) == [[f[48]] if x else [] for x in inside]
+    others = [w for w in f.by_type("IfcWall") if w != f[48]]
+    assert not any(f[48] in es for es in t.select_points(points, others, num_threads=2))
+t.set_mesh_narrow_phase(False)
+
+# Test ray queries, towards the point from a meter away
+origin = [p[i] + n[i] for i in range(3)]
+direction = [-x for x in n]
+hits = t.select_ray(origin, direction, all_hits=True)
+distances = [h[1] for h in hits]
+assert distances == sorted(distances)
+assert f[48] in [h[0] for h in hits]
+assert all(0. < h[1] <= 1. + 1.e-3 for h in hits if h[0] == f[48])
+closest = t.select_ray(origin, direction)
+assert len(closest) == 1 and abs(closest[0][1] - distances[0]) < 1.e-9
+assert f[48] not in [h[0] for h in t.select_ray(origin, n, all_hits=True)]
+
+# Test nearest element queries
+nearest = t.select_nearest(p, k=3)
+assert len(nearest) <= 3
+assert any(h[0] == f[48] and h[1] < 1.e-3 for h in nearest)
+
+# Batches of queries yield the same results as the individual queries
+assert t.select_ray_batch([origin, origin], [direction, n], all_hits=True, num_threads=2) == \
+    [hits, t.select_ray(origin, n, all_hits=True)]
+assert t.select_nearest_batch([p, origin], k=3, num_threads=2) == [nearest, t.select_nearest(origin, k=3)]
+
+# Test clashes, which are the same on meshes as with boolean operations
+walls = f.by_type("IfcWall")
+def clash_pairs():
+    return set(frozenset((x.id(), y.id())) for x, y, ty, d, q in t.clashes(walls, walls, clearance=0.1))
+pairs = clash_pairs()
+t.set_mesh_narrow_phase(True)
+assert clash_pairs() == pairs
+t.set_mesh_narrow_phase(False)
+assert len([pair for pair in pairs if f[48].id() in pair]) == 2
+assert clash_pairs() == set(frozenset((x.id(), y.id())) for x, y, ty, d, q in t.clashes(walls, walls, clearance=0.1, num_threads=2))
+
+# Test adjacency, in terms of indices into the walls, of which there are no spaces
+contacts, containment = t.adjacency(walls, [], 0.1, num_threads=2)
+assert contacts == sorted(contacts) and containment == []
+assert all(i < j for i, j in contacts)
+assert len([e for e in contacts if walls.index(f[48]) in e]) == 2
+assert set(frozenset((walls[i].id(), walls[j].id())) for i, j in contacts) == pairs
+
+# Test writing the tree to a file and reading it back, which requires the same settings
+assert t.write(f, tree_settings, "output.tree")
+t2 = ifcopenshell.geom.tree()
+assert not t2.read(f, shape_settings, "output.tree")
+assert not t2.read(f, tree_settings, "output.tree", boxes_only=True)
+assert t2.read(f, tree_settings, "output.tree")
+os.unlink("output.tree")
+assert len(t2.select_box(f[48], extend=0.1)) == 3
+assert f[48] in [h[0] for h in t2.select_nearest(p, k=3)]
+
+# Test removing and updating elements
+shape_settings.set(shape_settings.USE_BREP_DATA, True)
+brep = ifcopenshell.geom.create_shape(shape_settings, f[48]).geometry.brep_data
+assert t.remove(f[48])
+assert not t.remove(f[48])
+assert t.select_box(f[48]) == []
+assert f[48] not in [h[0] for h in t.select_nearest(p, k=3)]
+t.update(f[48], brep)
+assert len(t.select_box(f[48], extend=0.1)) == 3
+assert f[48] in [h[0] for h in t.select_nearest(p, k=3)]
+
+# Batches of queries yield the same elements as the individual queries
+def ids(elements):
+    return sorted(e.id() for e in elements)
+boxes = [(p, p), ([x - 0.1 for x in p], [x + 0.1 for x in p])]
+assert [ids(es) for es in t.select_box_batch(boxes, num_threads=2)] == [ids(t.select_box(b)) for b in boxes]
+assert [ids(es) for es in t.select_batch(walls, num_threads=2)] == [ids(t.select(w)) for w in walls]
+assert [ids(es) for es in t.select_batch(walls, completely_within=True)] == \
+    [ids(t.select(w, completely_within=True)) for w in walls]
+assert [ids(es) for es in t.select_batch([brep], num_threads=2)] == [ids(t.select(brep))]
+
 # Test serialization
 f.write("output.ifc")
 with open("output.ifc") as txt: